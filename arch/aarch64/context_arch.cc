@@ -0,0 +1,97 @@
+#include "arch/context.h"
+
+// Saved by arch_context_switch, lowest address first. Only the low
+// 64 bits of v8-v15 are callee-saved
+struct context_frame_t {
+    uint64_t x19_x28[10];
+    uint64_t fp;
+    uint64_t lr;
+    uint64_t d8_d15[8];
+    uint64_t fpcr;
+    uint64_t unused;
+};
+
+static_assert(sizeof(context_frame_t) == 176, "Switch code layout");
+
+// A new context returns here, with entry in x19, arg in x20,
+// and context_start in x21
+extern "C" char context_trampoline[];
+
+__asm__ (
+    ".pushsection .text\n"
+    ".globl arch_context_switch\n"
+    ".type arch_context_switch,%function\n"
+    "arch_context_switch:\n"
+    "   sub sp,sp,#176\n"
+    "   stp x19,x20,[sp,#0]\n"
+    "   stp x21,x22,[sp,#16]\n"
+    "   stp x23,x24,[sp,#32]\n"
+    "   stp x25,x26,[sp,#48]\n"
+    "   stp x27,x28,[sp,#64]\n"
+    "   stp x29,x30,[sp,#80]\n"
+    "   stp d8,d9,[sp,#96]\n"
+    "   stp d10,d11,[sp,#112]\n"
+    "   stp d12,d13,[sp,#128]\n"
+    "   stp d14,d15,[sp,#144]\n"
+    "   mrs x9,fpcr\n"
+    "   str x9,[sp,#160]\n"
+    "   mov x9,sp\n"
+    "   str x9,[x0]\n"
+    "   mov sp,x1\n"
+    "   ldr x9,[sp,#160]\n"
+    "   msr fpcr,x9\n"
+    "   ldp x19,x20,[sp,#0]\n"
+    "   ldp x21,x22,[sp,#16]\n"
+    "   ldp x23,x24,[sp,#32]\n"
+    "   ldp x25,x26,[sp,#48]\n"
+    "   ldp x27,x28,[sp,#64]\n"
+    "   ldp x29,x30,[sp,#80]\n"
+    "   ldp d8,d9,[sp,#96]\n"
+    "   ldp d10,d11,[sp,#112]\n"
+    "   ldp d12,d13,[sp,#128]\n"
+    "   ldp d14,d15,[sp,#144]\n"
+    "   add sp,sp,#176\n"
+    "   ret\n"
+    ".size arch_context_switch,.-arch_context_switch\n"
+
+    ".globl context_trampoline\n"
+    ".type context_trampoline,%function\n"
+    "context_trampoline:\n"
+    "   mov x0,x19\n"
+    "   mov x1,x20\n"
+    "   blr x21\n"
+    "   brk #0\n"
+    ".size context_trampoline,.-context_trampoline\n"
+    ".popsection\n"
+);
+
+bool arch_context_available()
+{
+    return true;
+}
+
+context_t *arch_context_init(void *stack_top,
+        context_entry_t entry, void *arg)
+{
+    // sp must always be 16 byte aligned, and is the top after the frame
+    uintptr_t top = uintptr_t(stack_top) & -uintptr_t(16);
+    context_frame_t *frame = (context_frame_t*)(top -
+            sizeof(context_frame_t));
+
+    for (uint64_t &reg : frame->x19_x28)
+        reg = 0;
+
+    for (uint64_t &reg : frame->d8_d15)
+        reg = 0;
+
+    frame->x19_x28[0] = uintptr_t(entry);
+    frame->x19_x28[1] = uintptr_t(arg);
+    frame->x19_x28[2] = uintptr_t(context_start);
+    frame->fp = 0;
+    frame->lr = uintptr_t(context_trampoline);
+    frame->unused = 0;
+
+    __asm__ __volatile__ ("mrs %[fpcr],fpcr\n\t" : [fpcr] "=r" (frame->fpcr));
+
+    return (context_t*)frame;
+}
@@ -0,0 +1,38 @@
+#include "arch/cpu.h"
+
+uint32_t cpu_features;
+
+// The entry code stops FP and SIMD trapping at every exception level,
+// so there is no state left to enable here
+
+void arch_cpu_init()
+{
+    uint64_t pfr0, isar0;
+    __asm__ __volatile__ ("mrs %[pfr0],ID_AA64PFR0_EL1" : [pfr0] "=r" (pfr0));
+    __asm__ __volatile__ ("mrs %[isar0],ID_AA64ISAR0_EL1"
+        : [isar0] "=r" (isar0));
+
+    uint32_t features = 0;
+
+    // 0xF is not implemented, 1 adds half precision
+    unsigned asimd = (pfr0 >> 20) & 0xF;
+
+    if (asimd != 0xF)
+        features |= CPU_ASIMD;
+
+    if (asimd == 1)
+        features |= CPU_FP16;
+
+    // 2 is the LSE atomics
+    if (((isar0 >> 20) & 0xF) >= 2)
+        features |= CPU_LSE;
+
+    if (((isar0 >> 44) & 0xF) >= 1)
+        features |= CPU_DOTPROD;
+
+    cpu_features = features;
+}
+
+void arch_cpu_init_secondary()
+{
+}
@@ -0,0 +1,139 @@
+#include "arch/smp.h"
+#include <stddef.h>
+
+// Offsets used by the entry code in entry_arch.S
+static_assert(offsetof(smp_cpu_t, stack) == 16, "Entry code layout");
+static_assert(sizeof(smp_cpu_t) == 32, "Entry code layout");
+static_assert(SMP_MAX_CPUS == 16, "Entry code layout");
+
+extern "C" char smp_secondary_start[];
+
+// Nonzero releases the secondaries waiting in the pen
+extern "C" uint64_t smp_pen_release;
+uint64_t smp_pen_release;
+
+static constexpr uint32_t PSCI_CPU_ON = 0xC4000003;
+static constexpr uint32_t PSCI_AFFINITY_INFO = 0xC4000004;
+static constexpr int64_t PSCI_SUCCESS = 0;
+static constexpr int64_t PSCI_NOT_SUPPORTED = -1;
+static constexpr int64_t PSCI_AFFINITY_OFF = 1;
+
+// Affinity fields of MPIDR_EL1, Aff3 is above the flag bits
+static constexpr uint64_t MPIDR_AFF_MASK = 0xFF00FFFFFFULL;
+
+// Cores searched for, GICv3 can only target Aff0 0 to 15 with an SGI,
+// so clusters go no wider. Holes anywhere in the numbering are skipped
+static constexpr uint64_t SMP_SEARCH_AFF0 = 16;
+static constexpr uint64_t SMP_SEARCH_AFF1 = 16;
+static constexpr uint64_t SMP_SEARCH_AFF2 = 4;
+
+static unsigned smp_current_el()
+{
+    uint64_t el;
+    __asm__ __volatile__ ("mrs %[el],CurrentEL\n\t" : [el] "=r" (el));
+    return (el >> 2) & 3;
+}
+
+// Firmware calls go to the level above, the hypervisor from EL1,
+// or the secure monitor from EL2
+static int64_t psci_call(uint64_t fn, uint64_t a1, uint64_t a2, uint64_t a3)
+{
+    register uint64_t x0 __asm__("x0") = fn;
+    register uint64_t x1 __asm__("x1") = a1;
+    register uint64_t x2 __asm__("x2") = a2;
+    register uint64_t x3 __asm__("x3") = a3;
+
+    if (smp_current_el() == 1) {
+        __asm__ __volatile__ (
+            "hvc #0\n\t"
+            : "+r" (x0), "+r" (x1), "+r" (x2), "+r" (x3)
+            :
+            : "memory"
+        );
+    } else {
+        __asm__ __volatile__ (
+            "smc #0\n\t"
+            : "+r" (x0), "+r" (x1), "+r" (x2), "+r" (x3)
+            :
+            : "memory"
+        );
+    }
+
+    return int64_t(x0);
+}
+
+// Power on every core PSCI reports as off. There is no device tree
+// parser, so the affinities are searched instead, AFFINITY_INFO rejects
+// ones that don't exist. Firmware without AFFINITY_INFO gets CPU_ON for
+// each, and its errors are ignored
+static void smp_psci_start()
+{
+    uint64_t self;
+    __asm__ __volatile__ ("mrs %[self],MPIDR_EL1\n\t" : [self] "=r" (self));
+    self &= MPIDR_AFF_MASK;
+
+    unsigned started = 0;
+
+    for (uint64_t aff2 = 0; aff2 < SMP_SEARCH_AFF2; ++aff2) {
+        for (uint64_t aff1 = 0; aff1 < SMP_SEARCH_AFF1; ++aff1) {
+            for (uint64_t aff0 = 0; aff0 < SMP_SEARCH_AFF0; ++aff0) {
+                uint64_t mpidr = (aff2 << 16) | (aff1 << 8) | aff0;
+
+                if (mpidr == self)
+                    continue;
+
+                int64_t state = psci_call(PSCI_AFFINITY_INFO, mpidr, 0, 0);
+
+                if (state != PSCI_AFFINITY_OFF &&
+                        state != PSCI_NOT_SUPPORTED)
+                    continue;
+
+                if (psci_call(PSCI_CPU_ON, mpidr,
+                        uintptr_t(smp_secondary_start), 0) != PSCI_SUCCESS)
+                    continue;
+
+                // Any more would park
+                if (++started >= SMP_MAX_CPUS - 1)
+                    return;
+            }
+        }
+    }
+}
+
+unsigned arch_smp_start(void (*entry)(smp_cpu_t *cpu))
+{
+    if (!smp_prepare(entry))
+        return 1;
+
+    if (smp_current_el() == 3) {
+        // We are the firmware, the secondaries are already in the pen
+        __atomic_store_n(&smp_pen_release, 1, __ATOMIC_RELEASE);
+        __asm__ __volatile__ ("dsb ish\n\tsev\n\t" ::: "memory");
+    } else {
+        smp_psci_start();
+    }
+
+    return smp_collect();
+}
+
+unsigned arch_smp_cpu_index()
+{
+    smp_cpu_t *cpu;
+    __asm__ __volatile__ ("mrs %[cpu],tpidr_el0\n\t" : [cpu] "=r" (cpu));
+    return cpu->index;
+}
+
+void arch_smp_relax()
+{
+    __asm__ __volatile__ ("yield\n\t");
+}
+
+void arch_smp_wait()
+{
+    __asm__ __volatile__ ("wfe\n\t");
+}
+
+void arch_smp_wake()
+{
+    __asm__ __volatile__ ("dsb ish\n\tsev\n\t" ::: "memory");
+}
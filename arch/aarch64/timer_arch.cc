@@ -0,0 +1,22 @@
+#include "arch/timer.h"
+
+uint64_t arch_timer_ticks()
+{
+    uint64_t ticks;
+    __asm__ __volatile__ (
+        "isb\n\t"
+        "mrs %[ticks],cntpct_el0\n\t"
+        : [ticks] "=r" (ticks)
+    );
+    return ticks;
+}
+
+uint64_t arch_timer_freq()
+{
+    uint64_t freq;
+    __asm__ __volatile__ (
+        "mrs %[freq],cntfrq_el0\n\t"
+        : [freq] "=r" (freq)
+    );
+    return freq;
+}
@@ -1 +1,13 @@
 #include "context.h"
+#include "arch/halt.h"
+#include "debug.h"
+
+void context_start(context_entry_t entry, void *arg)
+{
+    entry(arg);
+
+    // There is nothing to return to
+    printdbg("Context entry returned\n");
+    debug_flush_sync();
+    arch_halt();
+}
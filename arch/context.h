@@ -1,3 +1,31 @@
 #pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "compiler.h"
 
+// Cooperative context switching. A suspended context is the callee-saved
+// registers and FP control state, pushed on its own stack, and is only
+// known by the stack pointer it left behind. Everything else is already
+// saved by the caller, as the calling convention says
 struct context_t;
+
+typedef void (*context_entry_t)(void *arg);
+
+// False where the architecture has no context switch,
+// arch_context_init returns nullptr there
+bool arch_context_available();
+
+// Build a context that calls entry(arg) on the stack ending at
+// stack_top the first time it is switched to. entry must never return.
+// The new context starts with the caller's FP control state
+context_t *arch_context_init(void *stack_top,
+        context_entry_t entry, void *arg);
+
+// Save the caller in *save, and resume restore.
+// Returns when another context switches back to *save
+extern "C"
+void arch_context_switch(context_t **save, context_t *restore);
+
+// Used by the arch code. Every new context starts here
+_noreturn
+void context_start(context_entry_t entry, void *arg);
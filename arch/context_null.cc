@@ -0,0 +1,19 @@
+#include "arch/context.h"
+#include "arch/halt.h"
+
+bool arch_context_available()
+{
+    return false;
+}
+
+context_t *arch_context_init(void */*stack_top*/,
+        context_entry_t /*entry*/, void */*arg*/)
+{
+    return nullptr;
+}
+
+// Unreachable, there is never a context to switch to
+void arch_context_switch(context_t **/*save*/, context_t */*restore*/)
+{
+    arch_halt();
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <stdint.h>
+
+// Instruction set extensions the CPU has, and the kernel enabled.
+// Every CPU is assumed to have the same set as the boot CPU
+
+enum cpu_feature_t : uint32_t {
+    // x86, the vector ones only when XCR0 enables their state
+    CPU_SSE2 = 1U << 0,
+    CPU_SSE41 = 1U << 1,
+    CPU_AVX = 1U << 2,
+    CPU_AVX2 = 1U << 3,
+    CPU_FMA = 1U << 4,
+    CPU_AVX512F = 1U << 5,
+    CPU_ERMS = 1U << 6,
+
+    // aarch64
+    CPU_ASIMD = 1U << 16,
+    CPU_FP16 = 1U << 17,
+    CPU_DOTPROD = 1U << 18,
+    CPU_LSE = 1U << 19
+};
+
+// Set by arch_cpu_init, 0 before
+extern uint32_t cpu_features;
+
+// Probe the boot CPU, and enable the state of the extensions it has.
+// Runs before anything is dispatched on cpu_features
+void arch_cpu_init();
+
+// Enable the same state on a secondary CPU, before it runs any
+// code that may have been dispatched on cpu_features
+void arch_cpu_init_secondary();
@@ -0,0 +1,12 @@
+#include "arch/cpu.h"
+
+// Nothing is probed, only the baseline variants are used
+uint32_t cpu_features;
+
+void arch_cpu_init()
+{
+}
+
+void arch_cpu_init_secondary()
+{
+}
@@ -1,2 +1,10 @@
 #pragma once
 
+// Point the CPU at the exception vectors, where a fault reports itself
+// and halts the CPU rather than resetting the machine. The boot CPU
+// builds the table, the others load the same one. Only x86_64 has these
+extern "C"
+void arch_exception_init();
+
+extern "C"
+void arch_exception_init_secondary();
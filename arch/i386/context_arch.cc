@@ -0,0 +1,104 @@
+#include "arch/context.h"
+
+// Saved by arch_context_switch, lowest address first
+struct context_frame_t {
+    uint16_t fpu_cw;
+    uint16_t unused;
+    uint32_t mxcsr;
+    uint32_t edi;
+    uint32_t esi;
+    uint32_t ebx;
+    uint32_t ebp;
+    uint32_t eip;
+};
+
+static_assert(sizeof(context_frame_t) == 28, "Switch code layout");
+
+// MXCSR only exists, and only matters, when the compiler uses SSE
+#ifdef __SSE__
+#define CONTEXT_SAVE_MXCSR "   stmxcsr 4(%esp)\n"
+#define CONTEXT_LOAD_MXCSR "   ldmxcsr 4(%esp)\n"
+#else
+#define CONTEXT_SAVE_MXCSR
+#define CONTEXT_LOAD_MXCSR
+#endif
+
+// A new context returns here, with entry in ebx, arg in esi,
+// and context_start in edi
+extern "C" char context_trampoline[];
+
+__asm__ (
+    ".pushsection .text\n"
+    ".globl arch_context_switch\n"
+    ".type arch_context_switch,@function\n"
+    "arch_context_switch:\n"
+    "   mov 4(%esp),%eax\n"
+    "   mov 8(%esp),%edx\n"
+    "   push %ebp\n"
+    "   push %ebx\n"
+    "   push %esi\n"
+    "   push %edi\n"
+    "   sub $8,%esp\n"
+    "   fnstcw (%esp)\n"
+    CONTEXT_SAVE_MXCSR
+    "   mov %esp,(%eax)\n"
+    "   mov %edx,%esp\n"
+    "   fldcw (%esp)\n"
+    CONTEXT_LOAD_MXCSR
+    "   add $8,%esp\n"
+    "   pop %edi\n"
+    "   pop %esi\n"
+    "   pop %ebx\n"
+    "   pop %ebp\n"
+    "   ret\n"
+    ".size arch_context_switch,.-arch_context_switch\n"
+
+    ".globl context_trampoline\n"
+    ".type context_trampoline,@function\n"
+    "context_trampoline:\n"
+    "   push %esi\n"
+    "   push %ebx\n"
+    "   call *%edi\n"
+    "   ud2\n"
+    ".size context_trampoline,.-context_trampoline\n"
+    ".popsection\n"
+);
+
+bool arch_context_available()
+{
+    return true;
+}
+
+context_t *arch_context_init(void *stack_top,
+        context_entry_t entry, void *arg)
+{
+    // esp is 8 off 16 byte alignment after the ret, so it is
+    // aligned at the call to context_start once the trampoline
+    // pushes the two arguments
+    uintptr_t top = uintptr_t(stack_top) & -uintptr_t(16);
+    context_frame_t *frame = (context_frame_t*)(top - 8 -
+            sizeof(context_frame_t));
+
+    __asm__ __volatile__ (
+        "fnstcw %[cw]\n\t"
+        : [cw] "=m" (frame->fpu_cw)
+    );
+
+#ifdef __SSE__
+    __asm__ __volatile__ (
+        "stmxcsr %[mxcsr]\n\t"
+        : [mxcsr] "=m" (frame->mxcsr)
+    );
+#else
+    frame->mxcsr = 0;
+#endif
+
+    frame->unused = 0;
+    frame->edi = uintptr_t(context_start);
+    frame->esi = uintptr_t(arg);
+    frame->ebx = uintptr_t(entry);
+    frame->ebp = 0;
+    frame->eip = uintptr_t(context_trampoline);
+
+    return (context_t*)frame;
+}
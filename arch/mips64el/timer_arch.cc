@@ -0,0 +1,26 @@
+#include "arch/timer.h"
+
+static uint32_t timer_last;
+static uint64_t timer_high;
+
+uint64_t arch_timer_ticks()
+{
+    uint32_t count;
+    __asm__ __volatile__ (
+        "mfc0 %[count],$9\n\t"
+        : [count] "=r" (count)
+    );
+
+    // CP0 Count is only 32 bits, extend it
+    if (count < timer_last)
+        timer_high += uint64_t(1) << 32;
+    timer_last = count;
+
+    return timer_high | count;
+}
+
+uint64_t arch_timer_freq()
+{
+    // CP0 Count runs at a CPU dependent fraction of the core clock
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include "pci.h"
 #include "debug.h"
 #include "assert.h"
+#include "fiber.h"
 
 static pci_ready_node_t *pci_ready_node_first;
 static bool pci_ready_already;
@@ -338,6 +339,9 @@ void pci_init()
                     }
                 }
             }
+
+            // Config cycles are slow, let the other fibers run
+            fiber_yield();
         }
     }
     
@@ -1006,7 +1010,10 @@ void pci_notify_pci_ready()
     }
     curr = prev;
     
-    // Execute the items in the order they were added
+    // Execute the items in the order they were added, one at a time.
+    // They reach config space through shared index and data ports on
+    // some machines, and add to driver tables without locks, so they
+    // are not spread over CPUs with parallel_for
     while (curr) {
         assert(curr->magic == curr->expected_magic);
         curr->callback(curr->callback_arg);
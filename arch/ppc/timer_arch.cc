@@ -0,0 +1,26 @@
+#include "arch/timer.h"
+
+uint64_t arch_timer_ticks()
+{
+    uint32_t hi, lo, hi2;
+
+    // Retry if the low half carried into the high half between reads
+    do {
+        __asm__ __volatile__ (
+            "mftbu %[hi]\n\t"
+            "mftb %[lo]\n\t"
+            "mftbu %[hi2]\n\t"
+            : [hi] "=r" (hi)
+            , [lo] "=r" (lo)
+            , [hi2] "=r" (hi2)
+        );
+    } while (hi != hi2);
+
+    return (uint64_t(hi) << 32) | lo;
+}
+
+uint64_t arch_timer_freq()
+{
+    // Time base frequency comes from the board, nothing tells us
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "arch/smp.h"
+#include "arch/timer.h"
+#include "arch/cpu.h"
+#include "malloc.h"
+#include "fiber.h"
+#include "likely.h"
+
+smp_cpu_t smp_cpus[SMP_MAX_CPUS];
+
+// Secondaries atomically increment this to take an index,
+// the boot CPU moves it out of range when it stops waiting
+extern "C" uint32_t smp_ap_next;
+uint32_t smp_ap_next;
+
+static void (*smp_entry)(smp_cpu_t *cpu);
+
+// Give up on more CPUs arriving after this long without one
+static constexpr uint64_t SMP_ARRIVAL_MS = 50;
+
+// Called by the entry code of each secondary, on its own stack
+extern "C" _noreturn void smp_secondary_main(smp_cpu_t *cpu);
+
+void smp_secondary_main(smp_cpu_t *cpu)
+{
+    arch_cpu_init_secondary();
+
+    __atomic_store_n(&cpu->started, 1, __ATOMIC_RELEASE);
+    arch_smp_wake();
+
+    smp_entry(cpu);
+
+    for (;;)
+        arch_smp_wait();
+}
+
+bool smp_prepare(void (*entry)(smp_cpu_t *cpu))
+{
+    smp_entry = entry;
+
+    for (unsigned i = 0; i < SMP_MAX_CPUS; ++i) {
+        smp_cpu_t *cpu = smp_cpus + i;
+
+        cpu->self = cpu;
+        cpu->index = i;
+
+        // The boot CPU keeps the stack it has
+        if (i == 0 || cpu->stack)
+            continue;
+
+        char *stack = (char*)malloc_aligned(SMP_STACK_SIZE, 64);
+
+        if (unlikely(!stack))
+            return false;
+
+        cpu->stack = stack + SMP_STACK_SIZE;
+    }
+
+    return true;
+}
+
+unsigned smp_collect()
+{
+    uint64_t freq = arch_timer_freq();
+    uint64_t wait = freq ? freq * SMP_ARRIVAL_MS / 1000 : 100000000;
+
+    uint32_t seen = 0;
+    uint64_t st = arch_timer_ticks();
+
+    // Keep waiting while they keep arriving
+    while (seen < SMP_MAX_CPUS - 1 && arch_timer_ticks() - st < wait) {
+        uint32_t arrived = __atomic_load_n(&smp_ap_next, __ATOMIC_ACQUIRE);
+
+        if (arrived != seen) {
+            seen = arrived;
+            st = arch_timer_ticks();
+        }
+
+        // Mostly waiting, let the other fibers run
+        fiber_yield();
+    }
+
+    // Anything arriving from now on gets an index out of range and parks
+    uint32_t count = __atomic_exchange_n(&smp_ap_next,
+            SMP_MAX_CPUS, __ATOMIC_ACQ_REL);
+
+    count = count < SMP_MAX_CPUS - 1 ? count : SMP_MAX_CPUS - 1;
+
+    // Every CPU that took an index will get to C code
+    for (uint32_t i = 1; i <= count; ++i) {
+        while (!__atomic_load_n(&smp_cpus[i].started, __ATOMIC_ACQUIRE))
+            arch_smp_wait();
+    }
+
+    return count + 1;
+}
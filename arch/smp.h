@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "compiler.h"
+
+// Secondary CPU bring-up. The boot CPU is CPU 0, the others are numbered
+// densely in the order they reach C code. Only the boot CPU may allocate
+
+static constexpr unsigned SMP_MAX_CPUS = 16;
+static constexpr size_t SMP_STACK_SIZE = 64 << 10;
+
+struct smp_cpu_t {
+    // Points to itself, so the entry code can find it
+    // through a per-CPU base register
+    smp_cpu_t *self;
+    uint32_t index;
+
+    // Initial stack pointer
+    void *stack;
+
+    // Set once the CPU is running C code
+    uint32_t started;
+};
+
+extern "C" smp_cpu_t smp_cpus[SMP_MAX_CPUS];
+
+// Start every secondary CPU that exists, up to SMP_MAX_CPUS. Each one
+// calls entry on its own stack, with interrupts off, and entry must never
+// return. Returns the number of CPUs running, including the boot CPU
+extern "C"
+unsigned arch_smp_start(void (*entry)(smp_cpu_t *cpu));
+
+// Index of the calling CPU
+extern "C"
+unsigned arch_smp_cpu_index();
+
+// Spin loop hint, lets the other hyperthread or vCPU run
+extern "C"
+void arch_smp_relax();
+
+// Sleep until another CPU calls arch_smp_wake, may return early.
+// WFE on aarch64. On x86 only a spin, halting would need an
+// interrupt to wake up, and interrupts are never enabled
+extern "C"
+void arch_smp_wait();
+
+// Wake every CPU in arch_smp_wait, after storing what they wait for
+extern "C"
+void arch_smp_wake();
+
+// Used by the arch code.
+// Allocate the stacks and remember entry, false if out of memory
+bool smp_prepare(void (*entry)(smp_cpu_t *cpu));
+
+// Wait for the CPUs that were started to take an index,
+// then stop handing out indices and return the CPU count
+unsigned smp_collect();
@@ -0,0 +1,23 @@
+#include "arch/smp.h"
+
+unsigned arch_smp_start(void (*/*entry*/)(smp_cpu_t *cpu))
+{
+    return 1;
+}
+
+unsigned arch_smp_cpu_index()
+{
+    return 0;
+}
+
+void arch_smp_relax()
+{
+}
+
+void arch_smp_wait()
+{
+}
+
+void arch_smp_wake()
+{
+}
@@ -0,0 +1,94 @@
+#include "arch/stream.h"
+
+typedef uint32_t v4su _vector_size(16);
+typedef v4su v4su_u _aligned(4);
+
+// Plain copy of whatever is left, 4 bytes at a time
+static void stream_copy_tail(uint32_t *dst, uint32_t const *src, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = src[i];
+}
+
+#if defined(__x86_64__) || defined(__SSE2__)
+
+typedef long long v2di _vector_size(16);
+typedef v2di v2di_u _aligned(4);
+
+void arch_stream_copy(void *dst, void const *src, size_t bytes)
+{
+    uint32_t *d = (uint32_t*)dst;
+    uint32_t const *s = (uint32_t const*)src;
+    size_t count = bytes >> 2;
+
+    // movntdq needs a 16 byte aligned destination
+    size_t head = ((16 - (uintptr_t(d) & 15)) & 15) >> 2;
+    head = head < count ? head : count;
+
+    stream_copy_tail(d, s, head);
+    d += head;
+    s += head;
+    count -= head;
+
+    for (; count >= 4; count -= 4, d += 4, s += 4)
+        __builtin_ia32_movntdq((v2di*)d, *(v2di_u const*)s);
+
+    stream_copy_tail(d, s, count);
+}
+
+void arch_stream_fence()
+{
+    __builtin_ia32_sfence();
+}
+
+#elif defined(__aarch64__)
+
+void arch_stream_copy(void *dst, void const *src, size_t bytes)
+{
+    uint32_t *d = (uint32_t*)dst;
+    uint32_t const *s = (uint32_t const*)src;
+    size_t count = bytes >> 2;
+
+    for (; count >= 8; count -= 8, d += 8, s += 8) {
+        v4su lo = *(v4su_u const*)s;
+        v4su hi = *(v4su_u const*)(s + 4);
+
+        __asm__ __volatile__ (
+            "stnp %q[lo],%q[hi],[%[d]]\n\t"
+            :
+            : [lo] "w" (lo)
+            , [hi] "w" (hi)
+            , [d] "r" (d)
+            : "memory"
+        );
+    }
+
+    stream_copy_tail(d, s, count);
+}
+
+void arch_stream_fence()
+{
+    __asm__ __volatile__ ("dmb oshst\n\t" : : : "memory");
+}
+
+#else
+
+// No non-temporal stores, at least move 16 bytes at a time
+void arch_stream_copy(void *dst, void const *src, size_t bytes)
+{
+    uint32_t *d = (uint32_t*)dst;
+    uint32_t const *s = (uint32_t const*)src;
+    size_t count = bytes >> 2;
+
+    for (; count >= 4; count -= 4, d += 4, s += 4)
+        *(v4su_u*)d = *(v4su_u const*)s;
+
+    stream_copy_tail(d, s, count);
+}
+
+void arch_stream_fence()
+{
+    __sync_synchronize();
+}
+
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "compiler.h"
+
+// Copy with non-temporal stores where the CPU has them, so copying to
+// write combined or uncached memory, like a framebuffer BAR, goes out in
+// whole lines and doesn't evict the source from the cache.
+// The destination and source must be 4 byte aligned
+extern "C"
+void arch_stream_copy(void *dst, void const *src, size_t bytes);
+
+// Make the streaming stores globally visible
+extern "C"
+void arch_stream_fence();
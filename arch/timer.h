@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+#include "compiler.h"
+
+// Free running, monotonic tick counter
+extern "C"
+uint64_t arch_timer_ticks();
+
+// Ticks per second, or 0 if it is not known on this machine
+extern "C"
+uint64_t arch_timer_freq();
@@ -0,0 +1,93 @@
+#include "arch/context.h"
+
+// Saved by arch_context_switch, lowest address first
+struct context_frame_t {
+    uint16_t fpu_cw;
+    uint16_t unused;
+    uint32_t mxcsr;
+    uint64_t r15;
+    uint64_t r14;
+    uint64_t r13;
+    uint64_t r12;
+    uint64_t rbx;
+    uint64_t rbp;
+    uint64_t rip;
+};
+
+static_assert(sizeof(context_frame_t) == 64, "Switch code layout");
+
+// A new context returns here, with entry in rbx, arg in r12,
+// and context_start in r13
+extern "C" char context_trampoline[];
+
+__asm__ (
+    ".pushsection .text\n"
+    ".globl arch_context_switch\n"
+    ".type arch_context_switch,@function\n"
+    "arch_context_switch:\n"
+    "   push %rbp\n"
+    "   push %rbx\n"
+    "   push %r12\n"
+    "   push %r13\n"
+    "   push %r14\n"
+    "   push %r15\n"
+    "   sub $8,%rsp\n"
+    "   fnstcw (%rsp)\n"
+    "   stmxcsr 4(%rsp)\n"
+    "   mov %rsp,(%rdi)\n"
+    "   mov %rsi,%rsp\n"
+    "   fldcw (%rsp)\n"
+    "   ldmxcsr 4(%rsp)\n"
+    "   add $8,%rsp\n"
+    "   pop %r15\n"
+    "   pop %r14\n"
+    "   pop %r13\n"
+    "   pop %r12\n"
+    "   pop %rbx\n"
+    "   pop %rbp\n"
+    "   ret\n"
+    ".size arch_context_switch,.-arch_context_switch\n"
+
+    ".globl context_trampoline\n"
+    ".type context_trampoline,@function\n"
+    "context_trampoline:\n"
+    "   mov %rbx,%rdi\n"
+    "   mov %r12,%rsi\n"
+    "   call *%r13\n"
+    "   ud2\n"
+    ".size context_trampoline,.-context_trampoline\n"
+    ".popsection\n"
+);
+
+bool arch_context_available()
+{
+    return true;
+}
+
+context_t *arch_context_init(void *stack_top,
+        context_entry_t entry, void *arg)
+{
+    // rsp is 16 byte aligned after the ret,
+    // so it is 8 off at context_start, like any call
+    uintptr_t top = uintptr_t(stack_top) & -uintptr_t(16);
+    context_frame_t *frame = (context_frame_t*)(top -
+            sizeof(context_frame_t));
+
+    __asm__ __volatile__ (
+        "fnstcw %[cw]\n\t"
+        "stmxcsr %[mxcsr]\n\t"
+        : [cw] "=m" (frame->fpu_cw)
+        , [mxcsr] "=m" (frame->mxcsr)
+    );
+
+    frame->unused = 0;
+    frame->r15 = 0;
+    frame->r14 = 0;
+    frame->r13 = uintptr_t(context_start);
+    frame->r12 = uintptr_t(arg);
+    frame->rbx = uintptr_t(entry);
+    frame->rbp = 0;
+    frame->rip = uintptr_t(context_trampoline);
+
+    return (context_t*)frame;
+}
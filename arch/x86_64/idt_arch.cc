@@ -0,0 +1,85 @@
+#include "arch/exception.h"
+#include "arch/halt.h"
+#include "arch/smp.h"
+#include "debug.h"
+#include <stdint.h>
+#include <stddef.h>
+
+// 16 byte entry stubs, one per vector, see exception_arch.S
+extern "C" char const interrupt_entry_points[];
+
+struct idt_gate_t {
+    uint16_t offset_lo;
+    uint16_t selector;
+    uint8_t ist;
+    uint8_t type;
+    uint16_t offset_mid;
+    uint32_t offset_hi;
+    uint32_t reserved;
+};
+
+struct _packed idt_ptr_t {
+    uint16_t limit;
+    uint64_t base;
+};
+
+// Code64 in the boot GDT, see machine/x86/entry_arch.S
+static constexpr uint16_t IDT_CODE64 = 0x18;
+
+// Present, ring 0, 64 bit interrupt gate
+static constexpr uint8_t IDT_INTR_GATE = 0x8E;
+
+// The exceptions, interrupts are never enabled. Anything past the
+// limit raises #GP, which is in range
+static constexpr size_t IDT_COUNT = 32;
+
+static idt_gate_t idt[IDT_COUNT];
+
+// Qword offsets in the frame isr_common builds, see exception_arch.S
+static constexpr size_t ISR_FRAME_INTR = 18;
+static constexpr size_t ISR_FRAME_ERROR = 19;
+static constexpr size_t ISR_FRAME_RIP = 20;
+
+static void idt_load()
+{
+    idt_ptr_t ptr = { sizeof(idt) - 1, uintptr_t(idt) };
+
+    __asm__ __volatile__ ("lidt %[ptr]\n\t" : : [ptr] "m" (ptr));
+}
+
+void arch_exception_init()
+{
+    for (size_t i = 0; i < IDT_COUNT; ++i) {
+        uintptr_t entry = uintptr_t(interrupt_entry_points + (i << 4));
+
+        idt[i].offset_lo = uint16_t(entry);
+        idt[i].selector = IDT_CODE64;
+        idt[i].ist = 0;
+        idt[i].type = IDT_INTR_GATE;
+        idt[i].offset_mid = uint16_t(entry >> 16);
+        idt[i].offset_hi = uint32_t(entry >> 32);
+        idt[i].reserved = 0;
+    }
+
+    idt_load();
+}
+
+void arch_exception_init_secondary()
+{
+    idt_load();
+}
+
+// Called by isr_common, nothing is handled, report it and stop this CPU
+extern "C" _noreturn void isr_dispatcher(uint64_t const *frame);
+
+void isr_dispatcher(uint64_t const *frame)
+{
+    printdbg("cpu %u: exception %llu, error 0x%llx at 0x%llx\n",
+            arch_smp_cpu_index(),
+            (unsigned long long)frame[ISR_FRAME_INTR],
+            (unsigned long long)frame[ISR_FRAME_ERROR],
+            (unsigned long long)frame[ISR_FRAME_RIP]);
+
+    debug_flush_sync();
+    arch_halt();
+}
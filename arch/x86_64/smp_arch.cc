@@ -0,0 +1,114 @@
+#include "arch/smp.h"
+#include "arch/timer.h"
+#include "string.h"
+#include "fiber.h"
+#include <stddef.h>
+
+// Offsets used by the entry code in machine/x86/entry_arch.S
+static_assert(offsetof(smp_cpu_t, index) == 8, "Entry code uses %gs:8");
+static_assert(offsetof(smp_cpu_t, stack) == 16, "Entry code layout");
+static_assert(sizeof(smp_cpu_t) == 32, "Entry code layout");
+static_assert(SMP_MAX_CPUS == 16, "Entry code layout");
+
+// Real mode code that switches to protected mode and jumps to the ROM,
+// copied below 1MB, where a startup IPI can point
+extern "C" char const smp_trampoline[];
+extern "C" char const smp_trampoline_end[];
+
+static constexpr uintptr_t SMP_TRAMPOLINE_ADDR = 0x8000;
+
+// Page tables for the secondaries, the ones the boot CPU uses
+extern "C" uint32_t smp_ap_cr3;
+uint32_t smp_ap_cr3;
+
+static constexpr uintptr_t LAPIC_BASE = 0xFEE00000;
+static constexpr uint32_t LAPIC_SVR = 0xF0;
+static constexpr uint32_t LAPIC_ICR_LO = 0x300;
+static constexpr uint32_t LAPIC_ICR_HI = 0x310;
+
+static constexpr uint32_t LAPIC_SVR_ENABLE = 1U << 8;
+static constexpr uint32_t LAPIC_ICR_INIT = 5U << 8;
+static constexpr uint32_t LAPIC_ICR_STARTUP = 6U << 8;
+static constexpr uint32_t LAPIC_ICR_PENDING = 1U << 12;
+static constexpr uint32_t LAPIC_ICR_ASSERT = 1U << 14;
+static constexpr uint32_t LAPIC_ICR_LEVEL = 1U << 15;
+static constexpr uint32_t LAPIC_ICR_ALL_BUT_SELF = 3U << 18;
+
+static _always_inline uint32_t lapic_read(uint32_t reg)
+{
+    return *(uint32_t volatile *)(LAPIC_BASE + reg);
+}
+
+static _always_inline void lapic_write(uint32_t reg, uint32_t value)
+{
+    *(uint32_t volatile *)(LAPIC_BASE + reg) = value;
+}
+
+static void lapic_send_ipi(uint32_t icr)
+{
+    lapic_write(LAPIC_ICR_HI, 0);
+    lapic_write(LAPIC_ICR_LO, icr);
+
+    while (lapic_read(LAPIC_ICR_LO) & LAPIC_ICR_PENDING)
+        __builtin_ia32_pause();
+}
+
+static void smp_delay_us(uint64_t us)
+{
+    uint64_t freq = arch_timer_freq();
+    uint64_t st = arch_timer_ticks();
+
+    while (arch_timer_ticks() - st < freq * us / 1000000)
+        fiber_yield();
+}
+
+unsigned arch_smp_start(void (*entry)(smp_cpu_t *cpu))
+{
+    if (!smp_prepare(entry))
+        return 1;
+
+    uintptr_t cr3;
+    __asm__ __volatile__ ("mov %%cr3,%[cr3]\n\t" : [cr3] "=r" (cr3));
+    smp_ap_cr3 = uint32_t(cr3);
+
+    memcpy((void*)SMP_TRAMPOLINE_ADDR, smp_trampoline,
+            smp_trampoline_end - smp_trampoline);
+
+    lapic_write(LAPIC_SVR, lapic_read(LAPIC_SVR) | LAPIC_SVR_ENABLE | 0xFF);
+
+    // INIT, then the startup IPI twice, as the MP specification says.
+    // A CPU that already started ignores the second one
+    lapic_send_ipi(LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_INIT |
+            LAPIC_ICR_ASSERT | LAPIC_ICR_LEVEL);
+    smp_delay_us(10000);
+
+    for (int i = 0; i < 2; ++i) {
+        lapic_send_ipi(LAPIC_ICR_ALL_BUT_SELF | LAPIC_ICR_STARTUP |
+                LAPIC_ICR_ASSERT | (SMP_TRAMPOLINE_ADDR >> 12));
+        smp_delay_us(200);
+    }
+
+    return smp_collect();
+}
+
+unsigned arch_smp_cpu_index()
+{
+    // The entry code points the gs base at the CPU's smp_cpu_t
+    uint32_t index;
+    __asm__ __volatile__ ("movl %%gs:8,%[index]\n\t" : [index] "=r" (index));
+    return index;
+}
+
+void arch_smp_relax()
+{
+    __builtin_ia32_pause();
+}
+
+void arch_smp_wait()
+{
+    __builtin_ia32_pause();
+}
+
+void arch_smp_wake()
+{
+}
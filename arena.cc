@@ -0,0 +1,122 @@
+#include "arena.h"
+#include "malloc.h"
+#include "string.h"
+#include "assert.h"
+#include "likely.h"
+
+struct arena_block_t {
+    arena_block_t *next;
+    size_t size;
+};
+
+// Block headers keep the space after them 64 byte aligned
+static constexpr size_t ARENA_HEADER_SIZE = 64;
+
+static_assert(sizeof(arena_block_t) <= ARENA_HEADER_SIZE,
+    "Header must fit");
+
+void arena_init(arena_t *arena, size_t block_size)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->block_size = block_size;
+}
+
+static char *arena_block_data(arena_block_t *block)
+{
+    return (char*)block + ARENA_HEADER_SIZE;
+}
+
+static void arena_enter(arena_t *arena, arena_block_t *block)
+{
+    arena->current = block;
+    arena->next = arena_block_data(block);
+    arena->end = arena->next + block->size;
+}
+
+// Unlink the first spare block after the current one
+// with room for bytes, left over from before a reset
+static arena_block_t *arena_take_spare(arena_t *arena, size_t bytes)
+{
+    if (!arena->current)
+        return nullptr;
+
+    for (arena_block_t **link = &arena->current->next; *link;
+            link = &(*link)->next) {
+        arena_block_t *block = *link;
+
+        if (block->size >= bytes) {
+            *link = block->next;
+            return block;
+        }
+    }
+
+    return nullptr;
+}
+
+static bool arena_grow(arena_t *arena, size_t bytes)
+{
+    arena_block_t *block = arena_take_spare(arena, bytes);
+
+    if (!block) {
+        size_t size = bytes > arena->block_size ? bytes : arena->block_size;
+
+        block = (arena_block_t*)malloc_aligned(ARENA_HEADER_SIZE + size, 64);
+
+        if (unlikely(!block))
+            return false;
+
+        block->size = size;
+    }
+
+    // Right after the current block, so the order blocks
+    // are used in is the order they are chained in
+    arena_block_t **link = arena->current ?
+            &arena->current->next : &arena->first;
+
+    block->next = *link;
+    *link = block;
+
+    arena_enter(arena, block);
+
+    return true;
+}
+
+void *arena_alloc(arena_t *arena, size_t bytes, size_t alignment)
+{
+    assert(alignment && alignment <= 64 &&
+            !(alignment & (alignment - 1)));
+
+    uintptr_t st = (uintptr_t(arena->next) + alignment - 1) &
+            -uintptr_t(alignment);
+
+    if (unlikely(!arena->current || st > uintptr_t(arena->end) ||
+            bytes > uintptr_t(arena->end) - st)) {
+        // New blocks start 64 byte aligned
+        if (unlikely(!arena_grow(arena, bytes)))
+            return nullptr;
+
+        st = uintptr_t(arena->next);
+    }
+
+    arena->next = (char*)st + bytes;
+
+    return (void*)st;
+}
+
+void arena_reset(arena_t *arena)
+{
+    if (arena->first)
+        arena_enter(arena, arena->first);
+}
+
+void arena_free(arena_t *arena)
+{
+    arena_block_t *next;
+
+    for (arena_block_t *block = arena->first; block; block = next) {
+        next = block->next;
+        free(block);
+    }
+
+    arena_init(arena, arena->block_size);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Bump allocator over a chain of large blocks. Allocations are never
+// freed one at a time, arena_reset makes all of the memory available
+// again, keeping the blocks for the next round
+
+struct arena_block_t;
+
+struct arena_t {
+    arena_block_t *first;
+    arena_block_t *current;
+
+    // Free space in the current block
+    char *next;
+    char *end;
+
+    // Usable bytes in each new block, larger allocations get a block
+    // of their own size
+    size_t block_size;
+};
+
+static constexpr size_t ARENA_BLOCK_SIZE = 64 << 10;
+
+void arena_init(arena_t *arena, size_t block_size = ARENA_BLOCK_SIZE);
+
+// Returns nullptr if out of memory. alignment must be a power of two,
+// no larger than 64
+void *arena_alloc(arena_t *arena, size_t bytes, size_t alignment = 16);
+
+// Forget every allocation, keeping the blocks
+void arena_reset(arena_t *arena);
+
+// Give the blocks back to malloc
+void arena_free(arena_t *arena);
@@ -11,5 +11,6 @@ void __assert_failed(const char *expr, const char *file, int line)
     if (!nesting)
         printdbg("%s(%d): Assertion failed: %s\n", file, line, expr);
     
+    debug_flush_sync();
     arch_halt();
 }
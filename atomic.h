@@ -0,0 +1,218 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "compiler.h"
+#include "arch/smp.h"
+
+// Spinlocks and bounded rings on the GCC __atomic builtins. Everything
+// is 32 bits or pointer sized, so it is lock free on every target,
+// including the 32 bit ones without 64 bit atomics. Indices wrap, and
+// are only ever compared by difference. Zero initialized is a valid
+// initial state, except for mpmc_ring_t, which needs init
+
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Fair, CPUs get the lock in the order they asked for it
+struct _aligned(CACHE_LINE_SIZE) ticket_lock_t {
+    uint32_t next;
+    uint32_t serving;
+
+    void lock()
+    {
+        uint32_t ticket = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED);
+
+        while (__atomic_load_n(&serving, __ATOMIC_ACQUIRE) != ticket)
+            arch_smp_relax();
+    }
+
+    bool try_lock()
+    {
+        uint32_t ticket = __atomic_load_n(&serving, __ATOMIC_RELAXED);
+        uint32_t expect = ticket;
+
+        return __atomic_compare_exchange_n(&next, &expect, ticket + 1,
+                false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+
+    void unlock()
+    {
+        // Only the owner writes serving
+        uint32_t ticket = __atomic_load_n(&serving, __ATOMIC_RELAXED);
+        __atomic_store_n(&serving, ticket + 1, __ATOMIC_RELEASE);
+    }
+};
+
+// Readers never block the writer, they retry if a write overlapped.
+// Copy the protected data into locals between read_begin and read_retry,
+// and only use the copy once read_retry returns false. Writers must be
+// serialized, by a lock or by having only one
+struct _aligned(CACHE_LINE_SIZE) seqlock_t {
+    // Odd while a write is in progress
+    uint32_t seq;
+
+    uint32_t read_begin() const
+    {
+        uint32_t s;
+
+        while ((s = __atomic_load_n(&seq, __ATOMIC_ACQUIRE)) & 1)
+            arch_smp_relax();
+
+        return s;
+    }
+
+    bool read_retry(uint32_t s) const
+    {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&seq, __ATOMIC_RELAXED) != s;
+    }
+
+    void write_begin()
+    {
+        uint32_t s = __atomic_load_n(&seq, __ATOMIC_RELAXED);
+        __atomic_store_n(&seq, s + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    void write_end()
+    {
+        uint32_t s = __atomic_load_n(&seq, __ATOMIC_RELAXED);
+        __atomic_store_n(&seq, s + 1, __ATOMIC_RELEASE);
+    }
+};
+
+// One producer and one consumer. Each side keeps a copy of the other
+// side's index, and only rereads it when the ring looks full or empty
+template<typename T, size_t N>
+struct spsc_ring_t {
+    static_assert((N & (N - 1)) == 0, "Size must be a power of two");
+
+    // Written by the consumer
+    uint32_t head _aligned(CACHE_LINE_SIZE);
+    uint32_t tail_cache;
+
+    // Written by the producer
+    uint32_t tail _aligned(CACHE_LINE_SIZE);
+    uint32_t head_cache;
+
+    T items[N] _aligned(CACHE_LINE_SIZE);
+
+    // Returns false when full
+    bool push(T const& item)
+    {
+        uint32_t t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+
+        if (t - head_cache == N) {
+            head_cache = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+
+            if (t - head_cache == N)
+                return false;
+        }
+
+        items[t & (N - 1)] = item;
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    // Returns false when empty
+    bool pop(T *item)
+    {
+        uint32_t h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+        if (h == tail_cache) {
+            tail_cache = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+
+            if (h == tail_cache)
+                return false;
+        }
+
+        *item = items[h & (N - 1)];
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+};
+
+// Any number of producers and consumers, Vyukov's bounded queue. Each
+// cell's sequence says whose turn it is, so producers and consumers only
+// contend on their own index, and never wait for each other
+template<typename T, size_t N>
+struct mpmc_ring_t {
+    static_assert((N & (N - 1)) == 0, "Size must be a power of two");
+
+    struct cell_t {
+        uint32_t seq;
+        T item;
+    };
+
+    uint32_t enqueue_pos _aligned(CACHE_LINE_SIZE);
+    uint32_t dequeue_pos _aligned(CACHE_LINE_SIZE);
+
+    cell_t cells[N] _aligned(CACHE_LINE_SIZE);
+
+    // Not safe while other CPUs use the ring
+    void init()
+    {
+        for (size_t i = 0; i < N; ++i)
+            __atomic_store_n(&cells[i].seq, uint32_t(i), __ATOMIC_RELAXED);
+
+        __atomic_store_n(&enqueue_pos, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&dequeue_pos, 0, __ATOMIC_RELEASE);
+    }
+
+    // Returns false when full
+    bool push(T const& item)
+    {
+        uint32_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+        cell_t *cell;
+
+        for (;;) {
+            cell = cells + (pos & (N - 1));
+            uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+            int32_t diff = int32_t(seq - pos);
+
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1,
+                        true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+            }
+        }
+
+        cell->item = item;
+        __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+    // Returns false when empty
+    bool pop(T *item)
+    {
+        uint32_t pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+        cell_t *cell;
+
+        for (;;) {
+            cell = cells + (pos & (N - 1));
+            uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+            int32_t diff = int32_t(seq - (pos + 1));
+
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&dequeue_pos, &pos, pos + 1,
+                        true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+            }
+        }
+
+        *item = cell->item;
+        __atomic_store_n(&cell->seq, pos + N, __ATOMIC_RELEASE);
+
+        return true;
+    }
+};
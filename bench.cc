@@ -0,0 +1,2039 @@
+#include "bench.h"
+#include "arch/timer.h"
+#include "debug.h"
+#include "polygon.h"
+#include "tile.h"
+#include "depth.h"
+#include "texture.h"
+#include "render.h"
+#include "line.h"
+#include "cmdbuf.h"
+#include "xform.h"
+#include "present.h"
+#include "dirty.h"
+#include "parallel.h"
+#include "atomic.h"
+#include "fiber.h"
+#include "arch/context.h"
+#include "dispi.h"
+#include "malloc.h"
+#include "string.h"
+#include "likely.h"
+#include "dispatch.h"
+
+void bench_report(char const *name, uint64_t ticks,
+    uint64_t items, char const *unit)
+{
+    uint64_t freq = arch_timer_freq();
+
+    if (freq && ticks) {
+        printdbg("bench %s: %llu ticks, %llu %s, %llu %s/s\n",
+                name, (unsigned long long)ticks,
+                (unsigned long long)items, unit,
+                (unsigned long long)(items * freq / ticks), unit);
+    } else {
+        printdbg("bench %s: %llu ticks, %llu %s\n",
+                name, (unsigned long long)ticks,
+                (unsigned long long)items, unit);
+    }
+}
+
+// Deterministic, so every engine sees exactly the same triangles
+static uint32_t bench_rand(uint32_t *state)
+{
+    *state = *state * 1103515245U + 12345U;
+    return *state >> 8;
+}
+
+static void bench_make_tris(vec4 *verts, size_t tri_count, int size)
+{
+    uint32_t seed = 0x5eed;
+    uint32_t w = render_surface.width;
+    uint32_t h = render_surface.height;
+
+    for (size_t i = 0; i < tri_count; ++i) {
+        vec4 *v = verts + i * 3;
+
+        float cx = float(bench_rand(&seed) % w);
+        float cy = float(bench_rand(&seed) % h);
+
+        for (size_t k = 0; k < 3; ++k) {
+            v[k] = vec4(
+                cx + float(int(bench_rand(&seed) % (size * 2)) - size),
+                cy + float(int(bench_rand(&seed) % (size * 2)) - size),
+                0.5f, 1.0f);
+        }
+
+        // Make it counterclockwise, going down on the left edges
+        float area = (v[1].y - v[0].y) * (v[2].x - v[0].x) +
+                (v[0].x - v[1].x) * (v[2].y - v[0].y);
+
+        if (area <= 0.0f) {
+            vec4 tmp = v[1];
+            v[1] = v[2];
+            v[2] = tmp;
+        }
+    }
+}
+
+static void bench_raster()
+{
+    static constexpr size_t tri_count = 4096;
+
+    struct bench_size_t {
+        char const *name;
+        int size;
+    };
+
+    static constexpr bench_size_t sizes[] = {
+        { "small", 8 },
+        { "medium", 64 },
+        { "large", 512 }
+    };
+
+    vec4 *verts = (vec4*)malloc(tri_count * 3 * sizeof(*verts));
+
+    if (unlikely(!verts))
+        return;
+
+    static char const * const names[2][2] = {
+        { "scanline immediate", "scanline binned" },
+        { "halfspace immediate", "halfspace binned" }
+    };
+
+    raster_engine_t old_engine = get_raster_engine();
+    bool old_binning = tile_binning();
+
+    for (bench_size_t const& size : sizes) {
+        bench_make_tris(verts, tri_count, size.size);
+
+        printdbg("raster, %s triangles\n", size.name);
+
+        for (int engine = RASTER_SCANLINE; engine <= RASTER_HALFSPACE;
+                ++engine) {
+            set_raster_engine(raster_engine_t(engine));
+
+            for (int binned = 0; binned < 2; ++binned) {
+                tile_set_binning(binned);
+
+                uint64_t st = arch_timer_ticks();
+
+                for (size_t i = 0; i < tri_count; ++i) {
+                    vec4 const *v = verts + i * 3;
+                    draw_tri_ccw(v, v + 1, v + 2, uint32_t(i * 0x10101));
+                }
+
+                if (binned)
+                    tile_flush();
+
+                uint64_t en = arch_timer_ticks();
+
+                bench_report(names[engine][binned],
+                        en - st, tri_count, "tris");
+            }
+        }
+    }
+
+    set_raster_engine(old_engine);
+    tile_set_binning(old_binning);
+
+    free(verts);
+}
+
+static void bench_depth_counters(char const *name)
+{
+    printdbg("bench %s: %llu written, %llu rejected,"
+            " %llu blocks rejected, %llu tris rejected\n", name,
+            (unsigned long long)depth_counters.pixels_written,
+            (unsigned long long)depth_counters.pixels_rejected,
+            (unsigned long long)depth_counters.blocks_rejected,
+            (unsigned long long)depth_counters.tris_rejected);
+}
+
+// Large overlapping triangles, drawn front to back, so most of the
+// later ones are hidden, then back to front, where nothing is hidden
+static void bench_depth()
+{
+    static constexpr size_t tri_count = 1024;
+
+    vec4 *verts = (vec4*)malloc(tri_count * 3 * sizeof(*verts));
+
+    if (unlikely(!verts))
+        return;
+
+    bench_make_tris(verts, tri_count, 256);
+
+    raster_engine_t old_engine = get_raster_engine();
+    bool old_depth = depth_enabled();
+
+    static char const * const names[2][3] = {
+        { "scanline no depth", "scanline front to back",
+            "scanline back to front" },
+        { "halfspace no depth", "halfspace front to back",
+            "halfspace back to front" }
+    };
+
+    for (int engine = RASTER_SCANLINE; engine <= RASTER_HALFSPACE;
+            ++engine) {
+        set_raster_engine(raster_engine_t(engine));
+
+        for (int order = 0; order < 3; ++order) {
+            for (size_t i = 0; i < tri_count; ++i) {
+                float z = (float(i) + 0.5f) / float(tri_count);
+                z = order == 2 ? 1.0f - z : z;
+
+                for (size_t k = 0; k < 3; ++k)
+                    verts[i * 3 + k].z = z;
+            }
+
+            depth_set_enabled(order != 0);
+            depth_clear();
+            depth_reset_counters();
+
+            uint64_t st = arch_timer_ticks();
+
+            for (size_t i = 0; i < tri_count; ++i) {
+                vec4 const *v = verts + i * 3;
+                draw_tri_ccw(v, v + 1, v + 2, uint32_t(i * 0x10101));
+            }
+
+            tile_flush();
+
+            uint64_t en = arch_timer_ticks();
+
+            bench_report(names[engine][order], en - st, tri_count, "tris");
+            bench_depth_counters(names[engine][order]);
+        }
+    }
+
+    set_raster_engine(old_engine);
+    depth_set_enabled(old_depth);
+    depth_clear();
+
+    free(verts);
+}
+
+// Fill rate of large triangles, flat, then textured with a divide
+// every pixel and with the longer subspans
+static void bench_texture()
+{
+    static constexpr size_t tri_count = 1024;
+
+    texture_t *texture = texture_create(8, 8);
+    vec4 *verts = (vec4*)malloc(tri_count * 3 * sizeof(*verts));
+    texcoord *tex = (texcoord*)malloc(tri_count * 3 * sizeof(*tex));
+
+    if (unlikely(!texture || !verts || !tex)) {
+        texture_free(texture);
+        free(verts);
+        free(tex);
+        return;
+    }
+
+    // Checkerboard of 8x8 texel squares
+    for (uint32_t y = 0; y < texture->height; ++y) {
+        for (uint32_t x = 0; x < texture->width; ++x) {
+            texture_store(texture, x, y,
+                    ((x ^ y) & 8) ? 0xFFFFFF : (x << 16) | (y << 8));
+        }
+    }
+
+    bench_make_tris(verts, tri_count, 256);
+
+    // Vary 1/w across each triangle, so the perspective divide matters
+    for (size_t i = 0; i < tri_count * 3; ++i) {
+        verts[i].w = 1.0f / float(1 + i % 3);
+        tex[i] = texcoord(float(i % 3 == 1), float(i % 3 == 2));
+    }
+
+    bool old_depth = depth_enabled();
+    unsigned old_subspan = texture_subspan_shift();
+
+    depth_set_enabled(false);
+
+    struct bench_mode_t {
+        char const *name;
+        bool textured;
+        unsigned subspan_shift;
+    };
+
+    static constexpr bench_mode_t modes[] = {
+        { "flat fill", false, 0 },
+        { "textured, divide per pixel", true, 0 },
+        { "textured, divide per 8 pixels", true, 3 },
+        { "textured, divide per 16 pixels", true, 4 }
+    };
+
+    for (bench_mode_t const& mode : modes) {
+        texture_set_subspan_shift(mode.subspan_shift);
+        depth_reset_counters();
+
+        uint64_t st = arch_timer_ticks();
+
+        for (size_t i = 0; i < tri_count; ++i) {
+            vec4 const *v = verts + i * 3;
+            texcoord const *t = tex + i * 3;
+
+            if (mode.textured) {
+                draw_tri_ccw_tex(v, v + 1, v + 2,
+                        t, t + 1, t + 2, texture);
+            } else {
+                draw_tri_ccw(v, v + 1, v + 2, uint32_t(i * 0x10101));
+            }
+        }
+
+        tile_flush();
+
+        uint64_t en = arch_timer_ticks();
+
+        bench_report(mode.name, en - st,
+                depth_counters.pixels_written, "pixels");
+    }
+
+    texture_set_subspan_shift(old_subspan);
+    depth_set_enabled(old_depth);
+
+    texture_free(texture);
+    free(verts);
+    free(tex);
+}
+
+// Fill rate of each span variant of the scanline engine, in pixels
+// covered, large triangles, so setup is a small part of the time
+static void bench_spans()
+{
+    static constexpr size_t tri_count = 1024;
+
+    texture_t *texture = texture_create(8, 8);
+    vec4 *verts = (vec4*)malloc(tri_count * 3 * sizeof(*verts));
+    texcoord *tex = (texcoord*)malloc(tri_count * 3 * sizeof(*tex));
+
+    if (unlikely(!texture || !verts || !tex)) {
+        texture_free(texture);
+        free(verts);
+        free(tex);
+        return;
+    }
+
+    for (uint32_t y = 0; y < texture->height; ++y) {
+        for (uint32_t x = 0; x < texture->width; ++x)
+            texture_store(texture, x, y, (x << 16) | (y << 8));
+    }
+
+    bench_make_tris(verts, tri_count, 256);
+
+    // Random depths, so the depth tested variants reject some pixels
+    uint32_t seed = 0xde97;
+
+    for (size_t i = 0; i < tri_count * 3; ++i) {
+        verts[i].z = float(bench_rand(&seed) & 0xFFFF) / 65536.0f;
+        tex[i] = texcoord(float(i % 3 == 1), float(i % 3 == 2));
+    }
+
+    raster_engine_t old_engine = get_raster_engine();
+    bool old_depth = depth_enabled();
+
+    set_raster_engine(RASTER_SCANLINE);
+
+    enum bench_span_kind_t {
+        BENCH_SPAN_FLAT,
+        BENCH_SPAN_SHADED,
+        BENCH_SPAN_TEXTURED
+    };
+
+    struct bench_span_t {
+        char const *name;
+        bench_span_kind_t kind;
+        bool depth;
+    };
+
+    static constexpr bench_span_t variants[] = {
+        { "span flat", BENCH_SPAN_FLAT, false },
+        { "span flat depth", BENCH_SPAN_FLAT, true },
+        { "span gouraud", BENCH_SPAN_SHADED, false },
+        { "span gouraud depth", BENCH_SPAN_SHADED, true },
+        { "span textured", BENCH_SPAN_TEXTURED, false },
+        { "span textured depth", BENCH_SPAN_TEXTURED, true }
+    };
+
+    for (bench_span_t const& variant : variants) {
+        depth_set_enabled(variant.depth);
+        depth_clear();
+        depth_reset_counters();
+
+        uint64_t st = arch_timer_ticks();
+
+        for (size_t i = 0; i < tri_count; ++i) {
+            vec4 const *v = verts + i * 3;
+            texcoord const *t = tex + i * 3;
+            uint32_t color = uint32_t(i * 0x10101);
+
+            switch (variant.kind) {
+            case BENCH_SPAN_FLAT:
+                draw_tri_ccw(v, v + 1, v + 2, color);
+                break;
+
+            case BENCH_SPAN_SHADED:
+                draw_tri_ccw_shaded(v, v + 1, v + 2,
+                        color, color ^ 0xFF0000, color ^ 0xFF);
+                break;
+
+            case BENCH_SPAN_TEXTURED:
+                draw_tri_ccw_tex(v, v + 1, v + 2,
+                        t, t + 1, t + 2, texture);
+                break;
+            }
+        }
+
+        tile_flush();
+
+        uint64_t en = arch_timer_ticks();
+
+        bench_report(variant.name, en - st,
+                depth_counters.pixels_written +
+                depth_counters.pixels_rejected, "pixels");
+    }
+
+    set_raster_engine(old_engine);
+    depth_set_enabled(old_depth);
+    depth_clear();
+
+    texture_free(texture);
+    free(verts);
+    free(tex);
+}
+
+// A grid of quads, split into two triangles each, with the inner
+// vertices moved by random sub-pixel amounts. In overdraw mode, every
+// pixel of the grid must end up drawn exactly once
+static void bench_overdraw()
+{
+    static constexpr int cells = 32;
+    static constexpr int cell_size = 16;
+    static constexpr int grid_size = cells * cell_size;
+
+    if (render_surface.width < grid_size || render_surface.height < grid_size)
+        return;
+
+    vec4 *grid = (vec4*)malloc((cells + 1) * (cells + 1) * sizeof(*grid));
+
+    if (unlikely(!grid))
+        return;
+
+    uint32_t seed = 0x0d4a;
+
+    for (int y = 0; y <= cells; ++y) {
+        for (int x = 0; x <= cells; ++x) {
+            // Up to a quarter cell, so every quad stays convex
+            bool inner = x > 0 && x < cells && y > 0 && y < cells;
+            float jx = inner ? float(int(bench_rand(&seed) % 129) - 64) *
+                    (cell_size / 256.0f) : 0.0f;
+            float jy = inner ? float(int(bench_rand(&seed) % 129) - 64) *
+                    (cell_size / 256.0f) : 0.0f;
+
+            grid[y * (cells + 1) + x] = vec4(
+                    float(x * cell_size) + jx,
+                    float(y * cell_size) + jy, 0.5f, 1.0f);
+        }
+    }
+
+    bool old_depth = depth_enabled();
+    depth_set_enabled(false);
+
+    clear_render_surface(0);
+    set_overdraw_mode(true);
+    depth_reset_counters();
+
+    uint64_t st = arch_timer_ticks();
+
+    for (int y = 0; y < cells; ++y) {
+        for (int x = 0; x < cells; ++x) {
+            vec4 const *tl = grid + y * (cells + 1) + x;
+            vec4 const *bl = tl + cells + 1;
+
+            draw_tri_ccw(tl, bl, bl + 1, 1);
+            draw_tri_ccw(tl, bl + 1, tl + 1, 1);
+        }
+    }
+
+    tile_flush();
+
+    uint64_t en = arch_timer_ticks();
+
+    set_overdraw_mode(false);
+
+    uint64_t gaps = 0;
+
+    for (int y = 0; y < grid_size; ++y) {
+        uint32_t const *row = (uint32_t const*)(
+                (char const*)render_surface.pixels +
+                render_surface.pitch * y);
+
+        for (int x = 0; x < grid_size; ++x)
+            gaps += row[x] == 0;
+    }
+
+    bench_report("overdraw mesh", en - st, cells * cells * 2, "tris");
+    printdbg("bench overdraw mesh: %llu pixels, %llu overdrawn, %llu gaps\n",
+            (unsigned long long)depth_counters.pixels_written,
+            (unsigned long long)depth_counters.pixels_overdrawn,
+            (unsigned long long)gaps);
+
+    clear_render_surface(0);
+    depth_set_enabled(old_depth);
+
+    free(grid);
+}
+
+// Small clip space triangles scattered over twice the view volume, so
+// some are rejected, many are accepted, and the rest poke slightly out
+static void bench_clip()
+{
+    static constexpr size_t tri_count = 4096;
+
+    vertex *verts = (vertex*)malloc(tri_count * 3 * sizeof(*verts));
+
+    if (unlikely(!verts))
+        return;
+
+    uint32_t seed = 0xc11b;
+
+    for (size_t i = 0; i < tri_count; ++i) {
+        vertex *v = verts + i * 3;
+
+        float cx = float(int(bench_rand(&seed) % 4096) - 2048) / 1024.0f;
+        float cy = float(int(bench_rand(&seed) % 4096) - 2048) / 1024.0f;
+
+        for (size_t k = 0; k < 3; ++k) {
+            float dx = float(int(bench_rand(&seed) % 256) - 128) / 1024.0f;
+            float dy = float(int(bench_rand(&seed) % 256) - 128) / 1024.0f;
+            v[k].pos = vec4(cx + dx, cy + dy, 0.0f, 1.0f);
+            v[k].tex = texcoord();
+        }
+
+        // Make it counterclockwise in window space
+        float area = (v[1].pos.y - v[0].pos.y) * (v[2].pos.x - v[0].pos.x) +
+                (v[0].pos.x - v[1].pos.x) * (v[2].pos.y - v[0].pos.y);
+
+        if (area <= 0.0f) {
+            vertex tmp = v[1];
+            v[1] = v[2];
+            v[2] = tmp;
+        }
+    }
+
+    float old_guard = clip_guard_band();
+    bool old_depth = depth_enabled();
+
+    depth_set_enabled(false);
+
+    static constexpr float guards[] = { 1.0f, 4.0f };
+    static char const * const names[] = {
+        "clip and draw, no guard band",
+        "clip and draw, guard band 4"
+    };
+
+    for (size_t g = 0; g < sizeof(guards) / sizeof(*guards); ++g) {
+        clip_set_guard_band(guards[g]);
+
+        uint64_t st = arch_timer_ticks();
+
+        for (size_t i = 0; i < tri_count; ++i)
+            render_polygon(verts + i * 3, 3, uint32_t(i * 0x10101));
+
+        tile_flush();
+
+        uint64_t en = arch_timer_ticks();
+
+        bench_report(names[g], en - st, tri_count, "tris");
+    }
+
+    clip_set_guard_band(old_guard);
+    depth_set_enabled(old_depth);
+
+    free(verts);
+}
+
+static constexpr uint32_t bench_cube_grid = 16;
+static constexpr uint32_t bench_cube_count =
+    bench_cube_grid * bench_cube_grid * bench_cube_grid;
+
+// Corner i has x, y and z positive where bits 0, 1 and 2 are set.
+// Each face is clockwise seen from outside, which makes it
+// counterclockwise in window space when it faces the eye
+static void bench_make_cube(vertex *verts, uint32_t *quads)
+{
+    for (uint32_t i = 0; i < 8; ++i) {
+        verts[i].pos = vec4((i & 1) ? 1.0f : -1.0f,
+                (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+        verts[i].tex = texcoord();
+    }
+
+    for (uint32_t face = 0, i = 0; face < 6; ++face) {
+        uint32_t axis = face >> 1;
+        uint32_t u = 1U << ((axis + 1) % 3);
+        uint32_t v = 1U << ((axis + 2) % 3);
+        uint32_t base = (face & 1) ? 0 : 1U << axis;
+
+        if (face & 1) {
+            uint32_t tmp = u;
+            u = v;
+            v = tmp;
+        }
+
+        quads[i++] = base;
+        quads[i++] = base | v;
+        quads[i++] = base | u | v;
+        quads[i++] = base | u;
+    }
+}
+
+// Object to clip transform of cube i, in a grid around the eye
+static mat4x4 bench_cube_transform(mat4x4 const& proj, uint32_t i)
+{
+    static constexpr uint32_t grid = bench_cube_grid;
+    static constexpr float spacing = 6.0f;
+
+    vec4 pos(
+        (float(i % grid) - grid * 0.5f + 0.5f) * spacing,
+        (float(i / grid % grid) - grid * 0.5f + 0.5f) * spacing,
+        (float(i / grid / grid) - grid * 0.5f + 0.5f) * spacing);
+
+    return proj * mat4x4::translate(pos);
+}
+
+// The sphere around a cube's corners
+static constexpr float bench_cube_radius = 1.7320508f;
+
+// Thousands of cubes around the eye, most of them behind it or outside
+// the field of view. Drawn once relying on the per-triangle outcode and
+// backface tests, then again skipping the cubes whose bounding sphere
+// is outside the frustum
+static void bench_cull()
+{
+    vertex verts[8];
+    uint32_t quads[24];
+
+    bench_make_cube(verts, quads);
+
+    mat4x4 proj = mat4x4::perspective(-1, 1, 1, -1, 1, 1024);
+
+    bool old_depth = depth_enabled();
+    depth_set_enabled(false);
+
+    static char const * const names[] = {
+        "cull cubes, triangles only",
+        "cull cubes, bounding spheres"
+    };
+
+    for (size_t pass = 0; pass < 2; ++pass) {
+        render_reset_cull_counters();
+
+        uint64_t st = arch_timer_ticks();
+
+        for (uint32_t i = 0; i < bench_cube_count; ++i) {
+            render_set_transform(bench_cube_transform(proj, i));
+
+            if (pass && !render_sphere_visible(vec4(), bench_cube_radius))
+                continue;
+
+            draw_indexed(verts, quads, 24, PRIM_QUADS, i * 0x10101);
+        }
+
+        tile_flush();
+
+        uint64_t en = arch_timer_ticks();
+
+        bench_report(names[pass], en - st, bench_cube_count, "cubes");
+        printdbg("bench %s: %llu of %llu cubes culled,"
+                " %llu tris outside, %llu backfacing\n", names[pass],
+                (unsigned long long)cull_counters.objects_culled,
+                (unsigned long long)cull_counters.objects_tested,
+                (unsigned long long)cull_counters.tris_outside,
+                (unsigned long long)cull_counters.tris_backfacing);
+    }
+
+    depth_set_enabled(old_depth);
+}
+
+// The cubes of bench_cull recorded once with their culls, then replayed,
+// against culling and drawing them with direct calls like a frame loop
+static void bench_cmdbuf()
+{
+    vertex verts[8];
+    uint32_t quads[24];
+
+    bench_make_cube(verts, quads);
+
+    mat4x4 proj = mat4x4::perspective(-1, 1, 1, -1, 1, 1024);
+
+    bool old_depth = depth_enabled();
+    depth_set_enabled(false);
+
+    cmdbuf_t cmds;
+    cmdbuf_init(&cmds);
+
+    uint64_t st = arch_timer_ticks();
+
+    for (uint32_t i = 0; i < bench_cube_count; ++i) {
+        cmdbuf_set_transform(&cmds, bench_cube_transform(proj, i));
+        cmdbuf_cull_sphere(&cmds, vec4(), bench_cube_radius);
+        cmdbuf_draw_indexed(&cmds, verts, quads, 24, PRIM_QUADS, i * 0x10101);
+    }
+
+    cmdbuf_present(&cmds);
+
+    uint64_t en = arch_timer_ticks();
+
+    bench_report("cmdbuf record", en - st, cmds.commands, "commands");
+    printdbg("bench cmdbuf record: %zu bytes%s\n", cmds.bytes,
+            cmds.overflow ? ", out of memory" : "");
+
+    st = arch_timer_ticks();
+
+    for (uint32_t i = 0; i < bench_cube_count; ++i) {
+        render_set_transform(bench_cube_transform(proj, i));
+
+        if (render_sphere_visible(vec4(), bench_cube_radius))
+            draw_indexed(verts, quads, 24, PRIM_QUADS, i * 0x10101);
+    }
+
+    tile_flush();
+
+    en = arch_timer_ticks();
+
+    bench_report("cmdbuf direct calls", en - st, bench_cube_count, "cubes");
+
+    st = arch_timer_ticks();
+
+    cmdbuf_execute(&cmds, nullptr, 0);
+
+    en = arch_timer_ticks();
+
+    bench_report("cmdbuf replay", en - st, bench_cube_count, "cubes");
+
+    cmdbuf_free(&cmds);
+
+    depth_set_enabled(old_depth);
+}
+
+// Random lines with ends up to a surface size outside the surface, then
+// horizontal and vertical ones, then the cube scene of bench_cull in
+// wireframe, where the cube edges shared by two faces are drawn once
+static void bench_lines()
+{
+    static constexpr size_t line_count = 4096;
+
+    int width = int(render_surface.width);
+    int height = int(render_surface.height);
+
+    static char const * const names[] = {
+        "lines, any slope",
+        "lines, horizontal",
+        "lines, vertical"
+    };
+
+    for (size_t kind = 0; kind < 3; ++kind) {
+        uint32_t seed = 0x11e5;
+
+        line_counters = {};
+
+        uint64_t st = arch_timer_ticks();
+
+        for (size_t i = 0; i < line_count; ++i) {
+            int x0 = int(bench_rand(&seed) % uint32_t(width * 3)) - width;
+            int y0 = int(bench_rand(&seed) % uint32_t(height * 3)) - height;
+            int x1 = int(bench_rand(&seed) % uint32_t(width * 3)) - width;
+            int y1 = int(bench_rand(&seed) % uint32_t(height * 3)) - height;
+
+            if (kind == 1) {
+                y0 = int(i % uint32_t(height));
+                y1 = y0;
+            } else if (kind == 2) {
+                x0 = int(i % uint32_t(width));
+                x1 = x0;
+            }
+
+            draw_line(x0, y0, x1, y1, uint32_t(i * 0x10101));
+        }
+
+        uint64_t en = arch_timer_ticks();
+
+        bench_report(names[kind], en - st, line_counters.pixels, "pixels");
+        printdbg("bench %s: %llu of %zu lines visible\n", names[kind],
+                (unsigned long long)line_counters.lines, line_count);
+    }
+
+    vertex verts[8];
+    uint32_t quads[24];
+
+    bench_make_cube(verts, quads);
+
+    mat4x4 proj = mat4x4::perspective(-1, 1, 1, -1, 1, 1024);
+
+    uint64_t edges = 0;
+
+    line_counters = {};
+    render_set_wireframe(true);
+
+    uint64_t st = arch_timer_ticks();
+
+    for (uint32_t i = 0; i < bench_cube_count; ++i) {
+        render_set_transform(bench_cube_transform(proj, i));
+
+        if (!render_sphere_visible(vec4(), bench_cube_radius))
+            continue;
+
+        draw_indexed(verts, quads, 24, PRIM_QUADS, i * 0x10101);
+        edges += draw_counters.edges;
+    }
+
+    uint64_t en = arch_timer_ticks();
+
+    render_set_wireframe(false);
+
+    bench_report("lines, wireframe cubes", en - st, edges, "edges");
+    printdbg("bench lines, wireframe cubes: %llu lines, %llu pixels\n",
+            (unsigned long long)line_counters.lines,
+            (unsigned long long)line_counters.pixels);
+}
+
+// Exact normalize against the estimate and Newton steps, then four
+// lanes at a time, with the worst length error of each in 1e-9
+static void bench_normalize()
+{
+    static constexpr size_t count = 4096;
+    static constexpr size_t runs = 256;
+
+    vec4 *in = (vec4*)malloc(count * sizeof(*in));
+    vec4 *out = (vec4*)malloc(count * sizeof(*out));
+
+    if (unlikely(!in || !out)) {
+        free(in);
+        free(out);
+        return;
+    }
+
+    uint32_t seed = 0x40c;
+
+    for (size_t i = 0; i < count; ++i) {
+        in[i] = vec4(
+            float(int(bench_rand(&seed) % 2048) - 1024) / 64.0f,
+            float(int(bench_rand(&seed) % 2048) - 1024) / 64.0f,
+            float(int(bench_rand(&seed) % 2048) + 1) / 64.0f);
+    }
+
+    static char const * const names[] = {
+        "normalize", "normalize_fast", "rsqrtf4"
+    };
+
+    for (size_t kind = 0; kind < 3; ++kind) {
+        uint64_t st = arch_timer_ticks();
+
+        for (size_t run = 0; run < runs; ++run) {
+            if (kind == 0) {
+                for (size_t i = 0; i < count; ++i)
+                    out[i] = vec4(in[i]).normalize();
+            } else if (kind == 1) {
+                for (size_t i = 0; i < count; ++i)
+                    out[i] = in[i].normalized_fast();
+            } else {
+                for (size_t i = 0; i < count; i += 4) {
+                    fastmath_v4sf r = rsqrtf4(fastmath_v4sf{
+                        in[i].sq_len(), in[i + 1].sq_len(),
+                        in[i + 2].sq_len(), in[i + 3].sq_len()
+                    });
+
+                    for (size_t k = 0; k < 4; ++k)
+                        out[i + k] = in[i + k] * r[k];
+                }
+            }
+        }
+
+        uint64_t en = arch_timer_ticks();
+
+        bench_report(names[kind], en - st, runs * count, "vectors");
+
+        double worst = 0;
+
+        for (size_t i = 0; i < count; ++i) {
+            double x = out[i].x;
+            double y = out[i].y;
+            double z = out[i].z;
+            double error = x * x + y * y + z * z - 1.0;
+
+            // Half the squared length error is the length error
+            error = error < 0 ? error * -0.5 : error * 0.5;
+
+            if (worst < error)
+                worst = error;
+        }
+
+        printdbg("bench %s: %llu e-9 worst length error\n", names[kind],
+                (unsigned long long)(worst * 1e9));
+    }
+
+    free(in);
+    free(out);
+}
+
+// sin and cos in double, the reference for the error sweep. pi / 2
+// in two parts, the first with 33 bits, and terms up to r^18
+static void bench_sincos_ref(double x, double *s, double *c)
+{
+    double n = double(int64_t(x * 0.63661977236758134 +
+            (x < 0 ? -0.5 : 0.5)));
+    double r = (x - n * 1.5707963267341256) - n * 6.0771005065061922e-11;
+    double z = r * r;
+    double sr = 0;
+    double cr = 0;
+
+    for (int k = 18; k > 0; k -= 2) {
+        sr = 1.0 - z * sr / double(k * (k + 1));
+        cr = 1.0 - z * cr / double((k - 1) * k);
+    }
+
+    sr *= r;
+
+    int q = int(int64_t(n) & 3);
+
+    *s = q == 0 ? sr : q == 1 ? cr : q == 2 ? -sr : -cr;
+    *c = q == 0 ? cr : q == 1 ? -sr : q == 2 ? -cr : sr;
+}
+
+// Error in hundredths of an ulp of the correctly rounded result
+static uint64_t bench_ulp_error(float result, double reference)
+{
+    double error = double(result) - reference;
+    float rounded = float(reference);
+    uint32_t bits;
+
+    memcpy(&bits, &rounded, sizeof(bits));
+
+    int exponent = int((bits >> 23) & 0xff) - 127 - 23;
+    double ulp = 1.0;
+
+    for ( ; exponent > 0; --exponent)
+        ulp *= 2.0;
+
+    for ( ; exponent < 0; ++exponent)
+        ulp *= 0.5;
+
+    if (error < 0)
+        error = -error;
+
+    return uint64_t(error / ulp * 100.0);
+}
+
+static void bench_sincos_report(char const *name, char const *range,
+        float const *angles, float const *sines, float const *cosines,
+        size_t count)
+{
+    uint64_t worst = 0;
+    double worst_abs = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        double s, c;
+        bench_sincos_ref(angles[i], &s, &c);
+
+        double results[] = { sines[i], cosines[i] };
+        double references[] = { s, c };
+
+        for (size_t k = 0; k < 2; ++k) {
+            double error = results[k] - references[k];
+
+            if (error < 0)
+                error = -error;
+
+            if (worst_abs < error)
+                worst_abs = error;
+
+            // Near the zeros only the absolute error means anything
+            if (references[k] > 0.001 || references[k] < -0.001) {
+                uint64_t ulps = bench_ulp_error(float(results[k]),
+                        references[k]);
+
+                if (worst < ulps)
+                    worst = ulps;
+            }
+        }
+    }
+
+    printdbg("bench %s error within %s: %llu.%02llu ulp,"
+            " %llu e-9 absolute\n", name, range,
+            (unsigned long long)(worst / 100),
+            (unsigned long long)(worst % 100),
+            (unsigned long long)(worst_abs * 1e9));
+}
+
+// The scalar sincosf, fsincos on x86, against both array kernels
+static void bench_sincos()
+{
+    static constexpr size_t count = 4096;
+    static constexpr size_t runs = 256;
+
+    float *angles = (float*)malloc(count * sizeof(*angles));
+    float *sines = (float*)malloc(count * sizeof(*sines));
+    float *cosines = (float*)malloc(count * sizeof(*cosines));
+
+    if (unlikely(!angles || !sines || !cosines)) {
+        free(angles);
+        free(sines);
+        free(cosines);
+        return;
+    }
+
+    static char const * const names[] = {
+        "sincosf", "sincosf_n fast", "sincosf_n precise"
+    };
+
+    static constexpr float ranges[] = { 6.2831853f, 1000.0f };
+    static char const * const range_names[] = { "2 pi", "1000" };
+
+    for (size_t range = 0; range < 2; ++range) {
+        float limit = ranges[range];
+
+        for (size_t i = 0; i < count; ++i) {
+            angles[i] = limit * (float(int(i * 2 + 1) - int(count)) /
+                    float(count));
+        }
+
+        for (size_t kind = 0; kind < 3; ++kind) {
+            uint64_t st = arch_timer_ticks();
+
+            for (size_t run = 0; run < runs; ++run) {
+                if (kind == 0) {
+                    for (size_t i = 0; i < count; ++i)
+                        sincosf(angles[i], sines + i, cosines + i);
+                } else {
+                    sincosf_n(angles, sines, cosines, count, kind == 1
+                            ? SINCOS_FAST : SINCOS_PRECISE);
+                }
+            }
+
+            uint64_t en = arch_timer_ticks();
+
+            if (range == 0)
+                bench_report(names[kind], en - st, runs * count, "angles");
+
+            bench_sincos_report(names[kind], range_names[range],
+                    angles, sines, cosines, count);
+        }
+    }
+
+    free(angles);
+    free(sines);
+    free(cosines);
+}
+
+// mat4x4 multiply, inverse, and transform of a vertex array, chained so
+// each result feeds the next, and the compiler can't skip any of them
+static void bench_mat()
+{
+    static constexpr size_t iters = 1 << 16;
+    static constexpr size_t vert_count = 1024;
+
+    mat4x4 a = mat4x4::perspective(-1, 1, 1, -1, 1, 1024) *
+            mat4x4::rotate_x(0.5f);
+    mat4x4 b = mat4x4::rotate_y(0.25f) * mat4x4::translate(vec4(1, 2, 3));
+
+    uint64_t st = arch_timer_ticks();
+
+    for (size_t i = 0; i < iters; ++i)
+        a = b * a;
+
+    uint64_t en = arch_timer_ticks();
+
+    bench_report("mat4x4 mul", en - st, iters, "muls");
+
+    mat4x4 c = mat4x4::rotate_z(0.75f) * b;
+
+    st = arch_timer_ticks();
+
+    for (size_t i = 0; i < iters; ++i)
+        c = c.inverse();
+
+    en = arch_timer_ticks();
+
+    bench_report("mat4x4 inverse", en - st, iters, "inverses");
+
+    vec4 *verts = (vec4*)malloc(vert_count * sizeof(*verts));
+
+    if (unlikely(!verts))
+        return;
+
+    for (size_t i = 0; i < vert_count; ++i)
+        verts[i] = vec4(float(i & 31), float(i >> 5), 1.0f);
+
+    // Rotated about the eye, so the values stay in range
+    mat4x4 r = mat4x4::rotate_y(0.001f);
+
+    st = arch_timer_ticks();
+
+    for (size_t run = 0; run < iters / vert_count * 16; ++run)
+        r.transform(verts, verts, vert_count);
+
+    en = arch_timer_ticks();
+
+    bench_report("mat4x4 transform", en - st,
+            iters * 16, "verts");
+
+    // Keep the results live
+    printdbg("bench mat4x4: %d %d %d\n", int(a.m[0][0] != 0.0f),
+            int(c.m[0][0] != 0.0f), int(verts[vert_count - 1].x != 0.0f));
+
+    free(verts);
+}
+
+// Vertex throughput of the batched structure of arrays stage, against
+// mat4x4::transform followed by render_viewport, at a range of batch
+// sizes. Every size processes about the same number of vertices
+static void bench_xform()
+{
+    static constexpr size_t max_batch = 65536;
+    static constexpr size_t total = 1 << 20;
+
+    xform_batch_t in, out;
+    vec4 *aos_in = (vec4*)malloc(max_batch * sizeof(*aos_in));
+    vec4 *aos_out = (vec4*)malloc(max_batch * sizeof(*aos_out));
+    bool in_ok = xform_batch_init(&in, max_batch);
+    bool out_ok = xform_batch_init(&out, max_batch);
+
+    if (unlikely(!aos_in || !aos_out || !in_ok || !out_ok)) {
+        free(aos_in);
+        free(aos_out);
+
+        if (in_ok)
+            xform_batch_free(&in);
+
+        if (out_ok)
+            xform_batch_free(&out);
+
+        return;
+    }
+
+    uint32_t seed = 0x7f0;
+
+    for (size_t i = 0; i < max_batch; ++i) {
+        aos_in[i] = vec4(
+            float(int(bench_rand(&seed) % 2048) - 1024) / 256.0f,
+            float(int(bench_rand(&seed) % 2048) - 1024) / 256.0f,
+            -float(bench_rand(&seed) % 2048) / 16.0f - 2.0f);
+
+        in.x[i] = aos_in[i].x;
+        in.y[i] = aos_in[i].y;
+        in.z[i] = aos_in[i].z;
+    }
+
+    mat4x4 m = mat4x4::perspective(-1, 1, 1, -1, 1, 1024);
+
+    for (size_t batch = 16; batch <= max_batch; batch <<= 2) {
+        size_t runs = total / batch;
+        int all_out;
+
+        printdbg("xform, batches of %llu vertices\n",
+                (unsigned long long)batch);
+
+        uint64_t st = arch_timer_ticks();
+
+        for (size_t run = 0; run < runs; ++run)
+            xform_project(&out, &in, m, batch, &all_out);
+
+        uint64_t en = arch_timer_ticks();
+
+        bench_report("xform soa", en - st, runs * batch, "verts");
+
+        st = arch_timer_ticks();
+
+        for (size_t run = 0; run < runs; ++run) {
+            m.transform(aos_out, aos_in, batch);
+
+            for (size_t i = 0; i < batch; ++i)
+                aos_out[i] = render_viewport(aos_out[i]);
+        }
+
+        en = arch_timer_ticks();
+
+        bench_report("xform aos", en - st, runs * batch, "verts");
+    }
+
+    xform_batch_free(&in);
+    xform_batch_free(&out);
+    free(aos_in);
+    free(aos_out);
+}
+
+// Grid mesh covering most of the view, drawn as an indexed triangle list,
+// and as one triangle strip per row, reporting the vertex cache hit rate
+static void bench_indexed()
+{
+    static constexpr uint32_t cells = 64;
+    static constexpr uint32_t stride = cells + 1;
+    static constexpr size_t list_count = cells * cells * 6;
+    static constexpr size_t strip_count = stride * 2;
+
+    vertex *verts = (vertex*)malloc(stride * stride * sizeof(*verts));
+    uint32_t *list = (uint32_t*)malloc(list_count * sizeof(*list));
+    uint32_t *strips = (uint32_t*)malloc(
+        cells * strip_count * sizeof(*strips));
+
+    if (unlikely(!verts || !list || !strips)) {
+        free(verts);
+        free(list);
+        free(strips);
+        return;
+    }
+
+    for (uint32_t y = 0; y < stride; ++y) {
+        for (uint32_t x = 0; x < stride; ++x) {
+            vertex &v = verts[y * stride + x];
+            v.pos = vec4(float(x) * (1.8f / cells) - 0.9f,
+                    float(y) * (1.8f / cells) - 0.9f, 0.0f);
+            v.tex = texcoord(float(x) / cells, float(y) / cells);
+        }
+    }
+
+    // a is the corner nearest the origin, d is above it, b is beside it
+    for (uint32_t y = 0, i = 0; y < cells; ++y) {
+        for (uint32_t x = 0; x < cells; ++x) {
+            uint32_t a = y * stride + x;
+            uint32_t b = a + 1;
+            uint32_t c = a + stride + 1;
+            uint32_t d = a + stride;
+
+            list[i++] = a;
+            list[i++] = d;
+            list[i++] = c;
+            list[i++] = a;
+            list[i++] = c;
+            list[i++] = b;
+        }
+    }
+
+    for (uint32_t y = 0; y < cells; ++y) {
+        uint32_t *strip = strips + y * strip_count;
+
+        for (uint32_t x = 0; x < stride; ++x) {
+            strip[x * 2] = y * stride + x;
+            strip[x * 2 + 1] = (y + 1) * stride + x;
+        }
+    }
+
+    bool old_depth = depth_enabled();
+    depth_set_enabled(false);
+
+    render_set_transform(mat4x4());
+
+    uint64_t st = arch_timer_ticks();
+
+    draw_indexed(verts, list, list_count, PRIM_TRIANGLES, 0x808080);
+    tile_flush();
+
+    uint64_t en = arch_timer_ticks();
+
+    bench_report("indexed triangle list", en - st,
+            draw_counters.primitives, "tris");
+    printdbg("bench indexed triangle list: %llu of %llu vertices cached\n",
+            (unsigned long long)draw_counters.vertex_hits,
+            (unsigned long long)draw_counters.vertex_lookups);
+
+    uint64_t hits = 0;
+    uint64_t lookups = 0;
+    uint64_t primitives = 0;
+
+    st = arch_timer_ticks();
+
+    for (uint32_t y = 0; y < cells; ++y) {
+        draw_indexed(verts, strips + y * strip_count, strip_count,
+                PRIM_TRIANGLE_STRIP, 0x808080);
+
+        hits += draw_counters.vertex_hits;
+        lookups += draw_counters.vertex_lookups;
+        primitives += draw_counters.primitives;
+    }
+
+    tile_flush();
+
+    en = arch_timer_ticks();
+
+    bench_report("indexed triangle strips", en - st, primitives, "tris");
+    printdbg("bench indexed triangle strips: %llu of %llu vertices cached\n",
+            (unsigned long long)hits, (unsigned long long)lookups);
+
+    depth_set_enabled(old_depth);
+
+    free(verts);
+    free(list);
+    free(strips);
+}
+
+// The same frame drawn straight into the framebuffer BAR, then drawn
+// into the RAM back buffer and presented, at two common sizes
+static void bench_present()
+{
+    static constexpr size_t tri_count = 4096;
+
+    struct bench_mode_t {
+        uint32_t width;
+        uint32_t height;
+    };
+
+    static constexpr bench_mode_t modes[] = {
+        { 1024, 768 },
+        { 1920, 1080 }
+    };
+
+    uintptr_t vram;
+    size_t vram_size;
+
+    if (!dispi_get_memory(0, &vram, &vram_size))
+        return;
+
+    vec4 *verts = (vec4*)malloc(tri_count * 3 * sizeof(*verts));
+
+    if (unlikely(!verts))
+        return;
+
+    render_surface_t old_surface = render_surface;
+    bool old_depth = depth_enabled();
+
+    for (bench_mode_t const& mode : modes) {
+        uint32_t pitch = mode.width * sizeof(uint32_t);
+
+        if (size_t(pitch) * mode.height > vram_size)
+            continue;
+
+        printdbg("present, %ux%u\n", mode.width, mode.height);
+
+        set_render_surface((uint32_t*)vram, pitch, mode.width, mode.height);
+        depth_set_enabled(false);
+        bench_make_tris(verts, tri_count, 64);
+
+        for (int back_buffer = 0; back_buffer < 2; ++back_buffer) {
+            if (back_buffer && !present_init(mode.width, mode.height))
+                break;
+
+            depth_set_enabled(false);
+
+            uint64_t st = arch_timer_ticks();
+
+            clear_render_surface(0);
+
+            for (size_t i = 0; i < tri_count; ++i) {
+                vec4 const *v = verts + i * 3;
+                draw_tri_ccw(v, v + 1, v + 2, uint32_t(i * 0x10101));
+            }
+
+            tile_flush();
+
+            if (back_buffer)
+                present((uint32_t*)vram, pitch);
+
+            uint64_t en = arch_timer_ticks();
+
+            bench_report(back_buffer ? "back buffer and present" :
+                    "direct to framebuffer", en - st, 1, "frames");
+        }
+    }
+
+    set_render_surface(old_surface.pixels, old_surface.pitch,
+            old_surface.width, old_surface.height);
+    depth_set_enabled(old_depth);
+
+    present_free();
+    free(verts);
+}
+
+// A small triangle moving across a 1024x768 back buffer, cleared and
+// presented each frame, with and without dirty tile tracking
+static void bench_dirty()
+{
+    static constexpr uint32_t width = 1024;
+    static constexpr uint32_t height = 768;
+    static constexpr size_t frame_count = 64;
+
+    uintptr_t vram;
+    size_t vram_size;
+
+    if (!dispi_get_memory(0, &vram, &vram_size) ||
+            size_t(width) * height * sizeof(uint32_t) > vram_size)
+        return;
+
+    render_surface_t old_surface = render_surface;
+    bool old_depth = depth_enabled();
+    bool old_dirty = dirty_enabled();
+
+    if (!present_init(width, height))
+        return;
+
+    depth_set_enabled(false);
+
+    for (int enable = 0; enable < 2; ++enable) {
+        dirty_set_enabled(enable);
+
+        // Settle the initial full clear and present
+        clear_render_surface(0);
+        present((uint32_t*)vram, width * sizeof(uint32_t));
+        dirty_reset_counters();
+
+        uint64_t st = arch_timer_ticks();
+
+        for (size_t i = 0; i < frame_count; ++i) {
+            float x = float(i * 8 + 64);
+            vec4 v[3] = {
+                vec4(x, 300.0f, 0.5f, 1.0f),
+                vec4(x - 50.0f, 400.0f, 0.5f, 1.0f),
+                vec4(x + 50.0f, 400.0f, 0.5f, 1.0f)
+            };
+
+            clear_render_surface(0);
+            draw_tri_ccw(v, v + 1, v + 2, 0xffffff);
+            tile_flush();
+            present((uint32_t*)vram, width * sizeof(uint32_t));
+        }
+
+        uint64_t en = arch_timer_ticks();
+
+        char const *name = enable ? "dirty tiles" : "whole surface";
+
+        bench_report(name, en - st, frame_count, "frames");
+        printdbg("bench %s: %llu cleared, %llu presented bytes per frame\n",
+                name,
+                (unsigned long long)(
+                dirty_counters.bytes_cleared / frame_count),
+                (unsigned long long)(
+                dirty_counters.bytes_presented / frame_count));
+    }
+
+    set_render_surface(old_surface.pixels, old_surface.pitch,
+            old_surface.width, old_surface.height);
+    depth_set_enabled(old_depth);
+    dirty_set_enabled(old_dirty);
+
+    present_free();
+}
+
+// Binned triangles drawn by the boot CPU alone, then by every CPU
+static void bench_parallel()
+{
+    static constexpr size_t tri_count = 4096;
+
+    vec4 *verts = (vec4*)malloc(tri_count * 3 * sizeof(*verts));
+
+    if (unlikely(!verts))
+        return;
+
+    bool old_binning = tile_binning();
+    bool old_parallel = tile_parallel();
+
+    tile_set_binning(true);
+    bench_make_tris(verts, tri_count, 64);
+
+    printdbg("parallel, %u CPUs\n", parallel_cpu_count());
+
+    for (int parallel = 0; parallel < 2; ++parallel) {
+        tile_set_parallel(parallel);
+
+        uint64_t st = arch_timer_ticks();
+
+        for (size_t i = 0; i < tri_count; ++i) {
+            vec4 const *v = verts + i * 3;
+            draw_tri_ccw(v, v + 1, v + 2, uint32_t(i * 0x10101));
+        }
+
+        tile_flush();
+
+        uint64_t en = arch_timer_ticks();
+
+        bench_report(parallel ? "tiles on every CPU" : "tiles on one CPU",
+                en - st, tri_count, "tris");
+    }
+
+    tile_set_binning(old_binning);
+    tile_set_parallel(old_parallel);
+
+    free(verts);
+}
+
+struct bench_xform_job_t {
+    xform_batch_t *out;
+    xform_batch_t const *in;
+    mat4x4 m;
+};
+
+// One piece of a parallel transform, the pieces are whole groups
+static void bench_xform_range(void *arg, size_t begin, size_t end)
+{
+    bench_xform_job_t const *job = (bench_xform_job_t const*)arg;
+
+    xform_batch_t out = *job->out;
+    xform_batch_t in = *job->in;
+
+    out.x += begin;
+    out.y += begin;
+    out.z += begin;
+    out.w += begin;
+    out.outcode += begin;
+    in.x += begin;
+    in.y += begin;
+    in.z += begin;
+
+    int all_out;
+    xform_project(&out, &in, job->m, end - begin, &all_out);
+}
+
+// Scaling of a CPU bound kernel, a large vertex batch transformed on
+// one CPU, then split across every CPU with parallel_for
+static void bench_parallel_xform()
+{
+    static constexpr size_t batch = 65536;
+    static constexpr size_t grain = 4096;
+    static constexpr size_t runs = 64;
+
+    xform_batch_t in, out;
+    bool in_ok = xform_batch_init(&in, batch);
+    bool out_ok = xform_batch_init(&out, batch);
+
+    if (unlikely(!in_ok || !out_ok)) {
+        if (in_ok)
+            xform_batch_free(&in);
+
+        if (out_ok)
+            xform_batch_free(&out);
+
+        return;
+    }
+
+    uint32_t seed = 0x7f0;
+
+    for (size_t i = 0; i < batch; ++i) {
+        in.x[i] = float(int(bench_rand(&seed) % 2048) - 1024) / 256.0f;
+        in.y[i] = float(int(bench_rand(&seed) % 2048) - 1024) / 256.0f;
+        in.z[i] = -float(bench_rand(&seed) % 2048) / 16.0f - 2.0f;
+    }
+
+    bench_xform_job_t job{ &out, &in,
+            mat4x4::perspective(-1, 1, 1, -1, 1, 1024) };
+
+    uint64_t st = arch_timer_ticks();
+
+    for (size_t run = 0; run < runs; ++run)
+        bench_xform_range(&job, 0, batch);
+
+    uint64_t en = arch_timer_ticks();
+
+    bench_report("xform on one CPU", en - st, runs * batch, "verts");
+
+    st = arch_timer_ticks();
+
+    for (size_t run = 0; run < runs; ++run)
+        parallel_for(0, batch, grain, bench_xform_range, &job);
+
+    en = arch_timer_ticks();
+
+    bench_report("xform on every CPU", en - st, runs * batch, "verts");
+
+    xform_batch_free(&in);
+    xform_batch_free(&out);
+}
+
+static constexpr size_t bench_atomic_iters = 1 << 16;
+
+static ticket_lock_t bench_lock;
+static uint32_t bench_lock_count;
+
+static seqlock_t bench_seqlock;
+static uint32_t bench_seq_a;
+static uint32_t bench_seq_b;
+static uint32_t bench_seq_torn;
+
+static mpmc_ring_t<uint32_t, 1024> bench_mpmc;
+static spsc_ring_t<uint32_t, 1024> bench_spsc;
+static uint32_t bench_spsc_errors;
+
+static void bench_lock_range(void *, size_t begin, size_t end)
+{
+    for (size_t piece = begin; piece < end; ++piece) {
+        for (size_t i = 0; i < bench_atomic_iters; ++i) {
+            bench_lock.lock();
+            ++bench_lock_count;
+            bench_lock.unlock();
+        }
+    }
+}
+
+// Piece 0 writes a pair that is always complementary,
+// the others count reads that see a mix of two writes
+static void bench_seqlock_range(void *, size_t begin, size_t end)
+{
+    for (size_t piece = begin; piece < end; ++piece) {
+        for (size_t i = 0; i < bench_atomic_iters; ++i) {
+            if (piece == 0) {
+                bench_seqlock.write_begin();
+                __atomic_store_n(&bench_seq_a, uint32_t(i), __ATOMIC_RELAXED);
+                __atomic_store_n(&bench_seq_b, ~uint32_t(i),
+                        __ATOMIC_RELAXED);
+                bench_seqlock.write_end();
+                continue;
+            }
+
+            uint32_t s, a, b;
+
+            do {
+                s = bench_seqlock.read_begin();
+                a = __atomic_load_n(&bench_seq_a, __ATOMIC_RELAXED);
+                b = __atomic_load_n(&bench_seq_b, __ATOMIC_RELAXED);
+            } while (bench_seqlock.read_retry(s));
+
+            if (a != ~b)
+                __atomic_add_fetch(&bench_seq_torn, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+// Each push is followed by a pop, so the ring never fills
+static void bench_mpmc_range(void *, size_t begin, size_t end)
+{
+    for (size_t piece = begin; piece < end; ++piece) {
+        for (size_t i = 0; i < bench_atomic_iters; ++i) {
+            uint32_t item;
+
+            while (!bench_mpmc.push(uint32_t(i)))
+                arch_smp_relax();
+
+            while (!bench_mpmc.pop(&item))
+                arch_smp_relax();
+        }
+    }
+}
+
+// Runs on CPU 1 while CPU 0 produces, checks the order
+static void bench_spsc_consume(parallel_task_t *)
+{
+    for (size_t i = 0; i < bench_atomic_iters; ++i) {
+        uint32_t item;
+
+        while (!bench_spsc.pop(&item))
+            arch_smp_relax();
+
+        bench_spsc_errors += item != uint32_t(i);
+    }
+}
+
+static void bench_spsc_produce()
+{
+    for (size_t i = 0; i < bench_atomic_iters; ++i) {
+        while (!bench_spsc.push(uint32_t(i)))
+            arch_smp_relax();
+    }
+}
+
+// Every CPU hammering the same lock or ring at once
+static void bench_atomic()
+{
+    size_t cpus = parallel_cpu_count();
+
+    printdbg("atomic, %llu CPUs\n", (unsigned long long)cpus);
+
+    bench_lock_count = 0;
+
+    uint64_t st = arch_timer_ticks();
+    parallel_for(0, cpus, 1, bench_lock_range, nullptr);
+    uint64_t en = arch_timer_ticks();
+
+    bench_report("ticket lock", en - st, cpus * bench_atomic_iters, "locks");
+
+    if (bench_lock_count != cpus * bench_atomic_iters)
+        printdbg("bench ticket lock: count is wrong\n");
+
+    bench_seq_torn = 0;
+
+    st = arch_timer_ticks();
+    parallel_for(0, cpus, 1, bench_seqlock_range, nullptr);
+    en = arch_timer_ticks();
+
+    bench_report("seqlock", en - st, cpus * bench_atomic_iters, "ops");
+    printdbg("bench seqlock: %u torn reads\n", bench_seq_torn);
+
+    bench_mpmc.init();
+
+    st = arch_timer_ticks();
+    parallel_for(0, cpus, 1, bench_mpmc_range, nullptr);
+    en = arch_timer_ticks();
+
+    bench_report("mpmc ring", en - st, cpus * bench_atomic_iters, "pairs");
+
+    // The consumer must run on another CPU, or the producer
+    // would wait forever once the ring is full
+    parallel_task_t consumer;
+    consumer.run = bench_spsc_consume;
+
+    bench_spsc_errors = 0;
+
+    if (cpus < 2 || parallel_cpu_index() != 0 ||
+            !parallel_post(1, &consumer))
+        return;
+
+    st = arch_timer_ticks();
+    bench_spsc_produce();
+    parallel_wait(&consumer);
+    en = arch_timer_ticks();
+
+    bench_report("spsc ring", en - st, bench_atomic_iters, "items");
+
+    if (bench_spsc_errors)
+        printdbg("bench spsc ring: %u out of order\n", bench_spsc_errors);
+}
+
+static constexpr size_t bench_switch_iters = 1 << 16;
+
+static context_t *bench_ctx_main;
+static context_t *bench_ctx_other;
+
+// Switch straight back, forever. Abandoned mid switch when done
+static void bench_ctx_pong(void *)
+{
+    for (;;)
+        arch_context_switch(&bench_ctx_other, bench_ctx_main);
+}
+
+static void bench_fiber_yield(void *)
+{
+    for (size_t i = 0; i < bench_switch_iters; ++i)
+        fiber_yield();
+}
+
+// Round trips between two contexts, then between fibers,
+// through the scheduler
+static void bench_fiber()
+{
+    if (!fiber_enabled()) {
+        printdbg("bench fiber: no context switch\n");
+        return;
+    }
+
+    char *stack = (char*)malloc_aligned(FIBER_STACK_SIZE, 64);
+
+    if (unlikely(!stack))
+        return;
+
+    bench_ctx_other = arch_context_init(stack + FIBER_STACK_SIZE,
+            bench_ctx_pong, nullptr);
+
+    uint64_t st = arch_timer_ticks();
+    for (size_t i = 0; i < bench_switch_iters; ++i)
+        arch_context_switch(&bench_ctx_main, bench_ctx_other);
+    uint64_t en = arch_timer_ticks();
+
+    bench_report("context switch", en - st,
+            bench_switch_iters * 2, "switches");
+
+    free(stack);
+
+    uint64_t switches = fiber_switch_count;
+
+    st = arch_timer_ticks();
+    fiber_join(fiber_spawn(bench_fiber_yield, nullptr));
+    en = arch_timer_ticks();
+
+    bench_report("fiber yield", en - st,
+            fiber_switch_count - switches, "switches");
+}
+
+// Frames of a grid turning in front of the eye by step each frame,
+// transformed, projected and drawn flat, with Vec and Mat as vec4 and
+// mat4x4, or as vec4x and mat4x4x. In a soft-float build, every float
+// operation is a libgcc call
+template<typename Vec, typename Mat, typename Scalar>
+static void bench_fixed_frame(Vec *mesh, Vec *verts, size_t tri_count,
+    size_t frame, Scalar step)
+{
+    render_rect_t clip{
+        0, 0,
+        int(render_surface.width), int(render_surface.height)
+    };
+
+    Mat proj = Mat::perspective(-1, 1, 1, -1, 1, 1024) *
+            Mat::translate(Vec(0, 0, -8));
+
+    Mat m = proj * Mat::rotate_y(Scalar(int(frame)) * step);
+
+    m.transform(verts, mesh, tri_count * 3);
+
+    for (size_t i = 0; i < tri_count * 3; ++i)
+        verts[i] = render_viewport(verts[i]);
+
+    for (size_t i = 0; i < tri_count; ++i) {
+        Vec const *v = verts + i * 3;
+        draw_tri_ccw_rect(v, v + 1, v + 2, uint32_t(i * 0x10101), clip);
+    }
+}
+
+template<typename Vec, typename Mat, typename Scalar>
+static void bench_fixed_frames(char const *name, Vec *mesh, Vec *verts,
+    size_t tri_count, size_t frames, Scalar step)
+{
+    uint64_t st = arch_timer_ticks();
+
+    for (size_t frame = 0; frame < frames; ++frame) {
+        bench_fixed_frame<Vec, Mat, Scalar>(mesh, verts, tri_count,
+                frame, step);
+    }
+
+    uint64_t en = arch_timer_ticks();
+
+    bench_report(name, en - st, frames * tri_count, "tris");
+}
+
+// Pixels where the last frame differs between the float and fixed
+// paths, out of those either one drew
+static void bench_fixed_compare(vec4 *mesh, vec4 *verts,
+    vec4x *mesh_x, vec4x *verts_x, size_t tri_count,
+    size_t frame, fix16_t step)
+{
+    uint32_t width = render_surface.width;
+    uint32_t height = render_surface.height;
+    uint32_t *copy = (uint32_t*)malloc(size_t(width) * height *
+            sizeof(*copy));
+
+    if (unlikely(!copy))
+        return;
+
+    clear_render_surface(0);
+    bench_fixed_frame<vec4, mat4x4, float>(mesh, verts, tri_count,
+            frame, step.to_float());
+
+    for (uint32_t y = 0; y < height; ++y) {
+        memcpy(copy + size_t(y) * width, (char*)render_surface.pixels +
+                size_t(render_surface.pitch) * y, width * sizeof(*copy));
+    }
+
+    clear_render_surface(0);
+    bench_fixed_frame<vec4x, mat4x4x, fix16_t>(mesh_x, verts_x, tri_count,
+            frame, step);
+
+    size_t drawn = 0;
+    size_t differ = 0;
+
+    for (uint32_t y = 0; y < height; ++y) {
+        uint32_t const *row = (uint32_t const *)(
+                (char*)render_surface.pixels +
+                size_t(render_surface.pitch) * y);
+        uint32_t const *float_row = copy + size_t(y) * width;
+
+        for (uint32_t x = 0; x < width; ++x) {
+            drawn += (row[x] | float_row[x]) != 0;
+            differ += row[x] != float_row[x];
+        }
+    }
+
+    printdbg("bench frame fixed: %zu of %zu pixels differ from float\n",
+            differ, drawn);
+
+    free(copy);
+}
+
+static void bench_fixed()
+{
+    static constexpr int grid = 32;
+    static constexpr size_t tri_count = grid * grid * 2;
+    static constexpr size_t frames = 64;
+
+    vec4 *mesh = (vec4*)malloc(tri_count * 3 * sizeof(*mesh));
+    vec4 *verts = (vec4*)malloc(tri_count * 3 * sizeof(*verts));
+    vec4x *mesh_x = (vec4x*)malloc(tri_count * 3 * sizeof(*mesh_x));
+    vec4x *verts_x = (vec4x*)malloc(tri_count * 3 * sizeof(*verts_x));
+
+    if (likely(mesh && verts && mesh_x && verts_x)) {
+        // Clockwise in object space, y goes down in window space.
+        // Built in fixed point, the float copy converts exactly
+        vec4x *out = mesh_x;
+        fix16_t cell = fix16_t::from_raw((4 << fix16_t::FRAC_BITS) / grid);
+
+        for (int y = 0; y < grid; ++y) {
+            for (int x = 0; x < grid; ++x) {
+                fix16_t x0 = fix16_t::from_raw(x * cell.raw) - 2;
+                fix16_t y0 = fix16_t::from_raw(y * cell.raw) - 2;
+                fix16_t x1 = x0 + cell;
+                fix16_t y1 = y0 + cell;
+
+                *out++ = vec4x(x0, y0, 0);
+                *out++ = vec4x(x0, y1, 0);
+                *out++ = vec4x(x1, y0, 0);
+                *out++ = vec4x(x0, y1, 0);
+                *out++ = vec4x(x1, y1, 0);
+                *out++ = vec4x(x1, y0, 0);
+            }
+        }
+
+        for (size_t i = 0; i < tri_count * 3; ++i)
+            mesh[i] = mesh_x[i].to_float();
+
+        // About 0.01 radians, the same angle in both
+        fix16_t step = fix16_t::from_raw(655);
+
+        raster_engine_t old_engine = get_raster_engine();
+        bool old_binning = tile_binning();
+        bool old_depth = depth_enabled();
+
+        // The fixed point path is always immediate, scanline and
+        // without depth, so the float one is too
+        set_raster_engine(RASTER_SCANLINE);
+        tile_set_binning(false);
+        depth_set_enabled(false);
+
+        bench_fixed_frames<vec4, mat4x4, float>("frame float",
+                mesh, verts, tri_count, frames, step.to_float());
+        bench_fixed_frames<vec4x, mat4x4x, fix16_t>("frame fixed",
+                mesh_x, verts_x, tri_count, frames, step);
+
+        bench_fixed_compare(mesh, verts, mesh_x, verts_x, tri_count,
+                frames - 1, step);
+
+        set_raster_engine(old_engine);
+        tile_set_binning(old_binning);
+        depth_set_enabled(old_depth);
+    }
+
+    free(mesh);
+    free(verts);
+    free(mesh_x);
+    free(verts_x);
+}
+
+// Each dispatched kernel with only the baseline variants, then with
+// the best ones for this CPU
+static void bench_dispatch()
+{
+    static constexpr size_t copy_size = 1 << 20;
+    static constexpr size_t copy_runs = 64;
+    static constexpr size_t vert_count = 4096;
+    static constexpr size_t vert_runs = 256;
+    static constexpr size_t tri_count = 4096;
+
+    char *copy_src = (char*)malloc(copy_size);
+    char *copy_dst = (char*)malloc(copy_size);
+    float *angles = (float*)malloc(vert_count * sizeof(*angles));
+    float *sines = (float*)malloc(vert_count * sizeof(*sines));
+    float *cosines = (float*)malloc(vert_count * sizeof(*cosines));
+    vec4 *verts = (vec4*)malloc(tri_count * 3 * sizeof(*verts));
+    xform_batch_t in, out;
+    bool in_ok = xform_batch_init(&in, vert_count);
+    bool out_ok = xform_batch_init(&out, vert_count);
+
+    if (likely(copy_src && copy_dst && angles && sines && cosines &&
+            verts && in_ok && out_ok)) {
+        memset(copy_src, 0x5a, copy_size);
+
+        uint32_t seed = 0xd15;
+
+        for (size_t i = 0; i < vert_count; ++i) {
+            in.x[i] = float(int(bench_rand(&seed) % 2048) - 1024) / 256.0f;
+            in.y[i] = float(int(bench_rand(&seed) % 2048) - 1024) / 256.0f;
+            in.z[i] = -float(bench_rand(&seed) % 2048) / 16.0f - 2.0f;
+            angles[i] = in.x[i] * 100.0f;
+        }
+
+        bench_make_tris(verts, tri_count, 64);
+
+        mat4x4 m = mat4x4::perspective(-1, 1, 1, -1, 1, 1024);
+
+        raster_engine_t old_engine = get_raster_engine();
+        bool old_binning = tile_binning();
+        set_raster_engine(RASTER_SCANLINE);
+        tile_set_binning(false);
+
+        static char const * const names[2][4] = {
+            { "memcpy base", "xform base", "sincosf_n base", "spans base" },
+            { "memcpy best", "xform best", "sincosf_n best", "spans best" }
+        };
+
+        for (size_t pass = 0; pass < 2; ++pass) {
+            dispatch_init(pass ? cpu_features : 0);
+
+            uint64_t st = arch_timer_ticks();
+
+            for (size_t run = 0; run < copy_runs; ++run)
+                memcpy(copy_dst, copy_src, copy_size);
+
+            uint64_t en = arch_timer_ticks();
+
+            bench_report(names[pass][0], en - st,
+                    copy_runs * copy_size, "bytes");
+
+            int all_out;
+            st = arch_timer_ticks();
+
+            for (size_t run = 0; run < vert_runs; ++run)
+                xform_project(&out, &in, m, vert_count, &all_out);
+
+            en = arch_timer_ticks();
+
+            bench_report(names[pass][1], en - st,
+                    vert_runs * vert_count, "verts");
+
+            st = arch_timer_ticks();
+
+            for (size_t run = 0; run < vert_runs; ++run)
+                sincosf_n(angles, sines, cosines, vert_count);
+
+            en = arch_timer_ticks();
+
+            bench_report(names[pass][2], en - st,
+                    vert_runs * vert_count, "angles");
+
+            st = arch_timer_ticks();
+
+            for (size_t i = 0; i < tri_count; ++i) {
+                vec4 const *v = verts + i * 3;
+                draw_tri_ccw(v, v + 1, v + 2, uint32_t(i * 0x10101));
+            }
+
+            en = arch_timer_ticks();
+
+            bench_report(names[pass][3], en - st, tri_count, "tris");
+        }
+
+        set_raster_engine(old_engine);
+        tile_set_binning(old_binning);
+    }
+
+    if (in_ok)
+        xform_batch_free(&in);
+
+    if (out_ok)
+        xform_batch_free(&out);
+
+    free(copy_src);
+    free(copy_dst);
+    free(angles);
+    free(sines);
+    free(cosines);
+    free(verts);
+}
+
+void bench_run_all()
+{
+    bench_raster();
+    bench_parallel();
+    bench_parallel_xform();
+    bench_atomic();
+    bench_fiber();
+    bench_depth();
+    bench_texture();
+    bench_spans();
+    bench_overdraw();
+    bench_clip();
+    bench_cull();
+    bench_cmdbuf();
+    bench_lines();
+    bench_mat();
+    bench_normalize();
+    bench_sincos();
+    bench_xform();
+    bench_indexed();
+    bench_present();
+    bench_dirty();
+    bench_dispatch();
+    bench_fixed();
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Build with CXXFLAGS=-DENABLE_BENCH=1 to run the benchmarks at startup
+#ifndef ENABLE_BENCH
+#define ENABLE_BENCH 0
+#endif
+
+// Print elapsed ticks for a run over items units of work,
+// and the rate per second when the timer frequency is known
+void bench_report(char const *name, uint64_t ticks,
+    uint64_t items, char const *unit);
+
+// Run every benchmark, drawing to the current render surface
+void bench_run_all();
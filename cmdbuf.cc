@@ -0,0 +1,264 @@
+#include "cmdbuf.h"
+#include "polygon.h"
+#include "depth.h"
+#include "tile.h"
+#include "present.h"
+#include "string.h"
+#include "likely.h"
+
+enum cmd_op_t : uint32_t {
+    CMD_SET_TRANSFORM,
+    CMD_DRAW_INDEXED,
+    CMD_CLEAR,
+    CMD_PRESENT,
+    CMD_CULL_SPHERE,
+
+    // Continue in another chunk
+    CMD_JUMP
+};
+
+struct cmd_header_t {
+    cmd_op_t op;
+
+    // Of the whole command, header included, a multiple of CMD_ALIGN
+    uint32_t size;
+};
+
+struct cmd_set_transform_t {
+    cmd_header_t header;
+    mat4x4 m;
+};
+
+struct cmd_draw_indexed_t {
+    cmd_header_t header;
+    vertex const *vertices;
+    uint32_t const *indices;
+    texture_t const *texture;
+    size_t count;
+    primitive_t primitive;
+    uint32_t color;
+};
+
+struct cmd_clear_t {
+    cmd_header_t header;
+    uint32_t color;
+};
+
+struct cmd_present_t {
+    cmd_header_t header;
+};
+
+struct cmd_cull_sphere_t {
+    cmd_header_t header;
+    vec4 center;
+    float radius;
+};
+
+struct cmd_jump_t {
+    cmd_header_t header;
+    cmd_header_t *target;
+};
+
+static constexpr size_t CMD_ALIGN = 8;
+
+static constexpr size_t cmd_size(size_t bytes)
+{
+    return (bytes + CMD_ALIGN - 1) & -CMD_ALIGN;
+}
+
+void cmdbuf_init(cmdbuf_t *buf)
+{
+    memset(buf, 0, sizeof(*buf));
+    arena_init(&buf->arena);
+}
+
+void cmdbuf_free(cmdbuf_t *buf)
+{
+    arena_free(&buf->arena);
+    cmdbuf_init(buf);
+}
+
+void cmdbuf_reset(cmdbuf_t *buf)
+{
+    arena_reset(&buf->arena);
+
+    buf->first = nullptr;
+    buf->next = nullptr;
+    buf->end = nullptr;
+    buf->commands = 0;
+    buf->bytes = 0;
+    buf->overflow = false;
+}
+
+// Room for a command of size bytes, with its header filled in
+static void *cmdbuf_alloc(cmdbuf_t *buf, cmd_op_t op, size_t size)
+{
+    if (unlikely(buf->overflow))
+        return nullptr;
+
+    size = cmd_size(size);
+
+    if (unlikely(!buf->next || size > size_t(buf->end - buf->next))) {
+        size_t jump_size = cmd_size(sizeof(cmd_jump_t));
+        size_t chunk = size + jump_size > CMDBUF_CHUNK_SIZE ?
+                size + jump_size : CMDBUF_CHUNK_SIZE;
+
+        char *mem = (char*)arena_alloc(&buf->arena, chunk, 64);
+
+        if (unlikely(!mem)) {
+            buf->overflow = true;
+            return nullptr;
+        }
+
+        if (buf->next) {
+            // The room was kept for this
+            cmd_jump_t *jump = (cmd_jump_t*)buf->next;
+            jump->header.op = CMD_JUMP;
+            jump->header.size = uint32_t(jump_size);
+            jump->target = (cmd_header_t*)mem;
+        } else {
+            buf->first = (cmd_header_t*)mem;
+        }
+
+        buf->next = mem;
+        buf->end = mem + chunk - jump_size;
+    }
+
+    cmd_header_t *header = (cmd_header_t*)buf->next;
+    header->op = op;
+    header->size = uint32_t(size);
+
+    buf->next += size;
+    buf->bytes += size;
+    ++buf->commands;
+
+    return header;
+}
+
+bool cmdbuf_set_transform(cmdbuf_t *buf, mat4x4 const& m)
+{
+    cmd_set_transform_t *cmd = (cmd_set_transform_t*)cmdbuf_alloc(
+            buf, CMD_SET_TRANSFORM, sizeof(*cmd));
+
+    if (unlikely(!cmd))
+        return false;
+
+    cmd->m = m;
+
+    return true;
+}
+
+bool cmdbuf_draw_indexed(cmdbuf_t *buf, vertex const *vertices,
+    uint32_t const *indices, size_t count, primitive_t primitive,
+    uint32_t color, texture_t const *texture)
+{
+    cmd_draw_indexed_t *cmd = (cmd_draw_indexed_t*)cmdbuf_alloc(
+            buf, CMD_DRAW_INDEXED, sizeof(*cmd));
+
+    if (unlikely(!cmd))
+        return false;
+
+    cmd->vertices = vertices;
+    cmd->indices = indices;
+    cmd->texture = texture;
+    cmd->count = count;
+    cmd->primitive = primitive;
+    cmd->color = color;
+
+    return true;
+}
+
+bool cmdbuf_clear(cmdbuf_t *buf, uint32_t color)
+{
+    cmd_clear_t *cmd = (cmd_clear_t*)cmdbuf_alloc(
+            buf, CMD_CLEAR, sizeof(*cmd));
+
+    if (unlikely(!cmd))
+        return false;
+
+    cmd->color = color;
+
+    return true;
+}
+
+bool cmdbuf_cull_sphere(cmdbuf_t *buf, vec4 const& center, float radius)
+{
+    cmd_cull_sphere_t *cmd = (cmd_cull_sphere_t*)cmdbuf_alloc(
+            buf, CMD_CULL_SPHERE, sizeof(*cmd));
+
+    if (unlikely(!cmd))
+        return false;
+
+    cmd->center = center;
+    cmd->radius = radius;
+
+    return true;
+}
+
+bool cmdbuf_present(cmdbuf_t *buf)
+{
+    return cmdbuf_alloc(buf, CMD_PRESENT, sizeof(cmd_present_t)) != nullptr;
+}
+
+void cmdbuf_execute(cmdbuf_t const *buf,
+    uint32_t *present_dest, size_t present_pitch)
+{
+    cmd_header_t const *cmd = buf->first;
+    cmd_header_t const *end = (cmd_header_t const *)buf->next;
+
+    // Set by a failed cull, jumps don't count as the next command
+    bool skip = false;
+
+    while (cmd != end) {
+        if (skip && cmd->op != CMD_JUMP) {
+            skip = false;
+            cmd = (cmd_header_t const *)((char const *)cmd + cmd->size);
+            continue;
+        }
+
+        switch (cmd->op) {
+        case CMD_SET_TRANSFORM:
+            render_set_transform(((cmd_set_transform_t const *)cmd)->m);
+            break;
+
+        case CMD_DRAW_INDEXED: {
+            cmd_draw_indexed_t const *draw =
+                    (cmd_draw_indexed_t const *)cmd;
+
+            draw_indexed(draw->vertices, draw->indices, draw->count,
+                    draw->primitive, draw->color, draw->texture);
+            break;
+        }
+
+        case CMD_CLEAR:
+            clear_render_surface(((cmd_clear_t const *)cmd)->color);
+
+            if (depth_enabled())
+                depth_clear();
+
+            break;
+
+        case CMD_PRESENT:
+            tile_flush();
+
+            if (present_dest)
+                present(present_dest, present_pitch);
+
+            break;
+
+        case CMD_CULL_SPHERE: {
+            cmd_cull_sphere_t const *cull =
+                    (cmd_cull_sphere_t const *)cmd;
+
+            skip = !render_sphere_visible(cull->center, cull->radius);
+            break;
+        }
+
+        case CMD_JUMP:
+            cmd = ((cmd_jump_t const *)cmd)->target;
+            continue;
+        }
+
+        cmd = (cmd_header_t const *)((char const *)cmd + cmd->size);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "arena.h"
+#include "render.h"
+
+// Recorded frames. Commands are packed one after another in chunks taken
+// from an arena, and executed in order by cmdbuf_execute, any number of
+// times. Recording only writes to the command buffer, so the next frame
+// can be recorded while another buffer executes, on another fiber or CPU.
+// Execution draws through the render module, one buffer at a time
+
+struct cmd_header_t;
+
+struct cmdbuf_t {
+    arena_t arena;
+
+    // First command, and where the next one goes, always
+    // leaving room for a jump to another chunk before end
+    cmd_header_t *first;
+    char *next;
+    char *end;
+
+    // Commands and bytes recorded since the last reset
+    size_t commands;
+    size_t bytes;
+
+    // Set when a command didn't fit, execution stops there
+    bool overflow;
+};
+
+// Commands are taken from the arena in chunks of this many bytes
+static constexpr size_t CMDBUF_CHUNK_SIZE = 4 << 10;
+
+void cmdbuf_init(cmdbuf_t *buf);
+
+void cmdbuf_free(cmdbuf_t *buf);
+
+// Start recording again from the beginning, keeping the memory
+void cmdbuf_reset(cmdbuf_t *buf);
+
+// Each returns false if out of memory, after which nothing more
+// is recorded until the next reset
+
+// As render_set_transform
+bool cmdbuf_set_transform(cmdbuf_t *buf, mat4x4 const& m);
+
+// As draw_indexed. The vertices, indices and texture are not copied,
+// they must stay valid as long as the buffer is executed
+bool cmdbuf_draw_indexed(cmdbuf_t *buf, vertex const *vertices,
+    uint32_t const *indices, size_t count, primitive_t primitive,
+    uint32_t color, texture_t const *texture = nullptr);
+
+// As render_sphere_visible, tested when executed, against the transform
+// set by then. The next command is skipped if the sphere is out of view
+bool cmdbuf_cull_sphere(cmdbuf_t *buf, vec4 const& center, float radius);
+
+// As clear_render_surface, then depth_clear when depth testing
+bool cmdbuf_clear(cmdbuf_t *buf, uint32_t color);
+
+// Rasterize the binned triangles, then present the
+// back buffer to the destination passed to cmdbuf_execute
+bool cmdbuf_present(cmdbuf_t *buf);
+
+// Run the recorded commands. Presents go to present_dest, or only
+// flush the tiles when it is null or there is no back buffer
+void cmdbuf_execute(cmdbuf_t const *buf,
+    uint32_t *present_dest, size_t present_pitch);
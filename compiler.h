@@ -59,6 +59,7 @@
 #define _vector_size(n)         __attribute__((__vector_size__(n)))
 #define _noinline               __attribute__((__noinline__))
 #define _flatten                __attribute__((__flatten__))
+#define _target(isa)            __attribute__((__target__(isa)))
 #define _assume_aligned(n)      __attribute__((__assume_aligned__(n)))
 #define _printf_format(m,n)     __attribute__((__format__(__printf__, m, n)))
 #define _artificial             __attribute__((__artificial__))
@@ -70,7 +71,6 @@
 #define _constructor(prio)      __attribute__((__constructor__(prio)))
 #define _destructor(prio)       __attribute__((__destructor__(prio)))
 
-#define _ifunc_resolver(fn)     __attribute__((__ifunc__(#fn)))
 #define _section(name)          __attribute__((__section__(name)))
 #define _hot                    __attribute__((__hot__))
 #define _cold                   __attribute__((__cold__))
@@ -1,5 +1,77 @@
 #include <stddef.h>
 #include "debug.h"
+#include "fiber.h"
+
+// Output waiting for the drain fiber, indices wrap
+static constexpr size_t DEBUG_RING_SIZE = 4096;
+static char debug_ring[DEBUG_RING_SIZE];
+static size_t debug_ring_head;
+static size_t debug_ring_tail;
+
+static fiber_t *debug_drain_fiber;
+static bool debug_drain_stopping;
+
+// Write what the UART will take without waiting, then let the
+// others run, until stopped with nothing left to write
+static void debug_drain(void *)
+{
+    while (!debug_drain_stopping || debug_ring_head != debug_ring_tail) {
+        while (debug_ring_head != debug_ring_tail && arch_debug_ready())
+            arch_debug_char(debug_ring[debug_ring_head++ &
+                    (DEBUG_RING_SIZE - 1)]);
+
+        fiber_yield();
+    }
+}
+
+void debug_start_drain()
+{
+    if (debug_drain_fiber || !fiber_enabled())
+        return;
+
+    debug_drain_stopping = false;
+    debug_drain_fiber = fiber_spawn(debug_drain, nullptr);
+}
+
+void debug_stop_drain()
+{
+    if (!debug_drain_fiber)
+        return;
+
+    debug_drain_stopping = true;
+    fiber_join(debug_drain_fiber);
+    debug_drain_fiber = nullptr;
+}
+
+void debug_flush_sync()
+{
+    if (!fiber_enabled())
+        return;
+
+    while (debug_ring_head != debug_ring_tail)
+        arch_debug_char(debug_ring[debug_ring_head++ &
+                (DEBUG_RING_SIZE - 1)]);
+}
+
+// Queue for the drain fiber when it can run. Never yields, so it can be
+// called anywhere, when the queue is full the oldest character is
+// written directly, waiting for the UART. Other CPUs write directly
+static void debug_write(char const *s, char const *end)
+{
+    if (!debug_drain_fiber || !fiber_enabled()) {
+        while (s < end)
+            arch_debug_char(*s++);
+        return;
+    }
+
+    while (s < end) {
+        if (debug_ring_tail - debug_ring_head == DEBUG_RING_SIZE)
+            arch_debug_char(debug_ring[debug_ring_head++ &
+                    (DEBUG_RING_SIZE - 1)]);
+
+        debug_ring[debug_ring_tail++ & (DEBUG_RING_SIZE - 1)] = *s++;
+    }
+}
 
 void little_formatterv_default(char *buffer, char **buffer_ptr, 
         size_t buffer_size, void *, int ch)
@@ -22,9 +94,7 @@ void little_formatterv_default(char *buffer, char **buffer_ptr,
         *buffer_ptr = buffer;
         
         // Write the buffer to output
-        while (buffer < end)
-            arch_debug_char(*buffer++);
-        
+        debug_write(buffer, end);
     }
 }
 
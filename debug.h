@@ -33,3 +33,19 @@ int putsdbg(char const *s);
 
 extern "C" 
 void arch_debug_char(uint8_t ch);
+
+// True when arch_debug_char won't have to wait
+extern "C" 
+bool arch_debug_ready();
+
+// Queue output on the boot CPU for a fiber that writes it as the UART
+// takes it, instead of waiting for the UART. Call after fiber_init
+void debug_start_drain();
+
+// Write everything queued, then go back to writing directly
+void debug_stop_drain();
+
+// Write everything queued now, waiting for the UART, without switching
+// fibers. For paths that halt, which the drain fiber would never see.
+// Does nothing on the other CPUs, which never queue
+void debug_flush_sync();
@@ -0,0 +1,177 @@
+#include "depth.h"
+#include "malloc.h"
+#include "string.h"
+#include "likely.h"
+
+depth_counters_t depth_counters;
+
+// What depth_set_enabled asked for, and whether it is in effect,
+// which needs a depth buffer
+static bool depth_request;
+static bool depth_enable;
+static depth_hz_t *depth_hz;
+static uint32_t depth_hz_cols;
+static uint32_t depth_hz_rows;
+
+bool depth_init(uint32_t width, uint32_t height)
+{
+    free(render_surface.depth);
+    free(depth_hz);
+
+    render_surface.depth = nullptr;
+    render_surface.depth_pitch = 0;
+    depth_hz = nullptr;
+    depth_hz_cols = 0;
+    depth_hz_rows = 0;
+    depth_enable = false;
+
+    uint32_t cols = (width + DEPTH_HZ_SIZE - 1) >> DEPTH_HZ_SHIFT;
+    uint32_t rows = (height + DEPTH_HZ_SIZE - 1) >> DEPTH_HZ_SHIFT;
+
+    size_t pitch = (cols << DEPTH_HZ_SHIFT) * sizeof(float);
+
+    float *depth = (float*)malloc(pitch * (rows << DEPTH_HZ_SHIFT));
+    depth_hz_t *hz = (depth_hz_t*)malloc(cols * rows * sizeof(*hz));
+
+    if (unlikely(!depth || !hz)) {
+        free(depth);
+        free(hz);
+        return false;
+    }
+
+    render_surface.depth = depth;
+    render_surface.depth_pitch = pitch;
+    depth_hz = hz;
+    depth_hz_cols = cols;
+    depth_hz_rows = rows;
+    depth_enable = depth_request;
+
+    depth_clear();
+
+    return true;
+}
+
+void depth_set_enabled(bool enable)
+{
+    depth_request = enable;
+    depth_enable = enable && render_surface.depth;
+}
+
+bool depth_enabled()
+{
+    return depth_enable;
+}
+
+void depth_clear(float z)
+{
+    size_t count = depth_hz_cols * depth_hz_rows;
+
+    size_t depth_count = (render_surface.depth_pitch / sizeof(float)) *
+            (depth_hz_rows << DEPTH_HZ_SHIFT);
+
+    for (size_t i = 0; i < depth_count; ++i)
+        render_surface.depth[i] = z;
+
+    for (size_t i = 0; i < count; ++i) {
+        depth_hz[i].zmin = z;
+        depth_hz[i].zmax = z;
+        depth_hz[i].cover = 0;
+        depth_hz[i].cover_zmax = 0.0f;
+    }
+}
+
+void depth_reset_counters()
+{
+    memset(&depth_counters, 0, sizeof(depth_counters));
+}
+
+bool depth_plane_setup(depth_plane_t *plane,
+    vec4 const *v0, vec4 const *v1, vec4 const *v2)
+{
+    float dx1 = v1->x - v0->x;
+    float dy1 = v1->y - v0->y;
+    float dz1 = v1->z - v0->z;
+    float dx2 = v2->x - v0->x;
+    float dy2 = v2->y - v0->y;
+    float dz2 = v2->z - v0->z;
+
+    float det = dx1 * dy2 - dx2 * dy1;
+
+    if (unlikely(det == 0.0f))
+        return false;
+
+    float inv_det = 1.0f / det;
+
+    plane->dzdx = (dz1 * dy2 - dz2 * dy1) * inv_det;
+    plane->dzdy = (dx1 * dz2 - dx2 * dz1) * inv_det;
+    plane->z0 = v0->z - plane->dzdx * v0->x - plane->dzdy * v0->y;
+
+    plane->zmin = v0->z < v1->z ? v0->z : v1->z;
+    plane->zmax = v0->z > v1->z ? v0->z : v1->z;
+    plane->zmin = plane->zmin < v2->z ? plane->zmin : v2->z;
+    plane->zmax = plane->zmax > v2->z ? plane->zmax : v2->z;
+
+    return true;
+}
+
+void depth_block_range(depth_plane_t const *plane, int x, int y,
+    float *zmin, float *zmax)
+{
+    // The plane is linear, so the extremes are at the corner pixels
+    float x0 = float(x & -int(DEPTH_HZ_SIZE)) + 0.5f;
+    float y0 = float(y & -int(DEPTH_HZ_SIZE)) + 0.5f;
+    float z = plane->z0 + plane->dzdx * x0 + plane->dzdy * y0;
+    float zx = plane->dzdx * float(DEPTH_HZ_SIZE - 1);
+    float zy = plane->dzdy * float(DEPTH_HZ_SIZE - 1);
+
+    float lo = z + (zx < 0.0f ? zx : 0.0f) + (zy < 0.0f ? zy : 0.0f);
+    float hi = z + (zx > 0.0f ? zx : 0.0f) + (zy > 0.0f ? zy : 0.0f);
+
+    *zmin = lo > plane->zmin ? lo : plane->zmin;
+    *zmax = hi < plane->zmax ? hi : plane->zmax;
+}
+
+depth_hz_t *depth_hz_at(int x, int y)
+{
+    return depth_hz + (y >> DEPTH_HZ_SHIFT) * depth_hz_cols +
+            (x >> DEPTH_HZ_SHIFT);
+}
+
+bool depth_hz_reject(render_rect_t const& rect, float zmin)
+{
+    if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1)
+        return false;
+
+    int bx0 = rect.x0 >> DEPTH_HZ_SHIFT;
+    int by0 = rect.y0 >> DEPTH_HZ_SHIFT;
+    int bx1 = (rect.x1 - 1) >> DEPTH_HZ_SHIFT;
+    int by1 = (rect.y1 - 1) >> DEPTH_HZ_SHIFT;
+
+    for (int by = by0; by <= by1; ++by) {
+        depth_hz_t const *row = depth_hz + by * depth_hz_cols;
+
+        for (int bx = bx0; bx <= bx1; ++bx) {
+            if (row[bx].zmax > zmin)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void depth_hz_covered(depth_plane_t const *plane, int x0, int x1, int y)
+{
+    int bx0 = (x0 + DEPTH_HZ_SIZE - 1) >> DEPTH_HZ_SHIFT;
+    int bx1 = x1 >> DEPTH_HZ_SHIFT;
+
+    for (int bx = bx0; bx < bx1; ++bx) {
+        float zmin, zmax;
+        depth_block_range(plane, bx << DEPTH_HZ_SHIFT, y, &zmin, &zmax);
+
+        // Every pixel was either written, or was already nearer
+        depth_hz_t *hz = depth_hz_at(bx << DEPTH_HZ_SHIFT, y);
+
+        if (hz->zmax > zmax)
+            hz->zmax = zmax;
+    }
+}
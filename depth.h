@@ -0,0 +1,128 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "polygon.h"
+
+// Window space depth, 0 is the near plane and 1 is the far plane.
+// A pixel is written when its depth is less than the stored depth
+
+// The coarse level keeps a depth range for each 8x8 block
+static constexpr unsigned DEPTH_HZ_SHIFT = 3;
+static constexpr unsigned DEPTH_HZ_SIZE = 1U << DEPTH_HZ_SHIFT;
+
+// Every depth stored in the block is within [zmin, zmax]
+struct depth_hz_t {
+    float zmin;
+    float zmax;
+
+    // Pixels depth tested since zmax was last tightened, one bit each
+    // in rows of 8, and the farthest depth any of them was tested with
+    uint64_t cover;
+    float cover_zmax;
+};
+
+struct depth_counters_t {
+    // Pixels that passed every test and were written
+    uint64_t pixels_written;
+
+    // Covered pixels that failed the per-pixel depth test
+    uint64_t pixels_rejected;
+
+    // Blocks and triangles skipped by the coarse level,
+    // before any per-pixel work
+    uint64_t blocks_rejected;
+    uint64_t tris_rejected;
+
+    // Writes to pixels already drawn, only counted in overdraw mode,
+    // see set_overdraw_mode
+    uint64_t pixels_overdrawn;
+};
+
+// Approximate while tiles are drawn on several CPUs, see tile_flush
+extern depth_counters_t depth_counters;
+
+// Depth of a triangle at any pixel, z = z0 + dzdx * x + dzdy * y,
+// and the range of depths at its vertices
+struct depth_plane_t {
+    float z0;
+    float dzdx;
+    float dzdy;
+    float zmin;
+    float zmax;
+};
+
+// Allocate the depth buffer for the render surface, the rows and
+// columns are rounded up to whole coarse blocks, so block sized
+// accesses never go past the end. Depth testing stays as last set by
+// depth_set_enabled, and is off while there is no depth buffer
+bool depth_init(uint32_t width, uint32_t height);
+
+// Kept across depth_init, so across set_render_surface
+void depth_set_enabled(bool enable);
+bool depth_enabled();
+
+// Set every depth, and the coarse level, to z
+void depth_clear(float z = 1.0f);
+
+void depth_reset_counters();
+
+// Returns false if the triangle has no area
+bool depth_plane_setup(depth_plane_t *plane,
+    vec4 const *v0, vec4 const *v1, vec4 const *v2);
+
+static _always_inline float *depth_row(int y)
+{
+    return (float*)((char*)render_surface.depth +
+        render_surface.depth_pitch * y);
+}
+
+// Range of depths of the plane at the pixel centers of the coarse block
+// containing pixel x, y, clamped to the range at the vertices
+void depth_block_range(depth_plane_t const *plane, int x, int y,
+    float *zmin, float *zmax);
+
+// Coarse block containing pixel x, y
+depth_hz_t *depth_hz_at(int x, int y);
+
+// Pixels [x0, x1) of the block rows starting at y are completely covered by
+// the triangle, tighten zmax of the blocks entirely inside that range
+void depth_hz_covered(depth_plane_t const *plane, int x0, int x1, int y);
+
+// The pixels of the block selected by mask were depth tested with depths
+// of at most zmax, so each now holds at most zmax. Once every pixel of the
+// block has been, partial writes from several triangles included, zmax
+// is tightened to the farthest of them
+static _always_inline void depth_hz_cover(depth_hz_t *hz, uint64_t mask,
+    float zmax)
+{
+    // Much nearer than what is covered so far, the pixels covered
+    // then are likely covered again, start over from these
+    if (hz->cover_zmax - zmax > hz->zmax - hz->cover_zmax) {
+        hz->cover = 0;
+        hz->cover_zmax = 0.0f;
+    }
+
+    hz->cover |= mask;
+
+    if (hz->cover_zmax < zmax)
+        hz->cover_zmax = zmax;
+
+    if (hz->cover != ~uint64_t(0))
+        return;
+
+    if (hz->zmax > hz->cover_zmax)
+        hz->zmax = hz->cover_zmax;
+
+    hz->cover = 0;
+    hz->cover_zmax = 0.0f;
+}
+
+// Bits of one row of a block in a depth_hz_cover mask, columns [x0, x1)
+static _always_inline uint64_t depth_hz_row_mask(int row, int x0, int x1)
+{
+    return uint64_t((0xFFU >> (DEPTH_HZ_SIZE - (x1 - x0))) << x0) <<
+            (row << DEPTH_HZ_SHIFT);
+}
+
+// True when every block touched by rect is entirely nearer than zmin
+bool depth_hz_reject(render_rect_t const& rect, float zmin);
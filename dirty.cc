@@ -0,0 +1,243 @@
+#include "dirty.h"
+#include "arch/stream.h"
+#include "malloc.h"
+#include "string.h"
+#include "likely.h"
+
+dirty_counters_t dirty_counters;
+
+static bool dirty_enable = true;
+
+// Clears and presents each tile still needs
+static uint8_t *dirty_drawn;
+static uint8_t *dirty_changed;
+static uint32_t dirty_cols;
+static uint32_t dirty_rows;
+
+static uint8_t dirty_draw_pages = 1;
+static uint8_t dirty_present_pages = 1;
+
+// Whole surface clears still needed, because the contents are unknown,
+// or the clear color changed
+static uint8_t dirty_full_clears;
+static uint32_t dirty_clear_color;
+
+bool dirty_init(uint32_t width, uint32_t height)
+{
+    free(dirty_drawn);
+    free(dirty_changed);
+
+    dirty_drawn = nullptr;
+    dirty_changed = nullptr;
+    dirty_cols = 0;
+    dirty_rows = 0;
+    dirty_full_clears = dirty_draw_pages;
+
+    uint32_t cols = (width + DIRTY_SIZE - 1) >> DIRTY_SHIFT;
+    uint32_t rows = (height + DIRTY_SIZE - 1) >> DIRTY_SHIFT;
+
+    uint8_t *drawn = (uint8_t*)malloc(cols * rows);
+    uint8_t *changed = (uint8_t*)malloc(cols * rows);
+
+    if (unlikely(!drawn || !changed)) {
+        free(drawn);
+        free(changed);
+        return false;
+    }
+
+    dirty_drawn = drawn;
+    dirty_changed = changed;
+    dirty_cols = cols;
+    dirty_rows = rows;
+
+    dirty_mark_all();
+
+    return true;
+}
+
+void dirty_set_enabled(bool enable)
+{
+    dirty_enable = enable;
+
+    // Nothing was tracked while disabled
+    if (enable)
+        dirty_mark_all();
+}
+
+bool dirty_enabled()
+{
+    return dirty_enable;
+}
+
+void dirty_set_pages(unsigned draw_pages, unsigned present_pages)
+{
+    dirty_draw_pages = draw_pages > 0 ? draw_pages : 1;
+    dirty_present_pages = present_pages > 0 ? present_pages : 1;
+
+    dirty_mark_all();
+}
+
+void dirty_mark(render_rect_t const& rect)
+{
+    if (unlikely(!dirty_drawn))
+        return;
+
+    int x0 = rect.x0 > 0 ? rect.x0 : 0;
+    int y0 = rect.y0 > 0 ? rect.y0 : 0;
+    int x1 = rect.x1 < int(render_surface.width) ?
+            rect.x1 : int(render_surface.width);
+    int y1 = rect.y1 < int(render_surface.height) ?
+            rect.y1 : int(render_surface.height);
+
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    uint32_t tx0 = uint32_t(x0) >> DIRTY_SHIFT;
+    uint32_t tx1 = (uint32_t(x1) + DIRTY_SIZE - 1) >> DIRTY_SHIFT;
+    uint32_t ty0 = uint32_t(y0) >> DIRTY_SHIFT;
+    uint32_t ty1 = (uint32_t(y1) + DIRTY_SIZE - 1) >> DIRTY_SHIFT;
+
+    for (uint32_t ty = ty0; ty < ty1; ++ty) {
+        size_t row = size_t(ty) * dirty_cols;
+        memset(dirty_drawn + row + tx0, dirty_draw_pages, tx1 - tx0);
+        memset(dirty_changed + row + tx0, dirty_present_pages, tx1 - tx0);
+    }
+}
+
+void dirty_mark_all()
+{
+    size_t count = size_t(dirty_cols) * dirty_rows;
+
+    if (dirty_drawn) {
+        memset(dirty_drawn, dirty_draw_pages, count);
+        memset(dirty_changed, dirty_present_pages, count);
+    }
+}
+
+// Pixels [x0, x1) of rows [y0, y1), clamped to the surface
+static void dirty_fill(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1,
+    uint32_t color)
+{
+    x1 = x1 < render_surface.width ? x1 : render_surface.width;
+    y1 = y1 < render_surface.height ? y1 : render_surface.height;
+
+    uint32_t *scanline = (uint32_t*)((char*)render_surface.pixels +
+            size_t(render_surface.pitch) * y0);
+
+    for (uint32_t y = y0; y < y1; ++y) {
+        for (uint32_t x = x0; x < x1; ++x)
+            scanline[x] = color;
+
+        scanline = (uint32_t*)((char*)scanline + render_surface.pitch);
+    }
+
+    dirty_counters.bytes_cleared += uint64_t(x1 - x0) * (y1 - y0) *
+            sizeof(uint32_t);
+}
+
+void dirty_clear(uint32_t color)
+{
+    if (color != dirty_clear_color) {
+        dirty_clear_color = color;
+        dirty_full_clears = dirty_draw_pages;
+    }
+
+    if (!dirty_drawn || !dirty_enable || dirty_full_clears) {
+        dirty_fill(0, 0, render_surface.width, render_surface.height,
+                color);
+
+        if (dirty_full_clears)
+            --dirty_full_clears;
+
+        // Every buffer that was drawn still needs its own clear
+        size_t count = size_t(dirty_cols) * dirty_rows;
+
+        for (size_t i = 0; i < count; ++i) {
+            dirty_drawn[i] -= dirty_drawn[i] > 0;
+            dirty_changed[i] = dirty_present_pages;
+        }
+
+        return;
+    }
+
+    for (uint32_t ty = 0; ty < dirty_rows; ++ty) {
+        uint8_t *drawn = dirty_drawn + size_t(ty) * dirty_cols;
+        uint8_t *changed = dirty_changed + size_t(ty) * dirty_cols;
+
+        for (uint32_t tx = 0; tx < dirty_cols; ++tx) {
+            if (!drawn[tx])
+                continue;
+
+            // Extend the span over the run of drawn tiles
+            uint32_t end = tx;
+
+            do {
+                --drawn[end];
+                changed[end] = dirty_present_pages;
+            } while (++end < dirty_cols && drawn[end]);
+
+            dirty_fill(tx << DIRTY_SHIFT, ty << DIRTY_SHIFT,
+                    end << DIRTY_SHIFT, (ty + 1) << DIRTY_SHIFT, color);
+
+            tx = end;
+        }
+    }
+}
+
+// Pixels [x0, x1) of rows [y0, y1), clamped to the surface
+static void dirty_copy(uint32_t *dest, size_t dest_pitch,
+    uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+    x1 = x1 < render_surface.width ? x1 : render_surface.width;
+    y1 = y1 < render_surface.height ? y1 : render_surface.height;
+
+    size_t bytes = (x1 - x0) * sizeof(uint32_t);
+
+    for (uint32_t y = y0; y < y1; ++y) {
+        arch_stream_copy((char*)dest + dest_pitch * y + x0 * sizeof(uint32_t),
+                (char*)render_surface.pixels +
+                size_t(render_surface.pitch) * y + x0 * sizeof(uint32_t),
+                bytes);
+    }
+
+    dirty_counters.bytes_presented += uint64_t(bytes) * (y1 - y0);
+}
+
+void dirty_present(uint32_t *dest, size_t dest_pitch)
+{
+    ++dirty_counters.frames;
+
+    if (!dirty_changed || !dirty_enable) {
+        dirty_copy(dest, dest_pitch, 0, 0,
+                render_surface.width, render_surface.height);
+        arch_stream_fence();
+        return;
+    }
+
+    for (uint32_t ty = 0; ty < dirty_rows; ++ty) {
+        uint8_t *changed = dirty_changed + size_t(ty) * dirty_cols;
+
+        for (uint32_t tx = 0; tx < dirty_cols; ++tx) {
+            if (!changed[tx])
+                continue;
+
+            uint32_t end = tx;
+
+            do {
+                --changed[end];
+            } while (++end < dirty_cols && changed[end]);
+
+            dirty_copy(dest, dest_pitch, tx << DIRTY_SHIFT, ty << DIRTY_SHIFT,
+                    end << DIRTY_SHIFT, (ty + 1) << DIRTY_SHIFT);
+
+            tx = end;
+        }
+    }
+
+    arch_stream_fence();
+}
+
+void dirty_reset_counters()
+{
+    memset(&dirty_counters, 0, sizeof(dirty_counters));
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "polygon.h"
+
+// Damage tracking for the render surface. The surface is divided into
+// tiles, and each tile counts how many more clears and presents must
+// still touch it. Drawing sets both counts for the tiles it can touch,
+// so clears only refill the tiles drawn since the last clear, and
+// presents only copy the tiles that changed since the last present
+
+static constexpr unsigned DIRTY_SHIFT = 5;
+static constexpr unsigned DIRTY_SIZE = 1U << DIRTY_SHIFT;
+
+struct dirty_counters_t {
+    // Bytes written by clears, and copied by presents
+    uint64_t bytes_cleared;
+    uint64_t bytes_presented;
+
+    // Frames presented
+    uint64_t frames;
+};
+
+extern dirty_counters_t dirty_counters;
+
+// Allocate the tiles for the render surface, every tile starts dirty.
+// Without tiles, every clear and present covers the whole surface
+bool dirty_init(uint32_t width, uint32_t height);
+
+// When disabled, every clear and present covers the whole surface
+void dirty_set_enabled(bool enable);
+bool dirty_enabled();
+
+// Number of pixel buffers drawn in turn, such as the pages of a swap
+// chain drawn directly, and number of pages presented to in turn.
+// A tile is clean once every buffer has been cleared, or every page
+// has been presented. Both default to 1
+void dirty_set_pages(unsigned draw_pages, unsigned present_pages);
+
+// The pixels inside rect may have changed
+void dirty_mark(render_rect_t const& rect);
+
+// Everything may have changed
+void dirty_mark_all();
+
+// Fill the tiles drawn since the last clear with color,
+// or the whole surface when the color is different
+void dirty_clear(uint32_t color);
+
+// Copy the changed tiles of the render surface to dest,
+// runs of adjacent tiles are copied as one span per row
+void dirty_present(uint32_t *dest, size_t dest_pitch);
+
+void dirty_reset_counters();
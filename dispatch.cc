@@ -0,0 +1,43 @@
+#include "dispatch.h"
+#include "debug.h"
+
+struct dispatch_feature_name_t {
+    uint32_t feature;
+    char const *name;
+};
+
+static constexpr dispatch_feature_name_t dispatch_feature_names[] = {
+    { CPU_SSE2, "sse2" },
+    { CPU_SSE41, "sse4.1" },
+    { CPU_AVX, "avx" },
+    { CPU_AVX2, "avx2" },
+    { CPU_FMA, "fma" },
+    { CPU_AVX512F, "avx512f" },
+    { CPU_ERMS, "erms" },
+    { CPU_ASIMD, "asimd" },
+    { CPU_FP16, "fp16" },
+    { CPU_DOTPROD, "dotprod" },
+    { CPU_LSE, "lse" }
+};
+
+void dispatch_report(char const *kernel, char const *variant)
+{
+    printdbg("dispatch %s: %s\n", kernel, variant);
+}
+
+void dispatch_init(uint32_t features)
+{
+    printdbg("dispatch features:");
+
+    for (dispatch_feature_name_t const& f : dispatch_feature_names) {
+        if (features & f.feature)
+            printdbg(" %s", f.name);
+    }
+
+    printdbg("\n");
+
+    memcpy_dispatch(features);
+    polygon_dispatch(features);
+    xform_dispatch(features);
+    sincos_dispatch(features);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "arch/cpu.h"
+
+// Kernels built for several instruction sets are called through a
+// pointer, bound at startup to the best variant the CPU has. A plain
+// pointer needs no ifunc resolver pass, and can be bound again
+
+template<typename T>
+struct dispatch_variant_t {
+    char const *name;
+
+    // Every one of these must be present
+    uint32_t features;
+
+    T value;
+};
+
+// Print which variant a kernel is bound to
+void dispatch_report(char const *kernel, char const *variant);
+
+// Set *target to the first variant within features, best first.
+// The last variant must need none
+template<typename T, size_t N>
+void dispatch_bind(char const *kernel, T *target,
+        dispatch_variant_t<T> const (&variants)[N], uint32_t features)
+{
+    size_t i = 0;
+
+    while (i + 1 < N && (variants[i].features & features) !=
+            variants[i].features)
+        ++i;
+
+    __atomic_store_n(target, variants[i].value, __ATOMIC_RELAXED);
+
+    dispatch_report(kernel, variants[i].name);
+}
+
+// Bind every kernel to its best variant within features. Called with
+// cpu_features on the boot CPU before the others start, and again by
+// the benchmarks, while the other CPUs are idle. Until then every
+// kernel is bound to its baseline variant
+void dispatch_init(uint32_t features);
+
+// Defined next to each kernel, called by dispatch_init
+void memcpy_dispatch(uint32_t features);
+void polygon_dispatch(uint32_t features);
+void xform_dispatch(uint32_t features);
+void sincos_dispatch(uint32_t features);
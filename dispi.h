@@ -16,6 +16,7 @@ void dispi_add_mmio_device(
 
 size_t dispi_display_count();
 
+// The virtual width, vw, is in pixels, and defaults to w
 bool dispi_set_mode(size_t index,
         int w, int h, int bpp, 
         int x = 0, int y = 0, 
@@ -36,4 +37,22 @@ struct dispi_framebuffer_t {
     size_t height;
 };
 
+// Reports the back page when a swap chain is set up
 bool dispi_get_framebuffer(size_t index, dispi_framebuffer_t *info);
+
+// Swap chain of up to DISPI_MAX_PAGES pages, stacked vertically in the
+// framebuffer. One page is scanned out while drawing goes to the back
+// page, and a swap flips by moving the y offset. Returns false if the
+// pages don't fit in the framebuffer. Setting the mode resets it to one
+static constexpr size_t DISPI_MAX_PAGES = 3;
+
+bool dispi_swap_init(size_t index, size_t page_count);
+
+// Show the back page, the next page becomes the back page.
+// The offset takes effect at once, there is no vertical retrace wait
+bool dispi_swap(size_t index);
+
+size_t dispi_back_page(size_t index);
+
+// Whole framebuffer BAR, regardless of the mode
+bool dispi_get_memory(size_t index, uintptr_t *addr, size_t *size);
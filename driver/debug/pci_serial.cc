@@ -34,6 +34,12 @@ static void pci_serial_init()
             pci_serial_pci_ready, nullptr);
 }
 
+// Status isn't checked, writes never wait
+bool arch_debug_ready()
+{
+    return true;
+}
+
 void arch_debug_char(uint8_t ch)
 {
     if (serial_device_count > 0)
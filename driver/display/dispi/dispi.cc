@@ -1,6 +1,7 @@
 #include "dispi.h"
 #include "debug.h"
 #include "arch/pci.h"
+#include "parallel.h"
 
 // https://gitlab.com/qemu-project/qemu/-/blob/master/docs/specs/standard-vga.txt#L59
 
@@ -95,6 +96,11 @@ struct display_t {
     unsigned bpp;
     unsigned virtw;
     unsigned virth;
+
+    // Swap chain, pages are stacked vertically in the framebuffer
+    unsigned page_count;
+    unsigned front_page;
+    unsigned back_page;
 };
 
 // QEMU segfaults with more than 7 anyway
@@ -117,7 +123,8 @@ void dispi_add_mmio_device(
         mmio,
         framebuffer_addr,
         framebuffer_size,
-        0, 0, 0, 0, 0, 0, 0
+        0, 0, 0, 0, 0, 0, 0,
+        1, 0, 0
     };
 
     printdbg("Initialized %zuKB display at %zx\n",
@@ -135,32 +142,65 @@ bool dispi_add_device(uintptr_t mmio_addr,
     return true;
 }
 
+// Bytes per scanline, the virtual width is in pixels
+static size_t dispi_pitch(display_t const *display)
+{
+    return display->virtw * (display->bpp >> 3);
+}
+
+static size_t dispi_page_size(display_t const *display)
+{
+    return dispi_pitch(display) * display->height;
+}
+
+struct dispi_fill_t {
+    uint32_t *pixels;
+    unsigned width;
+    uint32_t tint;
+};
+
+// Rows begin to end of the test pattern
+static void dispi_fill_rows(void *arg, size_t begin, size_t end)
+{
+    dispi_fill_t const *fill = (dispi_fill_t const *)arg;
+
+    for (size_t y = begin; y < end; ++y) {
+        for (size_t x = 0; x < fill->width; ++x) {
+            size_t i = y * fill->width + x;
+
+            uint32_t pixel = (!!(y & 0x40) ^ !!(i & 0x40)
+                    ? 0x123456
+                    : 0x654321);
+
+            fill->pixels[i] = pixel ^ fill->tint;
+        }
+    }
+}
+
 bool dispi_fill_screen(size_t index, size_t page)
 {
     if (index >= MAX_DISPLAYS)
         return false;
 
     display_t *display = displays + index;
-    uint32_t *pixels = (uint32_t*)(display->framebuffer_addr +
-        page * display->virtw * display->height);
 
-    int pixel_count = display->width * display->height;
-    for (int i = 0; i < pixel_count; ++i) {
-        uint32_t pixel = (!!((i / display->width) & 0x40) ^ !!(i & 0x40)
-                ? 0x123456
-                : 0x654321);
+    dispi_fill_t fill;
+    fill.pixels = (uint32_t*)(display->framebuffer_addr +
+        page * dispi_page_size(display));
+    fill.width = display->width;
+    fill.tint = 0;
 
-        if (index & 1)
-            pixel ^= 0x44;
+    if (index & 1)
+        fill.tint ^= 0x44;
 
-        if (index & 2)
-            pixel ^= 0x4400;
+    if (index & 2)
+        fill.tint ^= 0x4400;
 
-        if (index & 4)
-            pixel ^= 0x440000;
+    if (index & 4)
+        fill.tint ^= 0x440000;
 
-        pixels[i] = pixel;
-    }
+    // Split by rows over every CPU
+    parallel_for(0, display->height, 16, dispi_fill_rows, &fill);
 
     return true;
 }
@@ -179,7 +219,7 @@ bool dispi_set_mode(size_t index,
         return false;
 
     if (vw < 0)
-        vw = w * (bpp / 8);
+        vw = w;
 
     if (vh < 0)
         vh = h;
@@ -201,6 +241,9 @@ bool dispi_set_mode(size_t index,
     displays[index].bpp = bpp;
     displays[index].virtw = vw;
     displays[index].virth = vh;
+    displays[index].page_count = 1;
+    displays[index].front_page = 0;
+    displays[index].back_page = 0;
 
     return dispi_set_enable(index, enabled, noclear);
 }
@@ -238,10 +281,67 @@ bool dispi_get_framebuffer(size_t index, dispi_framebuffer_t *info)
     
     display_t &display = displays[index];
     
-    info->pixels = (uint32_t*)display.framebuffer_addr;
-    info->pitch = display.virtw;
+    info->pixels = (uint32_t*)(display.framebuffer_addr +
+        display.back_page * dispi_page_size(&display));
+    info->pitch = dispi_pitch(&display);
     info->width = display.width;
     info->height = display.height;
     
     return true;
 }
+
+bool dispi_swap_init(size_t index, size_t page_count)
+{
+    if (index >= display_count ||
+            page_count < 1 || page_count > DISPI_MAX_PAGES)
+        return false;
+
+    display_t &display = displays[index];
+
+    if (dispi_page_size(&display) * page_count > display.framebuffer_size)
+        return false;
+
+    display.virth = display.height * page_count;
+    display.mmio_addr->vbe.virt_height = display.virth;
+
+    display.page_count = page_count;
+    display.front_page = 0;
+    display.back_page = page_count > 1 ? 1 : 0;
+
+    return dispi_set_pos(index, 0, 0);
+}
+
+bool dispi_swap(size_t index)
+{
+    if (index >= display_count)
+        return false;
+
+    display_t &display = displays[index];
+
+    if (display.page_count < 2)
+        return true;
+
+    display.front_page = display.back_page;
+    display.back_page = (display.back_page + 1) % display.page_count;
+
+    return dispi_set_pos(index, 0, display.front_page * display.height);
+}
+
+size_t dispi_back_page(size_t index)
+{
+    if (index >= display_count)
+        return 0;
+
+    return displays[index].back_page;
+}
+
+bool dispi_get_memory(size_t index, uintptr_t *addr, size_t *size)
+{
+    if (index >= display_count)
+        return false;
+
+    *addr = displays[index].framebuffer_addr;
+    *size = displays[index].framebuffer_size;
+
+    return true;
+}
@@ -0,0 +1,137 @@
+#include "fiber.h"
+#include "arch/context.h"
+#include "arch/smp.h"
+#include "malloc.h"
+#include "assert.h"
+#include "likely.h"
+
+struct fiber_t {
+    // Saved stack pointer, while another fiber runs
+    context_t *context;
+
+    // Ring of runnable fibers, the current one included
+    fiber_t *next;
+    fiber_t *prev;
+
+    fiber_fn fn;
+    void *arg;
+
+    // Set when fn returned, and the fiber left the ring
+    bool done;
+
+    // Last, so it is the first thing an overflowing stack overwrites
+    uint64_t guard;
+};
+
+static constexpr uint64_t FIBER_GUARD = 0x46494245525f4f4bULL;
+
+uint64_t fiber_switch_count;
+
+// The fiber that called fiber_init, never leaves the ring
+static fiber_t fiber_main;
+
+// nullptr until fiber_init
+static fiber_t *fiber_current;
+static unsigned fiber_cpu;
+
+bool fiber_init()
+{
+    if (!arch_context_available())
+        return false;
+
+    fiber_main.next = &fiber_main;
+    fiber_main.prev = &fiber_main;
+    fiber_cpu = arch_smp_cpu_index();
+    fiber_current = &fiber_main;
+
+    return true;
+}
+
+bool fiber_enabled()
+{
+    return fiber_current && arch_smp_cpu_index() == fiber_cpu;
+}
+
+static void fiber_switch_to(fiber_t *next)
+{
+    fiber_t *prev = fiber_current;
+
+    // Caught at the next switch, before the fiber_t is used again
+    assert(prev == &fiber_main || prev->guard == FIBER_GUARD);
+
+    fiber_current = next;
+    ++fiber_switch_count;
+    arch_context_switch(&prev->context, next->context);
+}
+
+static _noreturn void fiber_start(void *arg)
+{
+    fiber_t *self = (fiber_t*)arg;
+
+    self->fn(self->arg);
+
+    // Leave the ring, the main fiber is still in it
+    fiber_t *next = self->next;
+    self->prev->next = next;
+    next->prev = self->prev;
+    self->done = true;
+
+    // The saved context is never resumed, the joiner frees the stack
+    fiber_switch_to(next);
+    __builtin_unreachable();
+}
+
+fiber_t *fiber_spawn(fiber_fn fn, void *arg, size_t stack_size)
+{
+    fiber_t *fiber = nullptr;
+
+    // The fiber lives at the bottom of its own stack
+    if (likely(fiber_enabled()))
+        fiber = (fiber_t*)malloc_aligned(stack_size, 64);
+
+    if (unlikely(!fiber)) {
+        fn(arg);
+        return nullptr;
+    }
+
+    fiber->fn = fn;
+    fiber->arg = arg;
+    fiber->done = false;
+    fiber->guard = FIBER_GUARD;
+    fiber->context = arch_context_init((char*)fiber + stack_size,
+            fiber_start, fiber);
+
+    // Run after the others, just before the caller runs again
+    fiber->next = fiber_current;
+    fiber->prev = fiber_current->prev;
+    fiber->prev->next = fiber;
+    fiber_current->prev = fiber;
+
+    return fiber;
+}
+
+void fiber_yield()
+{
+    if (unlikely(!fiber_enabled()))
+        return;
+
+    fiber_t *next = fiber_current->next;
+
+    if (next != fiber_current)
+        fiber_switch_to(next);
+}
+
+void fiber_join(fiber_t *fiber)
+{
+    if (!fiber)
+        return;
+
+    assert(fiber != fiber_current);
+
+    while (!fiber->done)
+        fiber_yield();
+
+    assert(fiber->guard == FIBER_GUARD);
+
+    free(fiber);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Cooperative fibers on the boot CPU, round robin. Device code calls
+// fiber_yield while it waits on hardware, so the other fibers get to run.
+// Calls from other CPUs, or before fiber_init, don't switch anything,
+// see arch/context.h
+
+// Enough for the fibers that only wait, driver callbacks need more.
+// Overflow is caught by an assert at the next switch away
+static constexpr size_t FIBER_STACK_SIZE = 16 << 10;
+
+struct fiber_t;
+
+typedef void (*fiber_fn)(void *arg);
+
+// Turn the caller into the first fiber. False where the architecture
+// can't switch contexts, fibers then run to completion when spawned
+bool fiber_init();
+
+// True if the caller is a fiber, so yielding would let others run
+bool fiber_enabled();
+
+// Run fn(arg) in a new fiber, which first runs when the caller yields.
+// Runs fn to completion before returning, and returns nullptr, when
+// fibers aren't enabled or out of memory
+fiber_t *fiber_spawn(fiber_fn fn, void *arg,
+        size_t stack_size = FIBER_STACK_SIZE);
+
+// Let the next runnable fiber run, returns at once if there is none
+void fiber_yield();
+
+// Yield until fiber returned, then free it. Does nothing for nullptr
+void fiber_join(fiber_t *fiber);
+
+// Context switches since fiber_init
+extern uint64_t fiber_switch_count;
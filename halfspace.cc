@@ -0,0 +1,411 @@
+#include "halfspace.h"
+#include "compiler.h"
+#include "likely.h"
+
+// Vertices are snapped to 28.4 fixed point, pixel centers are at +0.5
+static constexpr int HS_SUBPIXEL_BITS = 4;
+static constexpr int32_t HS_ONE = 1 << HS_SUBPIXEL_BITS;
+static constexpr int32_t HS_HALF = HS_ONE >> 1;
+
+// Edge values at block corners are saturated to this. The sign of a
+// saturated value can't change within one block, because the in-block
+// increments are limited by HS_MAX_DELTA, and the sum still fits 32 bits
+static constexpr int32_t HS_LIMIT = 1 << 30;
+static constexpr int32_t HS_MAX_DELTA = 1 << 21;
+
+// Beyond this, the float to 28.4 conversion could overflow
+static constexpr float HS_MAX_COORD = 1048576.0f;
+
+static constexpr int HS_BLOCK = 8;
+static constexpr int HS_SUBBLOCK = 4;
+
+static_assert(HS_BLOCK == DEPTH_HZ_SIZE, "Blocks must match the coarse depth");
+
+typedef int32_t v4si _vector_size(16);
+typedef uint32_t v4su _vector_size(16);
+
+// Framebuffer rows are only guaranteed to be 4 byte aligned
+typedef v4su v4su_u _aligned(4);
+
+typedef float v4sf _vector_size(16);
+typedef v4sf v4sf_u _aligned(4);
+
+struct hs_edge_t {
+    // Change in edge value per 28.4 unit in x and y
+    int32_t a;
+    int32_t b;
+
+    // Edge value at 28.4 (0,0), including the fill rule bias
+    int64_t c;
+};
+
+static _always_inline int32_t hs_fixed(float n)
+{
+    n *= float(HS_ONE);
+    return int32_t(n + (n >= 0.0f ? 0.5f : -0.5f));
+}
+
+static _always_inline int32_t hs_saturate(int64_t n)
+{
+    return n > HS_LIMIT ? HS_LIMIT : n < -HS_LIMIT ? -HS_LIMIT : int32_t(n);
+}
+
+static _always_inline bool v4_any_negative(v4si v)
+{
+    return (v[0] | v[1] | v[2] | v[3]) < 0;
+}
+
+static _always_inline bool v4_all(v4si mask)
+{
+    return (mask[0] & mask[1] & mask[2] & mask[3]) != 0;
+}
+
+static _always_inline bool v4_none(v4si mask)
+{
+    return (mask[0] | mask[1] | mask[2] | mask[3]) == 0;
+}
+
+// Counterclockwise triangles go down on the left and up on the right,
+// the edge function is positive inside
+static void hs_setup_edge(hs_edge_t *edge,
+    int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    edge->a = y1 - y0;
+    edge->b = x0 - x1;
+
+    // Top-left fill rule: pixel centers exactly on a left edge or
+    // a top edge are inside, pixel centers exactly on any other edge
+    // are outside
+    bool top_left = edge->a > 0 || (edge->a == 0 && edge->b > 0);
+
+    edge->c = -int64_t(edge->a) * x0 - int64_t(edge->b) * y0 -
+            (top_left ? 0 : 1);
+}
+
+static _always_inline uint32_t *hs_pixel(int x, int y)
+{
+    return (uint32_t*)((char*)render_surface.pixels +
+        render_surface.pitch * y) + x;
+}
+
+static _always_inline int v4_count(v4si mask)
+{
+    return -(mask[0] + mask[1] + mask[2] + mask[3]);
+}
+
+// Per triangle state shared by the block fill functions
+struct hs_raster_t {
+    render_rect_t scissor;
+    uint32_t color;
+
+    // Null when depth testing is off
+    depth_plane_t const *depth;
+
+    // Depth step from the first pixel of a group of 4 to each pixel
+    v4sf zramp;
+
+    uint64_t written;
+    uint64_t rejected;
+};
+
+// Write the pixels of a group of 4 in one row where mask is set.
+// With depth, the pixels that fail the depth test are dropped from
+// the mask, unless ztest is false because the caller knows they pass
+static _always_inline void hs_write4(hs_raster_t *r, int x, int y,
+    v4si mask, bool ztest)
+{
+    if (r->depth) {
+        float *zp = depth_row(y) + x;
+
+        v4sf z = (r->depth->z0 +
+                r->depth->dzdx * (float(x) + 0.5f) +
+                r->depth->dzdy * (float(y) + 0.5f)) + r->zramp;
+
+        if (ztest) {
+            v4si pass = z < *(v4sf_u*)zp;
+            r->rejected += v4_count(mask & ~pass);
+            mask &= pass;
+        }
+
+        if (v4_all(mask)) {
+            *(v4sf_u*)zp = z;
+        } else {
+            for (int i = 0; i < 4; ++i) {
+                if (mask[i])
+                    zp[i] = z[i];
+            }
+        }
+    }
+
+    if (v4_none(mask))
+        return;
+
+    uint32_t *out = hs_pixel(x, y);
+
+    r->written += v4_count(mask);
+
+    if (v4_all(mask)) {
+        v4su colorv = { r->color, r->color, r->color, r->color };
+        *(v4su_u*)out = colorv;
+        return;
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        if (mask[i])
+            out[i] = r->color;
+    }
+}
+
+// Fill a block that is completely inside the triangle and the scissor
+static void hs_fill_block(hs_raster_t *r, int x, int y, int size, bool ztest)
+{
+    v4si all = { -1, -1, -1, -1 };
+
+    if (!r->depth) {
+        v4su colorv = { r->color, r->color, r->color, r->color };
+
+        for (int row = 0; row < size; ++row) {
+            v4su_u *out = (v4su_u*)hs_pixel(x, y + row);
+
+            for (int col = 0; col < size; col += 4)
+                *out++ = colorv;
+        }
+
+        r->written += size * size;
+        return;
+    }
+
+    for (int row = 0; row < size; ++row) {
+        for (int col = 0; col < size; col += 4)
+            hs_write4(r, x + col, y + row, all, ztest);
+    }
+}
+
+// Test every pixel of a 4x4 block, e holds the edge values of the
+// top left pixel of the block, one edge per lane
+static _always_inline void hs_fill_partial(hs_raster_t *r,
+    int x, int y, v4si e, v4si dx, v4si dy, bool ztest)
+{
+    render_rect_t const& scissor = r->scissor;
+
+    v4si ramp = { 0, 1, 2, 3 };
+
+    // Edge values for 4 pixels of the row, one vector per edge
+    v4si r0 = e[0] + ramp * dx[0];
+    v4si r1 = e[1] + ramp * dx[1];
+    v4si r2 = e[2] + ramp * dx[2];
+
+    v4si xs = x + ramp;
+    v4si xmask = (xs >= scissor.x0) & (xs < scissor.x1);
+
+    for (int row = 0; row < HS_SUBBLOCK; ++row, ++y,
+            r0 += dy[0], r1 += dy[1], r2 += dy[2]) {
+        if (y < scissor.y0 || y >= scissor.y1)
+            continue;
+
+        // Inside when no edge value has its sign bit set
+        v4si inside = ((r0 | r1 | r2) >= 0) & xmask;
+
+        if (v4_none(inside))
+            continue;
+
+        hs_write4(r, x, y, inside, ztest);
+    }
+}
+
+bool draw_tri_ccw_halfspace(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t color, render_rect_t const& clip, depth_plane_t const *depth)
+{
+    vec4 const *v[3] = { v0, v1, v2 };
+
+    for (size_t i = 0; i < 3; ++i) {
+        if (v[i]->x < -HS_MAX_COORD || v[i]->x > HS_MAX_COORD ||
+                v[i]->y < -HS_MAX_COORD || v[i]->y > HS_MAX_COORD)
+            return false;
+    }
+
+    int32_t x[3] = { hs_fixed(v0->x), hs_fixed(v1->x), hs_fixed(v2->x) };
+    int32_t y[3] = { hs_fixed(v0->y), hs_fixed(v1->y), hs_fixed(v2->y) };
+
+    hs_edge_t edges[3];
+    for (size_t i = 0; i < 3; ++i) {
+        size_t n = i < 2 ? i + 1 : 0;
+
+        int32_t dx = x[n] - x[i];
+        int32_t dy = y[n] - y[i];
+
+        if (dx <= -HS_MAX_DELTA || dx >= HS_MAX_DELTA ||
+                dy <= -HS_MAX_DELTA || dy >= HS_MAX_DELTA)
+            return false;
+
+        hs_setup_edge(edges + i, x[i], y[i], x[n], y[n]);
+    }
+
+    // Twice the signed area, backfacing and degenerate draw nothing
+    int64_t area = int64_t(edges[0].a) * (x[2] - x[0]) +
+            int64_t(edges[0].b) * (y[2] - y[0]);
+
+    if (area <= 0)
+        return true;
+
+    // Intersect the bounding box with the clip rectangle
+    int32_t minx = x[0] < x[1] ? x[0] : x[1];
+    int32_t maxx = x[0] > x[1] ? x[0] : x[1];
+    int32_t miny = y[0] < y[1] ? y[0] : y[1];
+    int32_t maxy = y[0] > y[1] ? y[0] : y[1];
+    minx = minx < x[2] ? minx : x[2];
+    maxx = maxx > x[2] ? maxx : x[2];
+    miny = miny < y[2] ? miny : y[2];
+    maxy = maxy > y[2] ? maxy : y[2];
+
+    render_rect_t scissor = clip;
+
+    if (scissor.x0 < (minx >> HS_SUBPIXEL_BITS))
+        scissor.x0 = minx >> HS_SUBPIXEL_BITS;
+    if (scissor.y0 < (miny >> HS_SUBPIXEL_BITS))
+        scissor.y0 = miny >> HS_SUBPIXEL_BITS;
+    if (scissor.x1 > (maxx >> HS_SUBPIXEL_BITS) + 1)
+        scissor.x1 = (maxx >> HS_SUBPIXEL_BITS) + 1;
+    if (scissor.y1 > (maxy >> HS_SUBPIXEL_BITS) + 1)
+        scissor.y1 = (maxy >> HS_SUBPIXEL_BITS) + 1;
+
+    if (scissor.x0 >= scissor.x1 || scissor.y0 >= scissor.y1)
+        return true;
+
+    // Per pixel steps, one edge per lane, the unused lane stays zero
+    v4si dx = { edges[0].a * HS_ONE, edges[1].a * HS_ONE,
+            edges[2].a * HS_ONE, 0 };
+    v4si dy = { edges[0].b * HS_ONE, edges[1].b * HS_ONE,
+            edges[2].b * HS_ONE, 0 };
+
+    // Offsets from the top left pixel of a block to the pixel with the
+    // largest (reject) and smallest (accept) value of each edge
+    v4si reject8 = ((dx > 0) & dx) * (HS_BLOCK - 1) +
+            ((dy > 0) & dy) * (HS_BLOCK - 1);
+    v4si accept8 = ((dx < 0) & dx) * (HS_BLOCK - 1) +
+            ((dy < 0) & dy) * (HS_BLOCK - 1);
+    v4si reject4 = ((dx > 0) & dx) * (HS_SUBBLOCK - 1) +
+            ((dy > 0) & dy) * (HS_SUBBLOCK - 1);
+    v4si accept4 = ((dx < 0) & dx) * (HS_SUBBLOCK - 1) +
+            ((dy < 0) & dy) * (HS_SUBBLOCK - 1);
+
+    hs_raster_t r{};
+    r.scissor = scissor;
+    r.color = color;
+    r.depth = depth;
+
+    if (depth) {
+        r.zramp = v4sf{ 0.0f, 1.0f, 2.0f, 3.0f } * depth->dzdx;
+    }
+
+    int bx0 = scissor.x0 & -HS_BLOCK;
+    int by0 = scissor.y0 & -HS_BLOCK;
+
+    // Edge values at the center of the top left pixel of the first block
+    int64_t erow[3];
+    for (size_t i = 0; i < 3; ++i) {
+        erow[i] = int64_t(edges[i].a) * (bx0 * HS_ONE + HS_HALF) +
+                int64_t(edges[i].b) * (by0 * HS_ONE + HS_HALF) +
+                edges[i].c;
+    }
+
+    for (int by = by0; by < scissor.y1; by += HS_BLOCK) {
+        int64_t eblk[3] = { erow[0], erow[1], erow[2] };
+
+        for (int bx = bx0; bx < scissor.x1; bx += HS_BLOCK) {
+            v4si e = {
+                hs_saturate(eblk[0]),
+                hs_saturate(eblk[1]),
+                hs_saturate(eblk[2]),
+                HS_LIMIT
+            };
+
+            for (size_t i = 0; i < 3; ++i)
+                eblk[i] += int64_t(dx[i]) * HS_BLOCK;
+
+            // Whole block outside at least one edge
+            if (v4_any_negative(e + reject8))
+                continue;
+
+            depth_hz_t *hz = nullptr;
+            float blk_zmin = 0.0f;
+            float blk_zmax = 0.0f;
+            bool ztest = true;
+
+            if (depth) {
+                depth_block_range(depth, bx, by, &blk_zmin, &blk_zmax);
+
+                hz = depth_hz_at(bx, by);
+
+                // Everything already in the block is nearer
+                if (blk_zmin >= hz->zmax) {
+                    ++depth_counters.blocks_rejected;
+                    continue;
+                }
+
+                // Everything already in the block is farther
+                ztest = blk_zmax >= hz->zmin;
+
+                if (hz->zmin > blk_zmin)
+                    hz->zmin = blk_zmin;
+            }
+
+            bool block_in_scissor =
+                    bx >= scissor.x0 && bx + HS_BLOCK <= scissor.x1 &&
+                    by >= scissor.y0 && by + HS_BLOCK <= scissor.y1;
+
+            // Whole block inside every edge
+            if (block_in_scissor && !v4_any_negative(e + accept8)) {
+                hs_fill_block(&r, bx, by, HS_BLOCK, ztest);
+
+                // Every pixel of the block is now at most blk_zmax
+                if (hz && hz->zmax > blk_zmax)
+                    hz->zmax = blk_zmax;
+
+                continue;
+            }
+
+            // Partially covered, repeat the tests on 4x4 sub-blocks
+            for (int sy = 0; sy < HS_BLOCK; sy += HS_SUBBLOCK) {
+                for (int sx = 0; sx < HS_BLOCK; sx += HS_SUBBLOCK) {
+                    v4si es = e + dx * sx + dy * sy;
+
+                    if (v4_any_negative(es + reject4))
+                        continue;
+
+                    int px = bx + sx;
+                    int py = by + sy;
+
+                    bool sub_in_scissor =
+                            px >= scissor.x0 &&
+                            px + HS_SUBBLOCK <= scissor.x1 &&
+                            py >= scissor.y0 &&
+                            py + HS_SUBBLOCK <= scissor.y1;
+
+                    if (sub_in_scissor && !v4_any_negative(es + accept4)) {
+                        hs_fill_block(&r, px, py, HS_SUBBLOCK, ztest);
+
+                        // Pixels of partial sub-blocks are left out,
+                        // which only delays tightening zmax
+                        if (hz) {
+                            depth_hz_cover(hz, uint64_t(0x0F0F0F0FU) <<
+                                    (sy * HS_BLOCK + sx), blk_zmax);
+                        }
+
+                        continue;
+                    }
+
+                    hs_fill_partial(&r, px, py, es, dx, dy, ztest);
+                }
+            }
+        }
+
+        for (size_t i = 0; i < 3; ++i)
+            erow[i] += int64_t(dy[i]) * HS_BLOCK;
+    }
+
+    depth_counters.pixels_written += r.written;
+    depth_counters.pixels_rejected += r.rejected;
+
+    return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "polygon.h"
+#include "depth.h"
+
+// Half-space rasterizer. Evaluates the three edge functions for whole
+// pixel blocks with SIMD, skips 8x8 and 4x4 blocks that are completely
+// outside, and fills completely covered blocks without per-pixel tests.
+// Returns false if the triangle is too large for the 32-bit block
+// evaluation, so the caller can fall back to the scanline engine.
+// With a depth plane, 8x8 blocks behind the coarse depth level are
+// skipped, and the remaining pixels are depth tested
+bool draw_tri_ccw_halfspace(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t color, render_rect_t const& clip, depth_plane_t const *depth);
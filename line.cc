@@ -0,0 +1,222 @@
+#include "line.h"
+#include "dirty.h"
+#include "likely.h"
+
+line_counters_t line_counters;
+
+// Framebuffer rows are only guaranteed to be 4 byte aligned
+typedef uint32_t v4su _vector_size(16);
+typedef v4su v4su_u _aligned(4);
+
+static _always_inline uint32_t *line_pixel(int x, int y)
+{
+    return (uint32_t*)((char*)render_surface.pixels +
+            size_t(render_surface.pitch) * y) + x;
+}
+
+// Division rounding toward positive infinity, d must be positive
+static _always_inline int64_t line_ceil_div(int64_t n, int64_t d)
+{
+    int64_t q = n / d;
+    return q + (q * d < n);
+}
+
+// Pixels [x0, x1) of row y, four at a time
+static void line_fill_row(int x0, int x1, int y, uint32_t color)
+{
+    uint32_t *pixel = line_pixel(x0, y);
+    uint32_t *end = pixel + (x1 - x0);
+
+    v4su value = { color, color, color, color };
+
+    for (; end - pixel >= 4; pixel += 4)
+        *(v4su_u*)pixel = value;
+
+    for (; pixel < end; ++pixel)
+        *pixel = color;
+}
+
+// Pixels [y0, y1) of column x
+static void line_fill_column(int x, int y0, int y1, uint32_t color)
+{
+    uint32_t *pixel = line_pixel(x, y0);
+
+    for (int y = y0; y < y1; ++y) {
+        *pixel = color;
+        pixel = (uint32_t*)((char*)pixel + render_surface.pitch);
+    }
+}
+
+// Pixel i of the line, for i in [0, am), is i steps along the major axis,
+// and k(i) = floor((2 * i * an + am) / (2 * am)) steps along the minor
+// axis, the pixel nearest the line. k never decreases, so the pixels
+// inside the clip rectangle are a range of i, found by division, and the
+// error term at the first one is exact
+static uint64_t line_diagonal(int x0, int y0, int64_t dx, int64_t dy,
+    uint32_t color, render_rect_t const& clip)
+{
+    bool xmajor = (dx < 0 ? -dx : dx) >= (dy < 0 ? -dy : dy);
+
+    int64_t dm = xmajor ? dx : dy;
+    int64_t dn = xmajor ? dy : dx;
+    int64_t m0 = xmajor ? x0 : y0;
+    int64_t n0 = xmajor ? y0 : x0;
+    int64_t mlo = xmajor ? clip.x0 : clip.y0;
+    int64_t mhi = xmajor ? clip.x1 : clip.y1;
+    int64_t nlo = xmajor ? clip.y0 : clip.x0;
+    int64_t nhi = xmajor ? clip.y1 : clip.x1;
+
+    int64_t am = dm < 0 ? -dm : dm;
+    int64_t an = dn < 0 ? -dn : dn;
+
+    // Steps along the major axis inside the clip rectangle
+    int64_t st = dm > 0 ? mlo - m0 : m0 - mhi + 1;
+    int64_t en = dm > 0 ? mhi - m0 : m0 - mlo + 1;
+
+    // Steps along the minor axis inside it
+    int64_t klo = dn > 0 ? nlo - n0 : n0 - nhi + 1;
+    int64_t khi = dn > 0 ? nhi - n0 : n0 - nlo + 1;
+
+    int64_t ist = line_ceil_div(2 * am * klo - am, 2 * an);
+    int64_t ien = line_ceil_div(2 * am * khi - am, 2 * an);
+
+    st = st > ist ? st : ist;
+    st = st > 0 ? st : 0;
+    en = en < ien ? en : ien;
+    en = en < am ? en : am;
+
+    if (st >= en)
+        return 0;
+
+    int64_t num = 2 * st * an + am;
+    int64_t k = num / (2 * am);
+    int64_t err = num - k * 2 * am;
+
+    ptrdiff_t xstep = dx < 0 ? -ptrdiff_t(sizeof(uint32_t)) :
+            ptrdiff_t(sizeof(uint32_t));
+    ptrdiff_t ystep = dy < 0 ? -ptrdiff_t(render_surface.pitch) :
+            ptrdiff_t(render_surface.pitch);
+    ptrdiff_t mstep = xmajor ? xstep : ystep;
+    ptrdiff_t nstep = xmajor ? ystep : xstep;
+
+    int64_t m = m0 + (dm < 0 ? -st : st);
+    int64_t n = n0 + (dn < 0 ? -k : k);
+
+    char *pixel = (char*)(xmajor ? line_pixel(int(m), int(n)) :
+            line_pixel(int(n), int(m)));
+
+    for (int64_t i = st; i < en; ++i) {
+        *(uint32_t*)pixel = color;
+        pixel += mstep;
+        err += 2 * an;
+
+        if (err >= 2 * am) {
+            err -= 2 * am;
+            pixel += nstep;
+        }
+    }
+
+    return uint64_t(en - st);
+}
+
+void draw_line_rect(int x0, int y0, int x1, int y1, uint32_t color,
+    render_rect_t const& clip)
+{
+    if (unlikely(x0 < -LINE_MAX_COORD || x0 > LINE_MAX_COORD ||
+            y0 < -LINE_MAX_COORD || y0 > LINE_MAX_COORD ||
+            x1 < -LINE_MAX_COORD || x1 > LINE_MAX_COORD ||
+            y1 < -LINE_MAX_COORD || y1 > LINE_MAX_COORD))
+        return;
+
+    int64_t dx = int64_t(x1) - x0;
+    int64_t dy = int64_t(y1) - y0;
+    uint64_t pixels;
+
+    if (dy == 0) {
+        // The first pixel, up to the last one, in either direction
+        int st = dx > 0 ? x0 : x1 + 1;
+        int en = dx > 0 ? x1 : x0 + 1;
+
+        st = st > clip.x0 ? st : clip.x0;
+        en = en < clip.x1 ? en : clip.x1;
+
+        if (y0 < clip.y0 || y0 >= clip.y1 || st >= en)
+            return;
+
+        line_fill_row(st, en, y0, color);
+        pixels = uint64_t(en - st);
+    } else if (dx == 0) {
+        int st = dy > 0 ? y0 : y1 + 1;
+        int en = dy > 0 ? y1 : y0 + 1;
+
+        st = st > clip.y0 ? st : clip.y0;
+        en = en < clip.y1 ? en : clip.y1;
+
+        if (x0 < clip.x0 || x0 >= clip.x1 || st >= en)
+            return;
+
+        line_fill_column(x0, st, en, color);
+        pixels = uint64_t(en - st);
+    } else {
+        pixels = line_diagonal(x0, y0, dx, dy, color, clip);
+
+        if (!pixels)
+            return;
+    }
+
+    // Bounding box of the endpoints, clamped to clip
+    render_rect_t bounds{
+        x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1,
+        (x0 > x1 ? x0 : x1) + 1, (y0 > y1 ? y0 : y1) + 1
+    };
+
+    bounds.x0 = bounds.x0 > clip.x0 ? bounds.x0 : clip.x0;
+    bounds.y0 = bounds.y0 > clip.y0 ? bounds.y0 : clip.y0;
+    bounds.x1 = bounds.x1 < clip.x1 ? bounds.x1 : clip.x1;
+    bounds.y1 = bounds.y1 < clip.y1 ? bounds.y1 : clip.y1;
+
+    dirty_mark(bounds);
+
+    ++line_counters.lines;
+    line_counters.pixels += pixels;
+}
+
+void draw_line(int x0, int y0, int x1, int y1, uint32_t color)
+{
+    render_rect_t clip{
+        0, 0,
+        int(render_surface.width), int(render_surface.height)
+    };
+
+    draw_line_rect(x0, y0, x1, y1, color, clip);
+}
+
+// Pixel containing window coordinate f, outside the
+// range when f is, including when it is NaN
+static int line_window_pixel(float f)
+{
+    static constexpr float limit = float(LINE_MAX_COORD);
+
+    if (!(f > -limit && f < limit))
+        return LINE_MAX_COORD + 1;
+
+    int i = int(f);
+    return i - (float(i) > f);
+}
+
+bool draw_line_window(vec4 const& a, vec4 const& b, uint32_t color)
+{
+    int x0 = line_window_pixel(a.x);
+    int y0 = line_window_pixel(a.y);
+    int x1 = line_window_pixel(b.x);
+    int y1 = line_window_pixel(b.y);
+
+    draw_line(x0, y0, x1, y1, color);
+
+    // As draw_line_rect decides, the first pixel of a line that has any
+    return (x0 != x1 || y0 != y1) &&
+            x0 >= 0 && x0 < int(render_surface.width) &&
+            y0 >= 0 && y0 < int(render_surface.height) &&
+            x1 >= -LINE_MAX_COORD && x1 <= LINE_MAX_COORD &&
+            y1 >= -LINE_MAX_COORD && y1 <= LINE_MAX_COORD;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "polygon.h"
+
+// Lines, drawn immediately with the Bresenham decision rule, clipped
+// exactly, so a clipped line draws the same pixels as the part of the
+// unclipped line inside the clip rectangle. Lines aren't binned or
+// depth tested, draw overlays after tile_flush so triangles still in
+// the bins don't cover them
+
+// Endpoints further than this from the origin are not drawn
+static constexpr int LINE_MAX_COORD = 1 << 28;
+
+struct line_counters_t {
+    // Lines with at least one pixel inside the clip rectangle
+    uint64_t lines;
+
+    uint64_t pixels;
+};
+
+extern line_counters_t line_counters;
+
+// From pixel (x0, y0) to pixel (x1, y1). The first pixel is drawn and the
+// last one isn't, so polylines and outlines draw each joint once
+void draw_line(int x0, int y0, int x1, int y1, uint32_t color);
+
+void draw_line_rect(int x0, int y0, int x1, int y1, uint32_t color,
+    render_rect_t const& clip);
+
+// Between window space positions, as render_viewport produces,
+// from the pixel each one falls in. True when the pixel a falls in was
+// drawn, false when b falls in the same one or it's off the surface
+bool draw_line_window(vec4 const& a, vec4 const& b, uint32_t color);
@@ -0,0 +1,17 @@
+#include "arch/timer.h"
+
+uint64_t arch_timer_ticks()
+{
+    uint64_t ticks;
+    __asm__ __volatile__ (
+        "rdtime %[ticks]\n\t"
+        : [ticks] "=r" (ticks)
+    );
+    return ticks;
+}
+
+uint64_t arch_timer_freq()
+{
+    // timebase-frequency of the qemu virt machine
+    return 10000000;
+}
@@ -5,6 +5,12 @@
 static uint8_t volatile * const uart_base =
         (uint8_t volatile *)SERIAL_ST;
 
+// Status isn't checked, writes never wait
+bool arch_debug_ready()
+{
+    return true;
+}
+
 void arch_debug_char(uint8_t ch)
 {
     *uart_base = ch;
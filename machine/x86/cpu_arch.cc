@@ -0,0 +1,120 @@
+#include "arch/cpu.h"
+#include "arch/exception.h"
+#include <cpuid.h>
+
+uint32_t cpu_features;
+
+static constexpr uintptr_t CPU_CR4_OSXMMEX = 1U << 10;
+static constexpr uintptr_t CPU_CR4_OSXSAVE = 1U << 18;
+
+// XCR0 state components
+static constexpr uint64_t CPU_XCR0_X87 = 1U << 0;
+static constexpr uint64_t CPU_XCR0_SSE = 1U << 1;
+static constexpr uint64_t CPU_XCR0_AVX = 1U << 2;
+
+// Opmask, upper halves of zmm0-15, and zmm16-31
+static constexpr uint64_t CPU_XCR0_AVX512 = 7U << 5;
+
+// Chosen on the boot CPU, 0 without XSAVE
+static uint64_t cpu_xcr0;
+
+static void cpu_enable_state()
+{
+    uintptr_t cr4;
+    __asm__ __volatile__ ("mov %%cr4,%[cr4]" : [cr4] "=r" (cr4));
+
+    // The entry code set OSFXSR
+    cr4 |= CPU_CR4_OSXMMEX;
+
+    if (cpu_xcr0)
+        cr4 |= CPU_CR4_OSXSAVE;
+
+    __asm__ __volatile__ ("mov %[cr4],%%cr4" : : [cr4] "r" (cr4));
+
+    if (cpu_xcr0) {
+        __asm__ __volatile__ (
+            "xsetbv"
+            :
+            : "c" (0)
+            , "a" (uint32_t(cpu_xcr0))
+            , "d" (uint32_t(cpu_xcr0 >> 32))
+        );
+    }
+}
+
+void arch_cpu_init()
+{
+    // Before anything that could fault
+#ifdef __x86_64__
+    arch_exception_init();
+#endif
+
+    unsigned eax, ebx, ecx, edx;
+    unsigned max_leaf = __get_cpuid_max(0, nullptr);
+
+    if (max_leaf < 1)
+        return;
+
+    __cpuid(1, eax, ebx, ecx, edx);
+
+    unsigned ecx1 = ecx;
+    unsigned ebx7 = 0;
+
+    if (max_leaf >= 7)
+        __cpuid_count(7, 0, eax, ebx7, ecx, edx);
+
+    uint32_t features = 0;
+
+    if (edx & bit_SSE2)
+        features |= CPU_SSE2;
+
+    if (ecx1 & bit_SSE4_1)
+        features |= CPU_SSE41;
+
+    // Enhanced rep movsb
+    if (ebx7 & (1U << 9))
+        features |= CPU_ERMS;
+
+    if ((ecx1 & bit_XSAVE) && max_leaf >= 0xD) {
+        // Components XCR0 can enable
+        __cpuid_count(0xD, 0, eax, ebx, ecx, edx);
+        uint64_t supported = eax | (uint64_t(edx) << 32);
+
+        uint64_t xcr0 = CPU_XCR0_X87 | CPU_XCR0_SSE;
+
+        if (ecx1 & bit_AVX)
+            xcr0 |= CPU_XCR0_AVX & supported;
+
+        if ((xcr0 & CPU_XCR0_AVX) && (ebx7 & bit_AVX512F) &&
+                (supported & CPU_XCR0_AVX512) == CPU_XCR0_AVX512)
+            xcr0 |= CPU_XCR0_AVX512;
+
+        cpu_xcr0 = xcr0;
+    }
+
+    cpu_enable_state();
+
+    if (cpu_xcr0 & CPU_XCR0_AVX) {
+        features |= CPU_AVX;
+
+        if (ecx1 & bit_FMA)
+            features |= CPU_FMA;
+
+        if (ebx7 & bit_AVX2)
+            features |= CPU_AVX2;
+
+        if (cpu_xcr0 & CPU_XCR0_AVX512)
+            features |= CPU_AVX512F;
+    }
+
+    cpu_features = features;
+}
+
+void arch_cpu_init_secondary()
+{
+#ifdef __x86_64__
+    arch_exception_init_secondary();
+#endif
+
+    cpu_enable_state();
+}
@@ -1,7 +1,21 @@
 #include "debug.h"
 #include "portio_arch.h"
 
+static constexpr uint16_t COM1_BASE = 0x3f8;
+static constexpr uint16_t COM1_LSR = COM1_BASE + 5;
+
+// Transmit holding register empty
+static constexpr uint8_t COM1_LSR_THRE = 0x20;
+
+bool arch_debug_ready()
+{
+    return inb(COM1_LSR) & COM1_LSR_THRE;
+}
+
 void arch_debug_char(uint8_t ch)
 {
-    outb(0x3f8, ch);
+    while (!arch_debug_ready())
+        __builtin_ia32_pause();
+
+    outb(COM1_BASE, ch);
 }
@@ -0,0 +1,52 @@
+#include "arch/timer.h"
+#include "portio_arch.h"
+
+static uint64_t timer_freq;
+
+static _always_inline uint64_t rdtsc()
+{
+    uint32_t lo, hi;
+    __asm__ __volatile__ (
+        "rdtsc\n\t"
+        : "=a" (lo)
+        , "=d" (hi)
+    );
+    return (uint64_t(hi) << 32) | lo;
+}
+
+uint64_t arch_timer_ticks()
+{
+    return rdtsc();
+}
+
+// Count TSC ticks during a 10ms one-shot on PIT channel 2
+static uint64_t timer_calibrate()
+{
+    static constexpr uint32_t pit_hz = 1193182;
+    static constexpr uint16_t pit_count = pit_hz / 100;
+
+    // Gate channel 2 on, speaker off
+    outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+
+    // Channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+    outb(0x43, 0xB0);
+    outb(0x42, pit_count & 0xFF);
+    outb(0x42, pit_count >> 8);
+
+    uint64_t st = rdtsc();
+
+    // OUT2 goes high at terminal count
+    while (!(inb(0x61) & 0x20));
+
+    uint64_t en = rdtsc();
+
+    return (en - st) * pit_hz / pit_count;
+}
+
+uint64_t arch_timer_freq()
+{
+    if (!timer_freq)
+        timer_freq = timer_calibrate();
+
+    return timer_freq;
+}
@@ -5,10 +5,20 @@
 #include "debug.h"
 #include "dispi.h"
 #include "polygon.h"
+#include "render.h"
+#include "cmdbuf.h"
+#include "present.h"
+#include "dirty.h"
+#include "tile.h"
+#include "depth.h"
+#include "bench.h"
+#include "parallel.h"
+#include "fiber.h"
 #include "likely.h"
 #include "math/math.h"
 #include "vec.h"
 #include "malloc.h"
+#include "dispatch.h"
 
 vec4 test_cube[] = {
     // South face
@@ -58,29 +68,24 @@ uint32_t test_indexes[] = {
 //GL_T2F_C4F_N3F_V3F
 //GL_T4F_C4F_N3F_V4F
 
-struct vertex {
-    texcoord tex;
-    vec4 pos;
-};
-
 extern void *bump_alloc;
 
-int main();
-int main()
+// Driver callbacks ran on the boot stack before, give them plenty
+static constexpr size_t MAIN_DISPLAY_STACK_SIZE = 256 << 10;
+
+// Enumerate PCI and set every display mode, the drivers yield while
+// waiting on hardware. Clears *ok when no display driver started
+static void main_display_init(void *arg)
 {
-    //*(int*)0xf00ff00f = 42;
+    bool *ok = (bool*)arg;
+
     pci_init();
-    
-    void *heap_st = bump_alloc;
-    void *heap_en = (char*)heap_st + (4 << 20);
-    bump_alloc = heap_en;
-    malloc_init(heap_st, heap_en);
-    
-    bool dispi_ok = dispi_init();
-    
-    if (!dispi_ok)
-        return 0;
-    
+
+    *ok = dispi_init();
+
+    if (!*ok)
+        return;
+
     size_t display_count = dispi_display_count();
     
     for (size_t i = 0; i < display_count; ++i) {
@@ -89,8 +94,48 @@ int main()
 
         dispi_set_mode(i, width, height, 32);
 
+        // Double buffered when the framebuffer has room
+        dispi_swap_init(i, 2);
+
         dispi_fill_screen(i, 0);
     }
+}
+
+int main();
+int main()
+{
+    //*(int*)0xf00ff00f = 42;
+    arch_cpu_init();
+
+    void *heap_st = bump_alloc;
+    void *heap_en = (char*)heap_st + (32 << 20);
+    bump_alloc = heap_en;
+    malloc_init(heap_st, heap_en);
+
+    // Serial output drains in its own fiber from here on
+    fiber_init();
+    debug_start_drain();
+
+    // Before the other CPUs start, they only ever see the best kernels
+    dispatch_init(cpu_features);
+
+    // Wake the other CPUs before the display fiber exists. The SIPI
+    // delays and the arrival window yield, and only the drain fiber,
+    // which never holds the CPU for long, may run in them
+    unsigned cpu_count = parallel_init();
+    printdbg("%u CPUs running\n", cpu_count);
+
+    // Overlaps the drain, the drivers yield while waiting on hardware
+    bool dispi_ok = false;
+    fiber_join(fiber_spawn(main_display_init, &dispi_ok,
+            MAIN_DISPLAY_STACK_SIZE));
+    
+    if (!dispi_ok) {
+        debug_stop_drain();
+        return 0;
+    }
+    
+    size_t display_count = dispi_display_count();
     
     if (display_count) {
         dispi_framebuffer_t fb;
@@ -110,112 +155,93 @@ int main()
             };
             static constexpr size_t test_vec_count = 
                     sizeof(test)/sizeof(*test);
-            vec4 xf[test_vec_count];
+
+            // Reversed, to wind counterclockwise in window space
+            static uint32_t const test_tri[] = { 0, 2, 1 };
+            vertex test_verts[test_vec_count];
+
+            for (size_t i = 0; i < test_vec_count; ++i) {
+                test_verts[i].pos = test[i];
+                test_verts[i].tex = texcoord();
+            }
             
             set_render_surface(fb.pixels, fb.pitch, fb.width, fb.height);
+            depth_set_enabled(true);
+            clip_set_guard_band(4.0f);
+
+            if (ENABLE_BENCH)
+                bench_run_all();
+
+            // Draw in RAM when there is room for a back buffer, and copy
+            // the changed tiles to each page of the swap chain in turn.
+            // Otherwise both pages are drawn, and cleared, in turn
+            bool back_buffer = present_init(fb.width, fb.height);
+            dirty_set_pages(back_buffer ? 1 : 2, back_buffer ? 2 : 1);
+            dirty_reset_counters();
+            render_reset_cull_counters();
+
+            // Bounding sphere of the test triangle, around the origin,
+            // skips the transform and clip when it is out of view
+            float test_radius = 0.0f;
+
+            for (vec4 const& v : test)
+                test_radius = v.len() > test_radius ? v.len() : test_radius;
+
+            // Each frame is recorded, then executed, in memory
+            // kept from the frame before
+            cmdbuf_t frame_cmds;
+            cmdbuf_init(&frame_cmds);
             
 //            float pix100 = 314.15926535897923f;
             for (size_t i = 0; i < 0xffffff; ++i) {
-                mtxProj->transform(xf, test, test_vec_count);
-                
-                // Clip
-                int clip_m[4] = { 0, 0, 0, 0 };
-                int clip_p[4] = { 0, 0, 0, 0 };
-                
-                //
-                // Classify all the points
-                
-                for (size_t i = 0; i < test_vec_count; ++i) {
-                    vec4 &v = xf[i];
-                    float pw = v.w;
-                    float mw = -v.w;
-                    
-                    // Say it in a way that makes it obvious to vectorize
-                    clip_p[0] += v.x > pw;
-                    clip_p[1] += v.y > pw;
-                    clip_p[2] += v.z > pw;
-                    clip_p[3] += v.w > pw;
-                    
-                    clip_m[0] += v.x < mw;
-                    clip_m[1] += v.y < mw;
-                    clip_m[2] += v.z < mw;
-                    clip_m[3] += v.w < mw;
-                }
-                
-                //
-                // Skip if completely clipped away
-                
-                if (clip_m[0] == test_vec_count || 
-                        clip_m[1] == test_vec_count ||
-                        clip_m[2] == test_vec_count ||
-                        clip_m[3] == test_vec_count)
-                    continue;
-                
-                if (clip_p[0] == test_vec_count || 
-                        clip_p[1] == test_vec_count ||
-                        clip_p[2] == test_vec_count ||
-                        clip_p[3] == test_vec_count)
-                    continue;
-                
-                vec4 outverts[4];
-                size_t outindex = 0;
-                
-                if (clip_m[2]) {
-                    // +z clip
-                    
-                    for (size_t i = 1; i <= test_vec_count; ++i) {
-                        vec4 const& st = xf[i - 1];
-                        vec4 const& en = xf[i & -(i < test_vec_count)];
-                        vec4 de = en - st;
-                        float d;
-                        
-                        //   3 ----+--+--
-                        //         | /  |  
-                        //         |/   | down -2 -  3 = -5
-                        //   0 ----*    |  
-                        //        /     |   up  3 - -2 =  5
-                        //  -2 --+-------
-                        
-                        if ((st.w+st.z) >= 0 && (en.w+en.z) < 0) {
-                            // Clip end
-                            d = (st.w+st.z) / ((st.w+st.z) - (en.w+en.z));
-                            outverts[outindex++] = st;
-                            outverts[outindex++] = st + de * d;
-                        } else if ((st.w+st.z) < 0 && (en.w+en.z) >= 0) {
-                            // Clip start
-                            d = -(st.w+st.z) / ((en.w+en.z) - (st.w+st.z));
-                            outverts[outindex++] = st + de * d;
-                        } else if ((st.w+st.z) > 0) {
-                            outverts[outindex++] = st;
-                        }
-                    }
-                }
-                
-                for (size_t i = 0; i < outindex; ++i)
-                    xf[i] = outverts[i];
-                size_t vec_count = outindex;
-                
-                // Transform normalized device coordinates 
-                // into window coordinates
-                for (size_t i = 0; i < vec_count; ++i) {
-                    vec4 v = xf[i];
-                    
-                    v.w = 1.0f / v.w;
-                    
-                    v = {
-                        (v.x * v.w + 1.0f) * fb.width * 0.5f,
-                        (v.y * v.w + 1.0f) * fb.height * 0.5f,
-                        (v.z + 1.0f) * 0.5f * v.w,
-                        v.w
-                    };
-                    
-                    xf[i] = v;
+                cmdbuf_reset(&frame_cmds);
+                cmdbuf_clear(&frame_cmds, 0);
+                cmdbuf_set_transform(&frame_cmds, *mtxProj);
+
+                cmdbuf_cull_sphere(&frame_cmds, vec4(), test_radius);
+                cmdbuf_draw_indexed(&frame_cmds, test_verts,
+                        test_tri, 3, PRIM_TRIANGLES, i);
+
+                // Rasterize the binned triangles tile by tile,
+                // then copy them out of the back buffer
+                cmdbuf_present(&frame_cmds);
+
+                cmdbuf_execute(&frame_cmds,
+                        back_buffer ? fb.pixels : nullptr, fb.pitch);
+
+                // Average bytes moved per frame by clears and presents
+                if ((i & 0xff) == 0xff) {
+                    printdbg("frame %zu, cleared %llu, presented %llu"
+                            " bytes per frame\n", i + 1,
+                            (unsigned long long)(
+                            dirty_counters.bytes_cleared >> 8),
+                            (unsigned long long)(
+                            dirty_counters.bytes_presented >> 8));
+                    printdbg("frame %zu, culled %llu objects,"
+                            " %llu tris outside, %llu backfacing\n", i + 1,
+                            (unsigned long long)cull_counters.objects_culled,
+                            (unsigned long long)cull_counters.tris_outside,
+                            (unsigned long long)
+                            cull_counters.tris_backfacing);
+                    dirty_reset_counters();
+                    render_reset_cull_counters();
                 }
-                
-                draw_tri_ccw(xf, xf+2, xf+1, i);
+
+                // Show the finished frame, and draw the next one
+                // into the page that was being shown
+                dispi_swap(0);
+
+                if (dispi_get_framebuffer(0, &fb) && !back_buffer)
+                    set_render_pixels(fb.pixels);
+
+                // Let the serial output drain
+                fiber_yield();
             }
+
+            cmdbuf_free(&frame_cmds);
         }
     }
     
+    debug_stop_drain();
     return 0;
 }
@@ -11,7 +11,7 @@
 #include "debug.h"
 #include "string.h"
 
-#define PANIC(...) arch_halt()
+#define PANIC(...) (debug_flush_sync(), arch_halt())
 #define PRINT printdbg
 #define HEAP_DEBUG 0
 
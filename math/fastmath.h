@@ -0,0 +1,275 @@
+#pragma once
+
+#include <stdint.h>
+#include "string.h"
+#include "compiler.h"
+
+// Reciprocal and reciprocal square root from the hardware estimate where
+// there is one, refined by Newton-Raphson steps. Each step about doubles
+// the correct bits, the default steps reach about 22 everywhere.
+// Results for 0 and infinity are unspecified. Soft-float builds have no
+// FP registers for the asm, they take the integer estimates instead
+
+typedef float fastmath_v4sf _vector_size(16);
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+// rsqrtss and rcpss, 12 bits
+#define FASTMATH_RSQRT_STEPS 1
+#define FASTMATH_RCP_STEPS 1
+#elif defined(__i386__) || (defined(__riscv) && defined(__riscv_flen))
+// Exact, from fsqrt and the divide
+#define FASTMATH_RSQRT_STEPS 0
+#define FASTMATH_RCP_STEPS 0
+#elif defined(__aarch64__)
+// frsqrte and frecpe, 8 bits
+#define FASTMATH_RSQRT_STEPS 2
+#define FASTMATH_RCP_STEPS 2
+#elif defined(__powerpc__) && !defined(_SOFT_FLOAT)
+// frsqrte 5 bits, and fres 8 bits
+#define FASTMATH_RSQRT_STEPS 3
+#define FASTMATH_RCP_STEPS 2
+#elif defined(__mips__) && defined(__mips_hard_float)
+// rsqrt.s and recip.s, accurate to a few ulp on most implementations
+#define FASTMATH_RSQRT_STEPS 1
+#define FASTMATH_RCP_STEPS 1
+#else
+// Bit hacks below, 4 bits
+#define FASTMATH_RSQRT_STEPS 3
+#define FASTMATH_RCP_STEPS 3
+#endif
+
+static _always_inline float rsqrtf_estimate(float n)
+{
+    float result;
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+    __asm__("rsqrtss %[src],%[dst]"
+        : [dst] "=x" (result)
+        : [src] "x" (n)
+    );
+#elif defined(__i386__)
+    result = n;
+    __asm__("fsqrt\n\t"
+        : [dst] "+t" (result)
+    );
+    result = 1.0f / result;
+#elif defined(__aarch64__)
+    result = vrsqrtes_f32(n);
+#elif defined(__powerpc__) && !defined(_SOFT_FLOAT)
+    __asm__("frsqrte %[dst],%[src]"
+        : [dst] "=f" (result)
+        : [src] "f" (n)
+    );
+#elif defined(__mips__) && defined(__mips_hard_float)
+    __asm__("rsqrt.s %[dst],%[src]"
+        : [dst] "=f" (result)
+        : [src] "f" (n)
+    );
+#elif defined(__riscv) && defined(__riscv_flen)
+    __asm__("fsqrt.s %[dst],%[src]"
+        : [dst] "=f" (result)
+        : [src] "f" (n)
+    );
+    result = 1.0f / result;
+#else
+    // https://en.wikipedia.org/wiki/Fast_inverse_square_root
+    uint32_t i;
+    memcpy(&i, &n, sizeof(i));
+    i = 0x5f3759df - (i >> 1);
+    memcpy(&result, &i, sizeof(result));
+#endif
+    return result;
+}
+
+static _always_inline float rcpf_estimate(float n)
+{
+    float result;
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+    __asm__("rcpss %[src],%[dst]"
+        : [dst] "=x" (result)
+        : [src] "x" (n)
+    );
+#elif defined(__i386__) || (defined(__riscv) && defined(__riscv_flen))
+    result = 1.0f / n;
+#elif defined(__aarch64__)
+    result = vrecpes_f32(n);
+#elif defined(__powerpc__) && !defined(_SOFT_FLOAT)
+    __asm__("fres %[dst],%[src]"
+        : [dst] "=f" (result)
+        : [src] "f" (n)
+    );
+#elif defined(__mips__) && defined(__mips_hard_float)
+    __asm__("recip.s %[dst],%[src]"
+        : [dst] "=f" (result)
+        : [src] "f" (n)
+    );
+#else
+    // Reflects the exponent, the mantissa is a first guess
+    uint32_t i;
+    memcpy(&i, &n, sizeof(i));
+    i = 0x7ef311c3 - i;
+    memcpy(&result, &i, sizeof(result));
+#endif
+    return result;
+}
+
+static _always_inline float rsqrtf(float n,
+        unsigned steps = FASTMATH_RSQRT_STEPS)
+{
+    float y = rsqrtf_estimate(n);
+
+    for (unsigned i = 0; i < steps; ++i) {
+#if defined(__aarch64__)
+        // frsqrts is (3 - a * b) / 2
+        y *= vrsqrtss_f32(n * y, y);
+#else
+        y *= 1.5f - 0.5f * n * y * y;
+#endif
+    }
+
+    return y;
+}
+
+static _always_inline float rcpf(float n,
+        unsigned steps = FASTMATH_RCP_STEPS)
+{
+    float y = rcpf_estimate(n);
+
+    for (unsigned i = 0; i < steps; ++i) {
+#if defined(__aarch64__)
+        // frecps is 2 - a * b
+        y *= vrecpss_f32(n, y);
+#else
+        y *= 2.0f - n * y;
+#endif
+    }
+
+    return y;
+}
+
+// Correctly rounded where there is an instruction
+static _always_inline float sqrtf(float n)
+{
+    float result;
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+    __asm__("sqrtss %[src],%[dst]"
+        : [dst] "=x" (result)
+        : [src] "x" (n)
+    );
+#elif defined(__i386__)
+    result = n;
+    __asm__("fsqrt\n\t"
+        : [dst] "+t" (result)
+    );
+#elif defined(__aarch64__)
+    __asm__("fsqrt %s[dst],%s[src]"
+        : [dst] "=w" (result)
+        : [src] "w" (n)
+    );
+#elif defined(__mips__) && defined(__mips_hard_float)
+    __asm__("sqrt.s %[dst],%[src]"
+        : [dst] "=f" (result)
+        : [src] "f" (n)
+    );
+#elif defined(__riscv) && defined(__riscv_flen)
+    __asm__("fsqrt.s %[dst],%[src]"
+        : [dst] "=f" (result)
+        : [src] "f" (n)
+    );
+#else
+    // fsqrt is optional on ppc, and the 603 and 750 lack it.
+    // Zero would be 0 * infinity
+    result = n > 0.0f ? n * rsqrtf(n) : n;
+#endif
+    return result;
+}
+
+// Four lanes of the above, per lane where there is no vector estimate
+
+static _always_inline fastmath_v4sf rsqrtf4_estimate(fastmath_v4sf n)
+{
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+    return __builtin_ia32_rsqrtps(n);
+#elif defined(__aarch64__)
+    return (fastmath_v4sf)vrsqrteq_f32((float32x4_t)n);
+#elif defined(__ALTIVEC__)
+    return __builtin_altivec_vrsqrtefp(n);
+#else
+    fastmath_v4sf result;
+
+    for (int i = 0; i < 4; ++i)
+        result[i] = rsqrtf_estimate(n[i]);
+
+    return result;
+#endif
+}
+
+static _always_inline fastmath_v4sf rcpf4_estimate(fastmath_v4sf n)
+{
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+    return __builtin_ia32_rcpps(n);
+#elif defined(__aarch64__)
+    return (fastmath_v4sf)vrecpeq_f32((float32x4_t)n);
+#elif defined(__ALTIVEC__)
+    return __builtin_altivec_vrefp(n);
+#else
+    fastmath_v4sf result;
+
+    for (int i = 0; i < 4; ++i)
+        result[i] = rcpf_estimate(n[i]);
+
+    return result;
+#endif
+}
+
+static _always_inline fastmath_v4sf rsqrtf4(fastmath_v4sf n,
+        unsigned steps = FASTMATH_RSQRT_STEPS)
+{
+    fastmath_v4sf y = rsqrtf4_estimate(n);
+
+    for (unsigned i = 0; i < steps; ++i) {
+#if defined(__aarch64__)
+        y *= (fastmath_v4sf)vrsqrtsq_f32((float32x4_t)(n * y),
+                (float32x4_t)y);
+#else
+        y *= 1.5f - 0.5f * n * y * y;
+#endif
+    }
+
+    return y;
+}
+
+static _always_inline fastmath_v4sf rcpf4(fastmath_v4sf n,
+        unsigned steps = FASTMATH_RCP_STEPS)
+{
+    fastmath_v4sf y = rcpf4_estimate(n);
+
+    for (unsigned i = 0; i < steps; ++i) {
+#if defined(__aarch64__)
+        y *= (fastmath_v4sf)vrecpsq_f32((float32x4_t)n, (float32x4_t)y);
+#else
+        y *= 2.0f - n * y;
+#endif
+    }
+
+    return y;
+}
+
+static _always_inline fastmath_v4sf sqrtf4(fastmath_v4sf n)
+{
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE__))
+    return __builtin_ia32_sqrtps(n);
+#elif defined(__aarch64__)
+    return (fastmath_v4sf)vsqrtq_f32((float32x4_t)n);
+#else
+    fastmath_v4sf result;
+
+    for (int i = 0; i < 4; ++i)
+        result[i] = sqrtf(n[i]);
+
+    return result;
+#endif
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <stdint.h>
+#include "compiler.h"
+
+// Fixed point scalars, for targets without an FPU, or built soft-float,
+// where every float operation is a libgcc call. Products are taken in
+// 64 bits and rounded once. Float conversions are for constants and for
+// the edges of an integer only path, at run time they are float math
+
+// 16.16, positions and matrices. Covers -32768 to 32768
+struct fix16_t {
+    int32_t raw;
+
+    static constexpr int FRAC_BITS = 16;
+    static constexpr int32_t ONE = 1 << FRAC_BITS;
+
+    constexpr fix16_t() : raw(0) {}
+
+    constexpr fix16_t(int n) : raw(int32_t(uint32_t(n) << FRAC_BITS)) {}
+
+    // Rounded to nearest. Explicit, so float math can't slip
+    // into fixed point code through a conversion
+    constexpr explicit fix16_t(float n)
+        : raw(int32_t(n * float(ONE) + (n >= 0.0f ? 0.5f : -0.5f))) {}
+
+    static constexpr fix16_t from_raw(int32_t raw)
+    {
+        fix16_t result;
+        result.raw = raw;
+        return result;
+    }
+
+    constexpr float to_float() const
+    {
+        return float(raw) * (1.0f / float(ONE));
+    }
+
+    // Rounded toward negative infinity
+    constexpr int floor() const
+    {
+        return raw >> FRAC_BITS;
+    }
+
+    constexpr fix16_t operator-() const
+    {
+        return from_raw(-raw);
+    }
+
+    constexpr fix16_t operator+(fix16_t rhs) const
+    {
+        return from_raw(raw + rhs.raw);
+    }
+
+    constexpr fix16_t operator-(fix16_t rhs) const
+    {
+        return from_raw(raw - rhs.raw);
+    }
+
+    constexpr fix16_t operator*(fix16_t rhs) const
+    {
+        return from_raw(int32_t((int64_t(raw) * rhs.raw +
+                (ONE >> 1)) >> FRAC_BITS));
+    }
+
+    // Truncated toward zero, saturated where the quotient
+    // is out of range. rhs must not be zero
+    constexpr fix16_t operator/(fix16_t rhs) const
+    {
+        int64_t q = int64_t(raw) * ONE / rhs.raw;
+
+        return from_raw(q > INT32_MAX ? INT32_MAX :
+                q < INT32_MIN ? INT32_MIN : int32_t(q));
+    }
+
+    fix16_t &operator+=(fix16_t rhs)
+    {
+        return *this = *this + rhs;
+    }
+
+    fix16_t &operator-=(fix16_t rhs)
+    {
+        return *this = *this - rhs;
+    }
+
+    fix16_t &operator*=(fix16_t rhs)
+    {
+        return *this = *this * rhs;
+    }
+
+    fix16_t &operator/=(fix16_t rhs)
+    {
+        return *this = *this / rhs;
+    }
+
+    constexpr bool operator==(fix16_t rhs) const { return raw == rhs.raw; }
+    constexpr bool operator!=(fix16_t rhs) const { return raw != rhs.raw; }
+    constexpr bool operator<(fix16_t rhs) const { return raw < rhs.raw; }
+    constexpr bool operator>(fix16_t rhs) const { return raw > rhs.raw; }
+    constexpr bool operator<=(fix16_t rhs) const { return raw <= rhs.raw; }
+    constexpr bool operator>=(fix16_t rhs) const { return raw >= rhs.raw; }
+};
+
+// 2.30, sines, cosines and other values within -2 to 2
+struct fix30_t {
+    int32_t raw;
+
+    static constexpr int FRAC_BITS = 30;
+    static constexpr int32_t ONE = 1 << FRAC_BITS;
+
+    constexpr fix30_t() : raw(0) {}
+
+    // Rounded to nearest, within the 24 bits of the float
+    constexpr explicit fix30_t(float n)
+        : raw(int32_t(n * float(ONE) + (n >= 0.0f ? 0.5f : -0.5f))) {}
+
+    static constexpr fix30_t from_raw(int32_t raw)
+    {
+        fix30_t result;
+        result.raw = raw;
+        return result;
+    }
+
+    constexpr float to_float() const
+    {
+        return float(raw) * (1.0f / float(ONE));
+    }
+
+    // Rounded to nearest
+    constexpr operator fix16_t() const
+    {
+        return fix16_t::from_raw((raw + (1 << 13)) >> 14);
+    }
+
+    constexpr fix30_t operator-() const
+    {
+        return from_raw(-raw);
+    }
+
+    constexpr fix30_t operator*(fix30_t rhs) const
+    {
+        return from_raw(int32_t((int64_t(raw) * rhs.raw +
+                (ONE >> 1)) >> FRAC_BITS));
+    }
+};
+
+// Full 30 bits of the unit value, rounded to 16.16 once
+constexpr fix16_t operator*(fix16_t lhs, fix30_t rhs)
+{
+    return fix16_t::from_raw(int32_t((int64_t(lhs.raw) * rhs.raw +
+            (fix30_t::ONE >> 1)) >> fix30_t::FRAC_BITS));
+}
+
+constexpr fix16_t operator*(fix30_t lhs, fix16_t rhs)
+{
+    return rhs * lhs;
+}
+
+// Floor of the square root, a bit at a time
+static constexpr uint32_t fix_isqrt64(uint64_t n)
+{
+    uint64_t root = 0;
+    uint64_t bit = uint64_t(1) << 62;
+
+    while (bit > n)
+        bit >>= 2;
+
+    for (; bit; bit >>= 2) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+
+    return uint32_t(root);
+}
+
+// 0 for negative n
+static _always_inline fix16_t fix_sqrt(fix16_t n)
+{
+    return n.raw > 0 ? fix16_t::from_raw(int32_t(
+            fix_isqrt64(uint64_t(n.raw) << fix16_t::FRAC_BITS))) :
+            fix16_t();
+}
+
+// sin(x * pi / 2) for x within 0 to 1, from a minimax polynomial
+// within 2^-28, the whole of sincos is within about 2^-27
+static _always_inline int32_t fix_sin_quarter(int32_t x)
+{
+    static constexpr int32_t c1 = 1686629674;
+    static constexpr int32_t c3 = -693597877;
+    static constexpr int32_t c5 = 85564856;
+    static constexpr int32_t c7 = -5016768;
+    static constexpr int32_t c9 = 161943;
+
+    int64_t x2 = (int64_t(x) * x) >> 30;
+    int64_t p = c9;
+    p = ((p * x2) >> 30) + c7;
+    p = ((p * x2) >> 30) + c5;
+    p = ((p * x2) >> 30) + c3;
+    p = ((p * x2) >> 30) + c1;
+    return int32_t((p * x) >> 30);
+}
+
+// Angle in radians, the whole 16.16 range reduces exactly
+static _always_inline void fix_sincos(fix16_t angle, fix30_t *s, fix30_t *c)
+{
+    // 2 / pi in 0.64, split in halves, the products are quarter turns
+    // with 48 fraction bits. The low half keeps large angles exact
+    static constexpr int64_t two_over_pi_hi = 2734261102;
+    static constexpr int64_t two_over_pi_lo = 1313084713;
+
+    int64_t turns = int64_t(angle.raw) * two_over_pi_hi +
+            ((int64_t(angle.raw) * two_over_pi_lo) >> 32);
+    unsigned quadrant = unsigned(turns >> 48) & 3;
+    int32_t x = int32_t((turns >> 18) & (fix30_t::ONE - 1));
+
+    int32_t sq = fix_sin_quarter(x);
+    int32_t cq = fix_sin_quarter(fix30_t::ONE - x);
+
+    switch (quadrant) {
+    case 0: *s = fix30_t::from_raw(sq); *c = fix30_t::from_raw(cq); break;
+    case 1: *s = fix30_t::from_raw(cq); *c = fix30_t::from_raw(-sq); break;
+    case 2: *s = fix30_t::from_raw(-sq); *c = fix30_t::from_raw(-cq); break;
+    default: *s = fix30_t::from_raw(-cq); *c = fix30_t::from_raw(sq); break;
+    }
+}
@@ -1,13 +1,10 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 #include "string.h"
 #include "assert.h"
-
-#ifdef __GNUC__
-#define _target_clones_sse_avx_avx512 \
-    __attribute__((__target_clones__("default,avx,avx512f")))
-#endif
+#include "math/fastmath.h"
 
 float trunc(float f);
 
@@ -24,7 +21,30 @@ static constexpr float const sin_coeffs[] = {
 };
 
 
-// sin approximation to 5 ulp with Chebyshev polynomials
+enum sincos_accuracy_t {
+    // A shorter reduction and cos polynomial. Within about 2.3 ulp of
+    // results over 0.001, and 1.4e-7 absolute, below 12868. Closer to
+    // the zeros only the absolute bound holds
+    SINCOS_FAST,
+
+    // Within about 1.5 ulp below 100, 2.2 ulp below 1000, and 2.4 ulp
+    // below 12868, near the zeros too
+    SINCOS_PRECISE
+};
+
+// Angles are reduced to a quadrant with pi / 2 in parts, exactly below
+// 8192 quadrants (12868). The error then grows to 1e-6 absolute at
+// SINCOS_MAX_ANGLE, past it the results are NaN, like infinity
+static constexpr float SINCOS_MAX_ANGLE = 102943.7f;
+
+// sin and cos of count angles, four at a time. Either output may
+// be nullptr, the arrays need no particular alignment
+void sincosf_n(float const *angles, float *sines, float *cosines,
+        size_t count, sincos_accuracy_t accuracy = SINCOS_PRECISE);
+
+// sin approximation with Chebyshev polynomials, reduced like
+// SINCOS_FAST. Within about 5.1 ulp of results over 0.001, and
+// 3.1e-7 absolute, below 12868
 float sinf(float x);
 
 // https://en.wikipedia.org/wiki/Fast_inverse_square_root
@@ -72,34 +92,11 @@ static inline void sincos(double a,
     );
     *c = a;
 }
-
-static inline float sqrtf(float n)
-{
-    float result;
-#if defined(__x86_64__s)
-    __asm__("sqrtss %[src],%[dst]" 
-        : [dst] "=x" (result) 
-        : [src] "x" (n)
-    );
 #else
-    result = n;
-    __asm__("fsqrt\n\t" 
-        : [dst] "+t" (result)
-    );
-#endif
-    return result;
-}
-
-static inline float rsqrtf(float n)
+// No instruction for it, one lane of the array kernel
+static inline void sincosf(
+    float a, float * __restrict s, float * __restrict c)
 {
-    float result;
-    __asm__("rsqrtss %[src],%[dst]" 
-        : [dst] "=x" (result) 
-        : [src] "x" (n)
-    );
-    return result;
+    sincosf_n(&a, s, c, 1);
 }
-
-#else
-#error Do not know how to sincos on this CPU yet
 #endif
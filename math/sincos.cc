@@ -1,77 +1,212 @@
-/*-
- * ====================================================
- * Copyright (C) 1993 by Sun Microsystems, Inc. All rights reserved.
- *
- * Developed at SunPro, a Sun Microsystems, Inc. business.
- * Permission to use, copy, modify, and distribute this
- * software is freely granted, provided that this notice
- * is preserved.
- * ====================================================
- * 
- * s_sin.c and s_cos.c merged by Steven G. Kargl.  Descriptions of the
- * algorithms are contained in the original files.
- */
-
-#include "math.h"
-#define INLINE_REM_PIO2
-#include "math_private.h"
-//#include "e_rem_pio2.c"
-#include "kernel_sincos.h"
-
-#include "math.h"
-
-void
-sincosf(float angle, float *sn, float *cs)
+#include "math/math.h"
+#include "compiler.h"
+#include "dispatch.h"
+
+// Lowers to SSE on x86_64, NEON on aarch64, and
+// to scalar code where there is no vector unit
+typedef float v4sf _vector_size(16);
+typedef int32_t v4si _vector_size(16);
+typedef uint32_t v4su _vector_size(16);
+
+// Any alignment, the caller's arrays are plain floats
+typedef v4sf v4sf_u _aligned(4) __attribute__((__may_alias__));
+
+static constexpr float two_over_pi = 0.636619772f;
+
+// pi / 2 in parts of at most 11 significant bits, and a last full
+// float. Products with a quadrant number below 8192 are exact
+static constexpr float pio2_1 = 1.5703125f;
+static constexpr float pio2_2 = 4.8375129699707031e-4f;
+static constexpr float pio2_3 = 7.5495336204767227e-8f;
+static constexpr float pio2_4 = 2.5633440682570896e-12f;
+
+// The fast reduction stops after three parts
+static constexpr float pio2_3_last = 7.5497901264043321e-8f;
+
+static constexpr float sincos_max_quadrant = 65536.0f;
+
+// The part of the angle within pi / 4 of its quadrant,
+// NaN where the angle is out of range
+template<bool precise>
+static _always_inline v4sf sincos_reduce(v4sf x, v4si *quadrant)
+{
+    v4sf v = x * two_over_pi;
+
+    // False for NaN too
+    v4si in_range = (v < sincos_max_quadrant) & (v > -sincos_max_quadrant);
+
+    // Keep the conversion defined in every lane
+    v = (v4sf)((v4si)v & in_range);
+
+    v4su sign = (v4su)v & 0x80000000U;
+    v4sf half = (v4sf)(sign | (v4su)(v4sf{} + 0.5f));
+    v4si n = __builtin_convertvector(v + half, v4si);
+    v4sf nf = __builtin_convertvector(n, v4sf);
+
+    v4sf r = (x - nf * pio2_1) - nf * pio2_2;
+
+    if (precise)
+        r = (r - nf * pio2_3) - nf * pio2_4;
+    else
+        r = r - nf * pio2_3_last;
+
+    *quadrant = n;
+
+    return (v4sf)(((v4si)r & in_range) |
+            ((v4si)(v4sf{} + __builtin_nanf("")) & ~in_range));
+}
+
+// sin over -pi to pi from sin_coeffs, exactly zero at both ends
+static _always_inline v4sf sin_chebyshev(v4sf x)
+{
+    static constexpr float pi_major = 3.1415927f;
+    static constexpr float pi_minor = -0.00000008742278f;
+
+    v4sf x2 = x * x;
+    v4sf p11 = v4sf{} + sin_coeffs[5];
+    v4sf p9  = p11*x2 + sin_coeffs[4];
+    v4sf p7  = p9*x2  + sin_coeffs[3];
+    v4sf p5  = p7*x2  + sin_coeffs[2];
+    v4sf p3  = p5*x2  + sin_coeffs[1];
+    v4sf p1  = p3*x2  + sin_coeffs[0];
+    return (x - pi_major - pi_minor) *
+            (x + pi_major + pi_minor) * p1 * x;
+}
+
+// sin of the angle a quarter turn ahead of the reduced angle.
+// Odd quadrants swap sin and cos, then the sign
+// flips in the second half turn
+static _always_inline v4sf sincos_quadrant(v4si quadrant,
+        v4sf sr, v4sf cr, uint32_t ahead)
+{
+    v4su q = (v4su)quadrant + ahead;
+    v4su swap = -(q & 1);
+
+    return (v4sf)((((v4su)sr & ~swap) | ((v4su)cr & swap)) ^
+            ((q & 2) << 30));
+}
+
+template<bool precise>
+static _always_inline void sincos_lanes(v4sf x, v4sf *s, v4sf *c)
 {
-	double y[2];
-	int32_t n, ix;
-
-	/* High word of x. */
-	GET_HIGH_WORD(ix, x);
-
-	/* |x| ~< pi/4 */
-	ix &= 0x7fffffff;
-	if (ix <= 0x3fe921fb) {
-		if (ix < 0x3e400000) {		/* |x| < 2**-27 */
-			if ((int)x == 0) {	/* Generate inexact. */
-				*sn = x;
-				*cs = 1;
-				return;
-			}
-		}
-		__kernel_sincos(x, 0, 0, sn, cs);
-		return;
-	}
-
-	/* If x = Inf or NaN, then sin(x) = NaN and cos(x) = NaN. */
-	if (ix >= 0x7ff00000) {
-		*sn = x - x;
-		*cs = x - x;
-		return;
-	}
-
-	/* Argument reduction. */
-	n = __ieee754_rem_pio2(x, y);
-
-	switch(n & 3) {
-	case 0:
-		__kernel_sincos(y[0], y[1], 1, sn, cs);
-		break;
-	case 1:
-		__kernel_sincos(y[0], y[1], 1, cs, sn);
-		*cs = -*cs;
-		break;
-	case 2:
-		__kernel_sincos(y[0], y[1], 1, sn, cs);
-		*sn = -*sn;
-		*cs = -*cs;
-		break;
-	default:
-		__kernel_sincos(y[0], y[1], 1, cs, sn);
-		*sn = -*sn;
-	}
+    v4si quadrant;
+    v4sf r = sincos_reduce<precise>(x, &quadrant);
+    v4sf z = r * r;
+
+    // Minimax over -pi / 4 to pi / 4, sin as in Cephes sinf.
+    // The fast cos drops a term, for about 0.8 ulp more
+    v4sf sr = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z -
+            1.6666654611e-1f) * z * r + r;
+    v4sf cr;
+
+    if (precise) {
+        cr = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z +
+                4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+    } else {
+        cr = (-1.364809650e-3f * z + 4.166104230e-2f) * z * z -
+                0.5f * z + 1.0f;
+    }
+
+    *s = sincos_quadrant(quadrant, sr, cr, 0);
+    *c = sincos_quadrant(quadrant, sr, cr, 1);
 }
 
-#if (LDBL_MANT_DIG == 53)
-__weak_reference(sincos, sincosl);
+template<bool precise>
+static _always_inline void sincos_array(float const *angles,
+        float *sines, float *cosines, size_t count)
+{
+    size_t i = 0;
+    v4sf s, c;
+
+    for ( ; i + 4 <= count; i += 4) {
+        sincos_lanes<precise>(*(v4sf_u const*)(angles + i), &s, &c);
+
+        if (sines)
+            *(v4sf_u*)(sines + i) = s;
+
+        if (cosines)
+            *(v4sf_u*)(cosines + i) = c;
+    }
+
+    if (i == count)
+        return;
+
+    // The last few through one zero padded vector
+    v4sf x = {};
+
+    for (size_t k = 0; i + k < count; ++k)
+        x[k] = angles[i + k];
+
+    sincos_lanes<precise>(x, &s, &c);
+
+    for (size_t k = 0; i + k < count; ++k) {
+        if (sines)
+            sines[i + k] = s[k];
+
+        if (cosines)
+            cosines[i + k] = c[k];
+    }
+}
+
+typedef void sincos_fn(float const *angles, float *sines, float *cosines,
+        size_t count, sincos_accuracy_t accuracy);
+
+// Built once per instruction set by the variants below
+static _always_inline void sincos_body(float const *angles,
+        float *sines, float *cosines, size_t count,
+        sincos_accuracy_t accuracy)
+{
+    if (accuracy == SINCOS_PRECISE)
+        sincos_array<true>(angles, sines, cosines, count);
+    else
+        sincos_array<false>(angles, sines, cosines, count);
+}
+
+static void sincos_base(float const *angles, float *sines, float *cosines,
+        size_t count, sincos_accuracy_t accuracy)
+{
+    sincos_body(angles, sines, cosines, count, accuracy);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// The polynomials fuse into multiply-adds, a little more accurate
+_target("avx2,fma")
+static void sincos_avx2(float const *angles, float *sines, float *cosines,
+        size_t count, sincos_accuracy_t accuracy)
+{
+    sincos_body(angles, sines, cosines, count, accuracy);
+}
+#endif
+
+static dispatch_variant_t<sincos_fn*> const sincos_variants[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "avx2", CPU_AVX2 | CPU_FMA, sincos_avx2 },
 #endif
+    { "base", 0, sincos_base }
+};
+
+static sincos_fn *sincos_kernel = sincos_base;
+
+void sincos_dispatch(uint32_t features)
+{
+    dispatch_bind("sincosf_n", &sincos_kernel, sincos_variants, features);
+}
+
+void sincosf_n(float const *angles, float *sines, float *cosines,
+        size_t count, sincos_accuracy_t accuracy)
+{
+    sincos_kernel(angles, sines, cosines, count, accuracy);
+}
+
+float sinf(float x)
+{
+    v4si quadrant;
+    v4sf r = sincos_reduce<false>(v4sf{} + x, &quadrant);
+
+    // A quarter turn more in odd quadrants stays within 3 pi / 4,
+    // where sin_coeffs holds, and the second half turn flips the sign
+    v4su q = (v4su)quadrant;
+    v4sf y = r + (v4sf)(-(q & 1) & (v4su)(v4sf{} + 1.5707964f));
+
+    return ((v4sf)((v4su)sin_chebyshev(y) ^ ((q & 2) << 30)))[0];
+}
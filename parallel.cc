@@ -0,0 +1,315 @@
+#include "parallel.h"
+#include "arch/smp.h"
+#include "assert.h"
+
+static unsigned parallel_count = 1;
+
+// Spins before a CPU with nothing to do goes to sleep
+static constexpr unsigned PARALLEL_SPIN_LIMIT = 1024;
+
+static_assert((PARALLEL_DEQUE_SIZE & (PARALLEL_DEQUE_SIZE - 1)) == 0,
+    "Deque size must be a power of two");
+
+// Chase-Lev deque, with the memory orders of Le et al., "Correct and
+// Efficient Work-Stealing for Weak Memory Models". Fixed size, so
+// secondaries never allocate. Each on its own cache lines
+struct _aligned(64) parallel_deque_t {
+    intptr_t top;
+    intptr_t bottom _aligned(64);
+    parallel_task_t *tasks[PARALLEL_DEQUE_SIZE];
+};
+
+static parallel_deque_t parallel_deques[SMP_MAX_CPUS];
+
+// CPUs that may be asleep in arch_smp_wait
+static uint32_t parallel_idle;
+
+// Task posted to each CPU by parallel_post, taken before any stealing
+static parallel_task_t *parallel_posted[SMP_MAX_CPUS];
+
+static bool deque_push(parallel_deque_t *deque, parallel_task_t *task)
+{
+    intptr_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    intptr_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+    if (b - t >= intptr_t(PARALLEL_DEQUE_SIZE))
+        return false;
+
+    __atomic_store_n(&deque->tasks[b & (PARALLEL_DEQUE_SIZE - 1)],
+            task, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+// Owner only, newest task first
+static parallel_task_t *deque_pop(parallel_deque_t *deque)
+{
+    intptr_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    intptr_t t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        // Empty
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+        return nullptr;
+    }
+
+    parallel_task_t *task = __atomic_load_n(
+            &deque->tasks[b & (PARALLEL_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+
+    if (t == b) {
+        // Last one, race the thieves for it
+        if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            task = nullptr;
+
+        __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+
+    return task;
+}
+
+// Any CPU, oldest task first
+static parallel_task_t *deque_steal(parallel_deque_t *deque)
+{
+    intptr_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    intptr_t b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+    if (t >= b)
+        return nullptr;
+
+    parallel_task_t *task = __atomic_load_n(
+            &deque->tasks[t & (PARALLEL_DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+
+    // Lost to the owner or another thief
+    if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false,
+            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return nullptr;
+
+    return task;
+}
+
+// Try every other CPU once, starting from a different one each time
+static parallel_task_t *parallel_steal(unsigned self, uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    unsigned start = (*seed >> 16) % parallel_count;
+
+    for (unsigned i = 0; i < parallel_count; ++i) {
+        unsigned victim = (start + i) % parallel_count;
+
+        if (victim == self)
+            continue;
+
+        if (parallel_task_t *task = deque_steal(parallel_deques + victim))
+            return task;
+    }
+
+    return nullptr;
+}
+
+// A task posted to self, or else one stolen from another CPU
+static parallel_task_t *parallel_find_work(unsigned self, uint32_t *seed)
+{
+    if (__atomic_load_n(&parallel_posted[self], __ATOMIC_RELAXED)) {
+        return __atomic_exchange_n(&parallel_posted[self], nullptr,
+                __ATOMIC_ACQUIRE);
+    }
+
+    return parallel_steal(self, seed);
+}
+
+static void parallel_run_stolen(parallel_task_t *task)
+{
+    task->run(task);
+
+    __atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+
+    // The CPU joining it may be asleep
+    arch_smp_wake();
+}
+
+// Sleep, unless work was spawned or posted since the caller last looked
+static void parallel_sleep(unsigned self)
+{
+    __atomic_add_fetch(&parallel_idle, 1, __ATOMIC_SEQ_CST);
+
+    bool empty = !__atomic_load_n(&parallel_posted[self], __ATOMIC_SEQ_CST);
+
+    for (unsigned i = 0; empty && i < parallel_count; ++i) {
+        parallel_deque_t *deque = parallel_deques + i;
+
+        empty = __atomic_load_n(&deque->top, __ATOMIC_SEQ_CST) >=
+                __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST);
+    }
+
+    if (empty)
+        arch_smp_wait();
+
+    __atomic_sub_fetch(&parallel_idle, 1, __ATOMIC_SEQ_CST);
+}
+
+static void parallel_secondary(smp_cpu_t *cpu)
+{
+    uint32_t seed = cpu->index;
+    unsigned spins = 0;
+
+    for (;;) {
+        if (parallel_task_t *task = parallel_find_work(cpu->index, &seed)) {
+            parallel_run_stolen(task);
+            spins = 0;
+        } else if (++spins < PARALLEL_SPIN_LIMIT) {
+            arch_smp_relax();
+        } else {
+            parallel_sleep(cpu->index);
+        }
+    }
+}
+
+unsigned parallel_init()
+{
+    if (parallel_count == 1)
+        parallel_count = arch_smp_start(parallel_secondary);
+
+    return parallel_count;
+}
+
+unsigned parallel_cpu_count()
+{
+    return parallel_count;
+}
+
+unsigned parallel_cpu_index()
+{
+    return parallel_count > 1 ? arch_smp_cpu_index() : 0;
+}
+
+bool parallel_spawn(parallel_task_t *task)
+{
+    task->done = 0;
+
+    if (parallel_count == 1 ||
+            !deque_push(parallel_deques + arch_smp_cpu_index(), task))
+        return false;
+
+    // Pairs with the fence in parallel_sleep, either the sleeper
+    // sees the task, or this sees the sleeper
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&parallel_idle, __ATOMIC_RELAXED))
+        arch_smp_wake();
+
+    return true;
+}
+
+void parallel_join(parallel_task_t *task)
+{
+    unsigned self = arch_smp_cpu_index();
+    parallel_task_t *newest = deque_pop(parallel_deques + self);
+
+    if (newest) {
+        // Everything spawned after it was already joined, and thieves
+        // take the oldest first, so if it was stolen the deque is empty
+        assert(newest == task);
+        task->run(task);
+        return;
+    }
+
+    // Stolen, help with other work until it's done
+    parallel_wait(task);
+}
+
+bool parallel_post(unsigned cpu, parallel_task_t *task)
+{
+    task->done = 0;
+
+    if (cpu >= parallel_count || cpu == arch_smp_cpu_index())
+        return false;
+
+    parallel_task_t *expect = nullptr;
+
+    if (!__atomic_compare_exchange_n(&parallel_posted[cpu], &expect, task,
+            false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return false;
+
+    // It may be asleep, or waiting in parallel_wait, which isn't
+    // counted in parallel_idle
+    arch_smp_wake();
+
+    return true;
+}
+
+void parallel_wait(parallel_task_t *task)
+{
+    unsigned self = arch_smp_cpu_index();
+    uint32_t seed = self;
+    unsigned spins = 0;
+
+    while (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+        if (parallel_task_t *other = parallel_find_work(self, &seed)) {
+            parallel_run_stolen(other);
+            spins = 0;
+        } else if (++spins < PARALLEL_SPIN_LIMIT) {
+            arch_smp_relax();
+        } else {
+            arch_smp_wait();
+        }
+    }
+}
+
+struct parallel_for_task_t {
+    parallel_task_t task;
+    parallel_for_fn fn;
+    void *arg;
+    size_t begin;
+    size_t end;
+    size_t grain;
+};
+
+static void parallel_for_range(parallel_for_fn fn, void *arg,
+    size_t begin, size_t end, size_t grain);
+
+static void parallel_for_run(parallel_task_t *task)
+{
+    parallel_for_task_t *range = (parallel_for_task_t*)task;
+
+    parallel_for_range(range->fn, range->arg,
+            range->begin, range->end, range->grain);
+}
+
+static void parallel_for_range(parallel_for_fn fn, void *arg,
+    size_t begin, size_t end, size_t grain)
+{
+    if (end - begin > grain) {
+        size_t mid = begin + (end - begin) / 2;
+
+        parallel_for_task_t upper;
+        upper.task.run = parallel_for_run;
+        upper.fn = fn;
+        upper.arg = arg;
+        upper.begin = mid;
+        upper.end = end;
+        upper.grain = grain;
+
+        if (parallel_spawn(&upper.task)) {
+            parallel_for_range(fn, arg, begin, mid, grain);
+            parallel_join(&upper.task);
+            return;
+        }
+    }
+
+    fn(arg, begin, end);
+}
+
+void parallel_for(size_t begin, size_t end, size_t grain,
+    parallel_for_fn fn, void *arg)
+{
+    if (begin >= end)
+        return;
+
+    parallel_for_range(fn, arg, begin, end, grain ? grain : 1);
+}
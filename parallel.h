@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Fork-join work stealing. Each CPU has a deque of spawned tasks, it
+// pushes and pops its own at the bottom, and idle CPUs steal the oldest
+// task from the top of another CPU's deque, see arch/smp.h
+
+// Start the secondary CPUs, call once after malloc_init.
+// Returns the number of CPUs, 1 where bring-up isn't supported
+unsigned parallel_init();
+
+unsigned parallel_cpu_count();
+
+// Index of the calling CPU, 0 on the boot CPU
+unsigned parallel_cpu_index();
+
+// Room for this many spawned tasks per CPU, spawning more runs them inline
+static constexpr size_t PARALLEL_DEQUE_SIZE = 256;
+
+struct parallel_task_t {
+    void (*run)(parallel_task_t *task);
+
+    // Set when run returned on another CPU
+    uint32_t done;
+};
+
+// Make task available to other CPUs. Returns false if the deque is full,
+// the caller should run the task itself instead. The task must stay valid
+// until parallel_join returns
+bool parallel_spawn(parallel_task_t *task);
+
+// Run task if no other CPU took it, otherwise steal other work until it
+// is done, then spin, then sleep. Only for tasks parallel_spawn accepted,
+// tasks spawned by one CPU must be joined in the opposite order
+void parallel_join(parallel_task_t *task);
+
+// Run task on CPU cpu, the next time it looks for work, rather than on
+// whichever CPU steals it. For work that must run alongside the caller.
+// Returns false if cpu is the caller's, out of range, or has a posted
+// task it hasn't taken yet. The task must stay valid until
+// parallel_wait returns
+bool parallel_post(unsigned cpu, parallel_task_t *task);
+
+// Until a posted or stolen task is done, helping with other work
+void parallel_wait(parallel_task_t *task);
+
+typedef void (*parallel_for_fn)(void *arg, size_t begin, size_t end);
+
+// Call fn on pieces of [begin, end), no larger than grain, split in half
+// recursively so idle CPUs steal large pieces. Returns when every piece
+// is done. Can be called from any CPU, including from inside fn
+void parallel_for(size_t begin, size_t end, size_t grain,
+    parallel_for_fn fn, void *arg);
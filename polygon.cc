@@ -1,35 +1,171 @@
 #include "polygon.h"
+#include "tile.h"
+#include "halfspace.h"
+#include "depth.h"
+#include "texture.h"
+#include "shade.h"
+#include "dirty.h"
+#include "parallel.h"
+#include "arch/smp.h"
+#include "malloc.h"
+#include "dispatch.h"
+#include "likely.h"
 #include <stdint.h>
 
-struct render_surface_t {
-    uint32_t *pixels;
-    uint32_t pitch;
-    uint32_t width;
-    uint32_t height;
-};
-
 render_surface_t render_surface;
 
-static constexpr size_t MAX_VRES = 2160;
-static uint16_t scratch16[MAX_VRES];
+// Left and right edge columns, one slice per CPU so tiles can be drawn
+// in parallel. Each slice has room for every row of the render surface
+static uint32_t *edge_buffers;
+static size_t edge_slice_size;
+static unsigned edge_cpus;
+
+// Rows per band when the edge buffers couldn't be allocated,
+// or the CPU isn't covered by them
+static constexpr int EDGE_BAND_ROWS = 64;
+
+static uint32_t edge_band_buffers[SMP_MAX_CPUS][EDGE_BAND_ROWS * 2];
+
+static raster_engine_t raster_engine = RASTER_SCANLINE;
+
+static bool overdraw_enabled;
+
+static void edge_init(uint32_t height)
+{
+    free(edge_buffers);
+
+    edge_buffers = nullptr;
+    edge_slice_size = 0;
+    edge_cpus = 0;
 
-void set_render_surface(uint32_t *pixels, uint32_t pitch, 
+    // Whole cache lines per slice, so CPUs don't share them
+    size_t slice = (size_t(height) * 2 + 15) & -size_t(16);
+    unsigned cpus = parallel_cpu_count();
+
+    if (unlikely(!slice))
+        return;
+
+    uint32_t *buffers = (uint32_t*)malloc_aligned(
+            slice * cpus * sizeof(uint32_t), 64);
+
+    if (unlikely(!buffers))
+        return;
+
+    edge_buffers = buffers;
+    edge_slice_size = slice;
+    edge_cpus = cpus;
+}
+
+void set_render_surface(uint32_t *pixels, uint32_t pitch,
     uint32_t width, uint32_t height)
 {
     render_surface.pixels = pixels;
     render_surface.pitch = pitch;
     render_surface.width = width;
     render_surface.height = height;
+
+    // Binning is silently disabled if the bins can't be allocated
+    tile_init(width, height);
+
+    // Depth testing stays off if the depth buffer can't be allocated
+    depth_init(width, height);
+
+    // Clears and presents cover everything if the tiles can't be allocated
+    dirty_init(width, height);
+
+    // Tall triangles are drawn in bands if the edges can't be allocated
+    edge_init(height);
+}
+
+void set_render_pixels(uint32_t *pixels)
+{
+    render_surface.pixels = pixels;
+}
+
+void clear_render_surface(uint32_t color)
+{
+    dirty_clear(color);
+}
+
+void set_raster_engine(raster_engine_t engine)
+{
+    raster_engine = engine;
+}
+
+raster_engine_t get_raster_engine()
+{
+    return raster_engine;
+}
+
+void set_overdraw_mode(bool enable)
+{
+    overdraw_enabled = enable;
+}
+
+bool overdraw_mode()
+{
+    return overdraw_enabled;
+}
+
+// Vertices are snapped to 28.4 fixed point, and pixel centers are at
+// +0.5, the same as the half-space engine, so both cover the same pixels
+static constexpr int SCAN_SUBPIXEL_BITS = 4;
+static constexpr int64_t SCAN_ONE = 1 << SCAN_SUBPIXEL_BITS;
+static constexpr int64_t SCAN_HALF = SCAN_ONE >> 1;
+
+// Clamped to this, so products of two coordinates fit in 64 bits
+static constexpr float SCAN_MAX_COORD = 67108864.0f;
+
+struct scan_vertex_t {
+    int64_t x;
+    int64_t y;
+};
+
+static _always_inline int64_t scan_fixed(float n)
+{
+    n = n > SCAN_MAX_COORD ? SCAN_MAX_COORD : n;
+    n = n < -SCAN_MAX_COORD ? -SCAN_MAX_COORD : n;
+    n *= float(SCAN_ONE);
+    return int64_t(n + (n >= 0.0f ? 0.5f : -0.5f));
+}
+
+// Rounded to nearest, ties up. 16.16 is always in range
+static _always_inline int64_t scan_fixed(fix16_t n)
+{
+    static constexpr int shift = fix16_t::FRAC_BITS - SCAN_SUBPIXEL_BITS;
+
+    return (int64_t(n.raw) + (1 << (shift - 1))) >> shift;
+}
+
+// Division rounding toward negative infinity, d must be positive
+static _always_inline int64_t scan_floor_div(int64_t n, int64_t d)
+{
+    int64_t q = n / d;
+    return q - (q * d > n);
+}
+
+// First row with its pixel center at or below 28.4 y
+static _always_inline int64_t scan_row(int64_t y)
+{
+    return (y - SCAN_HALF + SCAN_ONE - 1) >> SCAN_SUBPIXEL_BITS;
 }
 
+// Rows with pixel centers in [top, bottom) of the edge get the column of
+// the first pixel center at or right of the edge. That pixel starts the
+// span on a left edge, and is the first one past it on a right edge, so
+// centers exactly on a left edge are inside, and on a right edge outside.
+// Flat edges cover no rows, so centers exactly on a top edge are inside,
+// and on a bottom edge outside. That is the top-left fill rule, triangles
+// sharing an edge never both draw a pixel, and never both skip one
 static void draw_tri_scan_edge(
-    uint16_t *left_output, uint16_t *right_output,
-    vec4 const *v0, vec4 const *v1, int miny)
+    uint32_t *left_output, uint32_t *right_output,
+    scan_vertex_t const *v0, scan_vertex_t const *v1,
+    render_rect_t const& clip)
 {
     // Counterclockwise triangles go down on the left, and up on the right
-    uint16_t *output = v0->y < v1->y ? left_output : right_output;
-    vec4 const *vs;
-    vec4 const *ve;
+    uint32_t *output;
+    scan_vertex_t const *vs;
+    scan_vertex_t const *ve;
 
     if (v0->y < v1->y) {
         // Left side
@@ -42,68 +178,753 @@ static void draw_tri_scan_edge(
         vs = v1;
         ve = v0;
     }
-    
-    int sy = (int)vs->y; 
-    int ey = (int)ve->y;
-    if (sy < ey) {
-        int offset = (int)vs->y - miny;
-        output += offset;
-        
-        int fpsx = (int)(vs->x * 65536.0f);
-        int fpex = (int)(ve->x * 65536.0f);
-        int fpdx = fpex - fpsx;
-        int dy = ey - sy;
-        int step = fpdx / dy;
-        // Add rounding offset outside loop, so loop can just truncate
-        int x = fpsx + 0x8000;
-        for (int i = sy; i < ey; ++i, x += step)
-            *output++ = x >> 16;
+
+    int64_t sy = scan_row(vs->y);
+    int64_t ey = scan_row(ve->y);
+
+    // Skip the rows outside the clip rectangle
+    sy = sy > clip.y0 ? sy : clip.y0;
+    ey = ey < clip.y1 ? ey : clip.y1;
+
+    if (sy >= ey)
+        return;
+
+    int64_t dx = ve->x - vs->x;
+    int64_t dy = ve->y - vs->y;
+
+    // The column is ceil(num / den), at the center of row sy, and num
+    // steps by SCAN_ONE * dx each row. Both are kept as a quotient and a
+    // remainder in [0, den), so there is no error to accumulate
+    int64_t den = SCAN_ONE * dy;
+    int64_t num = dy * (vs->x - SCAN_HALF) +
+            dx * (sy * SCAN_ONE + SCAN_HALF - vs->y);
+
+    int64_t x = scan_floor_div(num, den);
+    int64_t rem = num - x * den;
+
+    int64_t step = SCAN_ONE * dx;
+    int64_t xstep = scan_floor_div(step, den);
+    int64_t rstep = step - xstep * den;
+
+    output += sy - clip.y0;
+
+    for (int64_t y = sy; y < ey; ++y) {
+        int64_t px = x + (rem != 0);
+
+        // Clamp to the clip rectangle, spans that end up
+        // entirely outside collapse to nothing
+        px = px < clip.x0 ? clip.x0 : px;
+        px = px > clip.x1 ? clip.x1 : px;
+
+        *output++ = uint32_t(px);
+
+        x += xstep;
+        rem += rstep;
+
+        if (rem >= den) {
+            rem -= den;
+            ++x;
+        }
+    }
+}
+
+// Lower zmin of the coarse blocks touched by a span that wrote pixels,
+// and mark its pixels covered in each, see depth_hz_cover
+static void fill_span_hz(int y, int st, int en, float zy, bool written,
+    depth_plane_t const *depth)
+{
+    // The plane is linear, so nothing written is nearer than
+    // the nearer end of the span
+    float zst = zy + depth->dzdx * (float(st) + 0.5f);
+    float zen = zy + depth->dzdx * (float(en - 1) + 0.5f);
+    float zmin = zst < zen ? zst : zen;
+
+    int row = y & (DEPTH_HZ_SIZE - 1);
+
+    for (int bx = st >> DEPTH_HZ_SHIFT; bx <= (en - 1) >> DEPTH_HZ_SHIFT;
+            ++bx) {
+        depth_hz_t *hz = depth_hz_at(bx << DEPTH_HZ_SHIFT, y);
+
+        if (written && hz->zmin > zmin)
+            hz->zmin = zmin;
+
+        int x0 = bx << DEPTH_HZ_SHIFT;
+        int c0 = st > x0 ? st : x0;
+        int c1 = en < x0 + int(DEPTH_HZ_SIZE) ? en : x0 + int(DEPTH_HZ_SIZE);
+
+        // Farther end of the part of the span inside the block
+        float z0 = zy + depth->dzdx * (float(c0) + 0.5f);
+        float z1 = zy + depth->dzdx * (float(c1 - 1) + 0.5f);
+        float zmax = z0 > z1 ? z0 : z1;
+
+        depth_hz_cover(hz, depth_hz_row_mask(row, c0 - x0, c1 - x0), zmax);
+    }
+}
+
+// Everything a span can interpolate, each variant
+// only reads the parts it uses
+struct span_setup_t {
+    uint32_t color;
+
+    // Null when depth testing is off
+    depth_plane_t const *depth;
+
+    shade_plane_t const *shade;
+
+    texture_plane_t const *tex;
+    texture_t const *texture;
+};
+
+// Span sources produce the color of each pixel of a span in turn.
+// begin is called once per span, chunk before each run of pixels,
+// and returns its length, then store and step for each pixel, and
+// finish at the end of the span
+
+// The same color everywhere
+struct span_flat_t {
+    uint32_t value;
+
+    _always_inline void begin(span_setup_t const *s, int, int, int)
+    {
+        value = s->color;
+    }
+
+    _always_inline int chunk(int remaining)
+    {
+        return remaining;
+    }
+
+    _always_inline void store(uint32_t *pixel) const
+    {
+        *pixel = value;
+    }
+
+    _always_inline void step()
+    {
+    }
+
+    _always_inline void finish()
+    {
+    }
+};
+
+// Gouraud, each channel in 16.16 fixed point, stepped from the first
+// pixel to the last. Pixel centers at the ends can be just outside the
+// triangle, so the ends are clamped, and everything between stays in range
+struct span_shade_t {
+    int32_t r, g, b;
+    int32_t dr, dg, db;
+
+    static _always_inline int32_t fixed(texture_gradient_t const& grad,
+        float fx, float fy)
+    {
+        float n = grad.a0 + grad.dady * fy + grad.dadx * fx;
+        n = n > 0.0f ? n : 0.0f;
+        n = n < 255.0f ? n : 255.0f;
+        return int32_t(n * 65536.0f) + 0x8000;
+    }
+
+    _always_inline void begin(span_setup_t const *s, int y, int st, int en)
+    {
+        shade_plane_t const *shade = s->shade;
+
+        float fy = float(y) + 0.5f;
+        float fx0 = float(st) + 0.5f;
+        float fx1 = float(en - 1) + 0.5f;
+        int32_t steps = en - st > 1 ? en - st - 1 : 1;
+
+        r = fixed(shade->r, fx0, fy);
+        g = fixed(shade->g, fx0, fy);
+        b = fixed(shade->b, fx0, fy);
+        dr = (fixed(shade->r, fx1, fy) - r) / steps;
+        dg = (fixed(shade->g, fx1, fy) - g) / steps;
+        db = (fixed(shade->b, fx1, fy) - b) / steps;
+    }
+
+    _always_inline int chunk(int remaining)
+    {
+        return remaining;
+    }
+
+    _always_inline void store(uint32_t *pixel) const
+    {
+        *pixel = uint32_t((r & 0xFF0000) | ((g >> 8) & 0xFF00) | (b >> 16));
+    }
+
+    _always_inline void step()
+    {
+        r += dr;
+        g += dg;
+        b += db;
+    }
+
+    _always_inline void finish()
+    {
+    }
+};
+
+// Perspective correct texture. u/w, v/w and 1/w are evaluated from their
+// planes at the first pixel, then stepped, and divided only at the ends
+// of each subspan, the texel coordinates are affine in between
+struct span_tex_t {
+    texture_plane_t const *tex;
+    texture_t const *texture;
+    int subspan;
+
+    float uw, vw, w;
+
+    // Texel coordinates in 16.16, at the start of the next subspan
+    uint32_t u, v;
+    uint32_t u1, v1;
+    int32_t du, dv;
+
+    _always_inline void begin(span_setup_t const *s, int y, int st, int)
+    {
+        tex = s->tex;
+        texture = s->texture;
+        subspan = 1 << texture_subspan_shift();
+
+        float fy = float(y) + 0.5f;
+        float fx = float(st) + 0.5f;
+
+        uw = tex->uw.a0 + tex->uw.dady * fy + tex->uw.dadx * fx;
+        vw = tex->vw.a0 + tex->vw.dady * fy + tex->vw.dadx * fx;
+        w = tex->w.a0 + tex->w.dady * fy + tex->w.dadx * fx;
+
+        float rw = 1.0f / w;
+        u1 = texture_fixed(uw * rw);
+        v1 = texture_fixed(vw * rw);
+    }
+
+    _always_inline int chunk(int remaining)
+    {
+        int count = remaining < subspan ? remaining : subspan;
+
+        u = u1;
+        v = v1;
+
+        // Perspective correct at the end of the subspan
+        uw += tex->uw.dadx * float(count);
+        vw += tex->vw.dadx * float(count);
+        w += tex->w.dadx * float(count);
+
+        float rw = 1.0f / w;
+        u1 = texture_fixed(uw * rw);
+        v1 = texture_fixed(vw * rw);
+
+        // Affine in between
+        du = int32_t(u1 - u) / count;
+        dv = int32_t(v1 - v) / count;
+
+        return count;
+    }
+
+    _always_inline void store(uint32_t *pixel) const
+    {
+        *pixel = texture_fetch(texture, u >> 16, v >> 16);
+    }
+
+    _always_inline void step()
+    {
+        u += du;
+        v += dv;
+    }
+
+    _always_inline void finish()
+    {
+    }
+};
+
+// Overdraw mode, adds one to the pixel instead of writing a color,
+// and counts the pixels that were already drawn
+struct span_overdraw_t {
+    uint64_t overdrawn;
+
+    _always_inline void begin(span_setup_t const *, int, int, int)
+    {
+        overdrawn = 0;
+    }
+
+    _always_inline int chunk(int remaining)
+    {
+        return remaining;
+    }
+
+    _always_inline void store(uint32_t *pixel)
+    {
+        overdrawn += *pixel != 0;
+        ++*pixel;
+    }
+
+    _always_inline void step()
+    {
+    }
+
+    _always_inline void finish()
+    {
+        depth_counters.pixels_overdrawn += overdrawn;
+    }
+};
+
+// Fill one span, depth tested when Depth, pixel centers are at +0.5.
+// Depth is evaluated from the plane at each pixel, rather than stepped,
+// so a span split across tiles gets exactly the same depths. Every
+// variant is its own instance, with no tests for the others inside
+template<typename Source, bool Depth>
+static void fill_span(uint32_t *scanline, int y, int st, int en,
+    span_setup_t const *s)
+{
+    float *depth_scanline = Depth ? depth_row(y) : nullptr;
+
+    float zy = Depth ? s->depth->z0 + s->depth->dzdy * (float(y) + 0.5f)
+            : 0.0f;
+    float dzdx = Depth ? s->depth->dzdx : 0.0f;
+
+    Source source;
+    source.begin(s, y, st, en);
+
+    uint64_t written = 0;
+
+    for (int x = st; x < en; ) {
+        int end = x + source.chunk(en - x);
+
+        for (; x < end; ++x, source.step()) {
+            if (Depth) {
+                float z = zy + dzdx * (float(x) + 0.5f);
+
+                if (!(z < depth_scanline[x]))
+                    continue;
+
+                depth_scanline[x] = z;
+            }
+
+            source.store(scanline + x);
+            ++written;
+        }
     }
+
+    source.finish();
+
+    depth_counters.pixels_written += written;
+    depth_counters.pixels_rejected += (en - st) - written;
+
+    // Pixels not written were already nearer, all of them are covered
+    if (Depth)
+        fill_span_hz(y, st, en, zy, written != 0, s->depth);
 }
 
+template<typename Source, bool Depth>
 static void fill_tri(
-    uint16_t const *left_output, uint16_t const *right_output, 
-    int miny, int maxy, uint32_t color)
+    uint32_t const *left_output, uint32_t const *right_output,
+    int miny, int maxy, span_setup_t const *s)
 {
-    uint32_t *scanline = (uint32_t*)((char*)render_surface.pixels + 
+    uint32_t *scanline = (uint32_t*)((char*)render_surface.pixels +
         (render_surface.pitch * miny));
-    
-    while (miny++ < maxy) {
+
+    // Columns covered by every row so far in the current coarse depth
+    // block row, starts empty when miny is partway through a block row
+    int cover_st = 1;
+    int cover_en = 0;
+
+    for (int y = miny; y < maxy; ++y) {
         size_t en = *right_output++;
         size_t st = *left_output++;
-        
-        while (st < en)
-            scanline[st++] = color;
-            
+
+        if (st < en)
+            fill_span<Source, Depth>(scanline, y, st, en, s);
+
         scanline = (uint32_t*)((char*)scanline + render_surface.pitch);
+
+        if (!Depth)
+            continue;
+
+        int row = y & (DEPTH_HZ_SIZE - 1);
+
+        if (row == 0) {
+            cover_st = int(st);
+            cover_en = int(en);
+        } else {
+            cover_st = cover_st > int(st) ? cover_st : int(st);
+            cover_en = cover_en < int(en) ? cover_en : int(en);
+        }
+
+        if (row == DEPTH_HZ_SIZE - 1 && cover_st < cover_en)
+            depth_hz_covered(s->depth, cover_st, cover_en, y);
     }
 }
 
-void draw_tri_ccw(vec4 const *v0, vec4 const *v1, vec4 const *v2, 
-    uint32_t color)
+// Index into fill_tri_variants, SPAN_DEPTH is added when depth testing
+enum span_variant_t : unsigned {
+    SPAN_FLAT = 0,
+    SPAN_DEPTH = 1,
+    SPAN_SHADE = 2,
+    SPAN_TEX = 4,
+    SPAN_OVERDRAW = 6
+};
+
+typedef void (*fill_tri_fn)(
+    uint32_t const *left_output, uint32_t const *right_output,
+    int miny, int maxy, span_setup_t const *s);
+
+static fill_tri_fn const fill_tri_base[] = {
+    fill_tri<span_flat_t, false>,
+    fill_tri<span_flat_t, true>,
+    fill_tri<span_shade_t, false>,
+    fill_tri<span_shade_t, true>,
+    fill_tri<span_tex_t, false>,
+    fill_tri<span_tex_t, true>,
+    fill_tri<span_overdraw_t, false>,
+    fill_tri<span_overdraw_t, true>
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+// The spans again with VEX encoding and 256 bit vectors. No FMA,
+// so every variant draws exactly the same pixels
+template<typename Source, bool Depth>
+_target("avx2") _flatten
+static void fill_tri_avx2(
+    uint32_t const *left_output, uint32_t const *right_output,
+    int miny, int maxy, span_setup_t const *s)
 {
-    float minyf, maxyf;
-    if (v0->y < v1->y) {
-        // v0 is lower. use v0 to get min, use v1 to get max
-        minyf = v0->y < v2->y ? v0->y : v2->y;
-        maxyf = v1->y > v2->y ? v1->y : v2->y;
+    fill_tri<Source, Depth>(left_output, right_output, miny, maxy, s);
+}
+
+static fill_tri_fn const fill_tri_avx2_variants[] = {
+    fill_tri_avx2<span_flat_t, false>,
+    fill_tri_avx2<span_flat_t, true>,
+    fill_tri_avx2<span_shade_t, false>,
+    fill_tri_avx2<span_shade_t, true>,
+    fill_tri_avx2<span_tex_t, false>,
+    fill_tri_avx2<span_tex_t, true>,
+    fill_tri_avx2<span_overdraw_t, false>,
+    fill_tri_avx2<span_overdraw_t, true>
+};
+#endif
+
+static dispatch_variant_t<fill_tri_fn const*> const fill_tri_tables[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "avx2", CPU_AVX2, fill_tri_avx2_variants },
+#endif
+    { "base", 0, fill_tri_base }
+};
+
+// One of the tables above
+static fill_tri_fn const *fill_tri_variants = fill_tri_base;
+
+void polygon_dispatch(uint32_t features)
+{
+    dispatch_bind("fill_tri", &fill_tri_variants,
+            fill_tri_tables, features);
+}
+
+// Integer arithmetic only, from the snapped vertices on
+static void draw_tri_scan(scan_vertex_t const *sv,
+    render_rect_t const& clip, span_setup_t const *s, unsigned variant)
+{
+    int64_t miny = sv[0].y < sv[1].y ? sv[0].y : sv[1].y;
+    int64_t maxy = sv[0].y > sv[1].y ? sv[0].y : sv[1].y;
+    miny = miny < sv[2].y ? miny : sv[2].y;
+    maxy = maxy > sv[2].y ? maxy : sv[2].y;
+
+    // Rows with pixel centers in [miny, maxy), intersected
+    // with the clip rectangle
+    miny = scan_row(miny);
+    maxy = scan_row(maxy);
+
+    render_rect_t rows = clip;
+
+    if (rows.y0 < miny)
+        rows.y0 = int(miny);
+
+    if (rows.y1 > maxy)
+        rows.y1 = int(maxy);
+
+    if (rows.y0 >= rows.y1)
+        return;
+
+    if (overdraw_enabled)
+        variant = SPAN_OVERDRAW;
+
+    if (s->depth)
+        variant |= SPAN_DEPTH;
+
+    unsigned cpu = parallel_cpu_index();
+
+    uint32_t *left_output;
+    int band_rows;
+
+    if (likely(cpu < edge_cpus)) {
+        left_output = edge_buffers + cpu * edge_slice_size;
+        band_rows = int(edge_slice_size >> 1);
     } else {
-        // v1 lower or equal. use v1 to get min, use v0 to get max
-        minyf = v1->y < v2->y ? v1->y : v2->y;
-        maxyf = v0->y > v2->y ? v0->y : v2->y;
-    }
-
-    int miny = (int)minyf;
-    int maxy = (int)maxyf;
-    
-    int height = maxy - miny;
-    
-    uint16_t *left_output = scratch16;
-    uint16_t *right_output = scratch16 + height;
-    
-    draw_tri_scan_edge(left_output, right_output, v0, v1, miny);
-    draw_tri_scan_edge(left_output, right_output, v1, v2, miny);
-    draw_tri_scan_edge(left_output, right_output, v2, v0, miny);
-    
-    fill_tri(left_output, right_output, miny, maxy, color);
+        left_output = edge_band_buffers[cpu];
+        band_rows = EDGE_BAND_ROWS;
+    }
+
+    uint32_t *right_output = left_output + band_rows;
+
+    // One band covers the whole triangle, unless the edges didn't fit
+    render_rect_t band = rows;
+
+    for (; band.y0 < rows.y1; band.y0 = band.y1) {
+        band.y1 = rows.y1 - band.y0 > band_rows ?
+                band.y0 + band_rows : rows.y1;
+
+        draw_tri_scan_edge(left_output, right_output, sv + 0, sv + 1, band);
+        draw_tri_scan_edge(left_output, right_output, sv + 1, sv + 2, band);
+        draw_tri_scan_edge(left_output, right_output, sv + 2, sv + 0, band);
+
+        fill_tri_variants[variant](left_output, right_output,
+                band.y0, band.y1, s);
+    }
+}
+
+static void draw_tri_ccw_scanline(
+    vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    render_rect_t const& clip, span_setup_t const *s, unsigned variant)
+{
+    scan_vertex_t sv[3] = {
+        { scan_fixed(v0->x), scan_fixed(v0->y) },
+        { scan_fixed(v1->x), scan_fixed(v1->y) },
+        { scan_fixed(v2->x), scan_fixed(v2->y) }
+    };
+
+    draw_tri_scan(sv, clip, s, variant);
+}
+
+// Pixel bounding box of the triangle, clamped to clip
+static render_rect_t tri_bounds(vec4 const *v0, vec4 const *v1,
+    vec4 const *v2, render_rect_t const& clip)
+{
+    float minxf = v0->x < v1->x ? v0->x : v1->x;
+    float maxxf = v0->x > v1->x ? v0->x : v1->x;
+    float minyf = v0->y < v1->y ? v0->y : v1->y;
+    float maxyf = v0->y > v1->y ? v0->y : v1->y;
+
+    minxf = minxf < v2->x ? minxf : v2->x;
+    maxxf = maxxf > v2->x ? maxxf : v2->x;
+    minyf = minyf < v2->y ? minyf : v2->y;
+    maxyf = maxyf > v2->y ? maxyf : v2->y;
+
+    render_rect_t bounds = clip;
+
+    // Compare in float, so huge coordinates can't overflow
+    if (minxf > float(clip.x0))
+        bounds.x0 = int(minxf);
+    if (minyf > float(clip.y0))
+        bounds.y0 = int(minyf);
+    if (maxxf < float(clip.x1 - 1))
+        bounds.x1 = int(maxxf) + 1;
+    if (maxyf < float(clip.y1 - 1))
+        bounds.y1 = int(maxyf) + 1;
+
+    return bounds;
+}
+
+// Sets depth to plane, or to null when depth testing is off.
+// Returns false if there is nothing to draw
+static bool draw_tri_depth_setup(depth_plane_t *plane,
+    depth_plane_t const **depth, vec4 const *v0, vec4 const *v1,
+    vec4 const *v2, render_rect_t const& clip)
+{
+    *depth = nullptr;
+
+    if (!depth_enabled())
+        return true;
+
+    // No area, nothing to draw
+    if (!depth_plane_setup(plane, v0, v1, v2))
+        return false;
+
+    // Hidden behind everything already drawn in its bounding box
+    if (depth_hz_reject(tri_bounds(v0, v1, v2, clip), plane->zmin)) {
+        ++depth_counters.tris_rejected;
+        return false;
+    }
+
+    *depth = plane;
+
+    return true;
+}
+
+// Tiles the triangle can touch need to be cleared and presented
+static void draw_tri_mark_dirty(vec4 const *v0, vec4 const *v1,
+    vec4 const *v2, render_rect_t const& clip)
+{
+    dirty_mark(tri_bounds(v0, v1, v2, clip));
+}
+
+void draw_tri_ccw_rect(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t color, render_rect_t const& clip)
+{
+    depth_plane_t plane;
+    depth_plane_t const *depth;
+
+    if (!draw_tri_depth_setup(&plane, &depth, v0, v1, v2, clip))
+        return;
+
+    draw_tri_mark_dirty(v0, v1, v2, clip);
+
+    // The half-space engine declines triangles it can't handle exactly
+    if (raster_engine == RASTER_HALFSPACE && !overdraw_enabled &&
+            draw_tri_ccw_halfspace(v0, v1, v2, color, clip, depth))
+        return;
+
+    span_setup_t setup{};
+    setup.color = color;
+    setup.depth = depth;
+
+    draw_tri_ccw_scanline(v0, v1, v2, clip, &setup, SPAN_FLAT);
+}
+
+void draw_tri_ccw(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t color)
+{
+    if (tile_binning() && tile_bin_tri(v0, v1, v2, color))
+        return;
+
+    render_rect_t clip{
+        0, 0,
+        int(render_surface.width), int(render_surface.height)
+    };
+
+    draw_tri_ccw_rect(v0, v1, v2, color, clip);
+}
+
+void draw_tri_ccw_rect(vec4x const *v0, vec4x const *v1, vec4x const *v2,
+    uint32_t color, render_rect_t const& clip)
+{
+    // Outside what render_viewport can project
+    if (unlikely(v0->w.raw <= 0 || v1->w.raw <= 0 || v2->w.raw <= 0))
+        return;
+
+    scan_vertex_t sv[3] = {
+        { scan_fixed(v0->x), scan_fixed(v0->y) },
+        { scan_fixed(v1->x), scan_fixed(v1->y) },
+        { scan_fixed(v2->x), scan_fixed(v2->y) }
+    };
+
+    // Pixel bounding box, as tri_bounds
+    int64_t minx = sv[0].x < sv[1].x ? sv[0].x : sv[1].x;
+    int64_t maxx = sv[0].x > sv[1].x ? sv[0].x : sv[1].x;
+    int64_t miny = sv[0].y < sv[1].y ? sv[0].y : sv[1].y;
+    int64_t maxy = sv[0].y > sv[1].y ? sv[0].y : sv[1].y;
+
+    minx = minx < sv[2].x ? minx : sv[2].x;
+    maxx = maxx > sv[2].x ? maxx : sv[2].x;
+    miny = miny < sv[2].y ? miny : sv[2].y;
+    maxy = maxy > sv[2].y ? maxy : sv[2].y;
+
+    render_rect_t bounds = clip;
+
+    if ((minx >> SCAN_SUBPIXEL_BITS) > clip.x0)
+        bounds.x0 = int(minx >> SCAN_SUBPIXEL_BITS);
+    if ((miny >> SCAN_SUBPIXEL_BITS) > clip.y0)
+        bounds.y0 = int(miny >> SCAN_SUBPIXEL_BITS);
+    if ((maxx >> SCAN_SUBPIXEL_BITS) < clip.x1 - 1)
+        bounds.x1 = int(maxx >> SCAN_SUBPIXEL_BITS) + 1;
+    if ((maxy >> SCAN_SUBPIXEL_BITS) < clip.y1 - 1)
+        bounds.y1 = int(maxy >> SCAN_SUBPIXEL_BITS) + 1;
+
+    dirty_mark(bounds);
+
+    span_setup_t setup{};
+    setup.color = color;
+
+    draw_tri_scan(sv, clip, &setup, SPAN_FLAT);
+}
+
+void draw_tri_ccw(vec4x const *v0, vec4x const *v1, vec4x const *v2,
+    uint32_t color)
+{
+    // Binned triangles would otherwise be drawn over this one
+    if (tile_binning())
+        tile_flush();
+
+    render_rect_t clip{
+        0, 0,
+        int(render_surface.width), int(render_surface.height)
+    };
+
+    draw_tri_ccw_rect(v0, v1, v2, color, clip);
+}
+
+void draw_tri_ccw_tex_rect(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    texcoord const *t0, texcoord const *t1, texcoord const *t2,
+    texture_t const *texture, render_rect_t const& clip)
+{
+    texture_plane_t tex;
+
+    // No area, nothing to draw
+    if (!texture_plane_setup(&tex, texture, v0, v1, v2, t0, t1, t2))
+        return;
+
+    depth_plane_t plane;
+    depth_plane_t const *depth;
+
+    if (!draw_tri_depth_setup(&plane, &depth, v0, v1, v2, clip))
+        return;
+
+    draw_tri_mark_dirty(v0, v1, v2, clip);
+
+    span_setup_t setup{};
+    setup.depth = depth;
+    setup.tex = &tex;
+    setup.texture = texture;
+
+    draw_tri_ccw_scanline(v0, v1, v2, clip, &setup, SPAN_TEX);
+}
+
+void draw_tri_ccw_tex(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    texcoord const *t0, texcoord const *t1, texcoord const *t2,
+    texture_t const *texture)
+{
+    if (tile_binning() && tile_bin_tri_tex(v0, v1, v2, t0, t1, t2, texture))
+        return;
+
+    render_rect_t clip{
+        0, 0,
+        int(render_surface.width), int(render_surface.height)
+    };
+
+    draw_tri_ccw_tex_rect(v0, v1, v2, t0, t1, t2, texture, clip);
+}
+
+void draw_tri_ccw_shaded_rect(vec4 const *v0, vec4 const *v1,
+    vec4 const *v2, uint32_t c0, uint32_t c1, uint32_t c2,
+    render_rect_t const& clip)
+{
+    shade_plane_t shade;
+
+    // No area, nothing to draw
+    if (!shade_plane_setup(&shade, v0, v1, v2, c0, c1, c2))
+        return;
+
+    depth_plane_t plane;
+    depth_plane_t const *depth;
+
+    if (!draw_tri_depth_setup(&plane, &depth, v0, v1, v2, clip))
+        return;
+
+    draw_tri_mark_dirty(v0, v1, v2, clip);
+
+    span_setup_t setup{};
+    setup.depth = depth;
+    setup.shade = &shade;
+
+    draw_tri_ccw_scanline(v0, v1, v2, clip, &setup, SPAN_SHADE);
+}
+
+void draw_tri_ccw_shaded(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t c0, uint32_t c1, uint32_t c2)
+{
+    if (tile_binning() && tile_bin_tri_shaded(v0, v1, v2, c0, c1, c2))
+        return;
+
+    render_rect_t clip{
+        0, 0,
+        int(render_surface.width), int(render_surface.height)
+    };
+
+    draw_tri_ccw_shaded_rect(v0, v1, v2, c0, c1, c2, clip);
 }
@@ -1,8 +1,92 @@
 #pragma once
 #include "vec.h"
+#include "vec_fixed.h"
 
-void set_render_surface(uint32_t *pixels, uint32_t pitch, 
+struct texture_t;
+
+struct render_surface_t {
+    uint32_t *pixels;
+    uint32_t pitch;
+    uint32_t width;
+    uint32_t height;
+
+    // Owned by the depth module, see depth.h
+    float *depth;
+    uint32_t depth_pitch;
+};
+
+extern render_surface_t render_surface;
+
+// Pixel rectangle, x1 and y1 are exclusive
+struct render_rect_t {
+    int x0, y0;
+    int x1, y1;
+};
+
+void set_render_surface(uint32_t *pixels, uint32_t pitch,
     uint32_t width, uint32_t height);
 
-void draw_tri_ccw(vec4 const *v0, vec4 const *v1, vec4 const *v2, 
+// Retarget to another buffer with the same size and pitch,
+// such as the next page of a swap chain, keeping the bins and depth
+void set_render_pixels(uint32_t *pixels);
+
+// Fill the render surface with color, only refilling
+// the parts drawn since the last clear, see dirty.h
+void clear_render_surface(uint32_t color);
+
+enum raster_engine_t {
+    // Walk the edges to find the span of each scanline, then fill spans
+    RASTER_SCANLINE,
+
+    // Evaluate edge functions over pixel blocks, see halfspace.h
+    RASTER_HALFSPACE
+};
+
+void set_raster_engine(raster_engine_t engine);
+raster_engine_t get_raster_engine();
+
+// While enabled, every triangle adds one to the pixels it covers instead
+// of writing a color, so after clearing to 0, each pixel holds the number
+// of times it was drawn, and depth_counters.pixels_overdrawn counts the
+// pixels drawn more than once. Always uses the scanline engine
+void set_overdraw_mode(bool enable);
+bool overdraw_mode();
+
+// Draws immediately, or bins the triangle if tile binning is enabled
+void draw_tri_ccw(vec4 const *v0, vec4 const *v1, vec4 const *v2,
     uint32_t color);
+
+// Rasterize immediately, touching only the pixels inside clip
+void draw_tri_ccw_rect(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t color, render_rect_t const& clip);
+
+// Fixed point, from render_viewport, with integer arithmetic only.
+// Never clipped, render_polygon does that, and dropped when a vertex
+// has w of 0, which render_viewport couldn't project. Never depth
+// tested, the depth buffer holds floats. Always drawn at once by the
+// scanline engine, never binned, so draw_tri_ccw flushes the tile bins
+// first to keep it over float triangles submitted before it
+void draw_tri_ccw(vec4x const *v0, vec4x const *v1, vec4x const *v2,
+    uint32_t color);
+
+void draw_tri_ccw_rect(vec4x const *v0, vec4x const *v1, vec4x const *v2,
+    uint32_t color, render_rect_t const& clip);
+
+// Perspective correct textured triangle, see texture.h. The color is
+// replaced by the texel. Textured triangles always use the scanline engine
+void draw_tri_ccw_tex(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    texcoord const *t0, texcoord const *t1, texcoord const *t2,
+    texture_t const *texture);
+
+void draw_tri_ccw_tex_rect(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    texcoord const *t0, texcoord const *t1, texcoord const *t2,
+    texture_t const *texture, render_rect_t const& clip);
+
+// Gouraud shaded, with a color for each vertex, see shade.h.
+// Shaded triangles always use the scanline engine
+void draw_tri_ccw_shaded(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t c0, uint32_t c1, uint32_t c2);
+
+void draw_tri_ccw_shaded_rect(vec4 const *v0, vec4 const *v1,
+    vec4 const *v2, uint32_t c0, uint32_t c1, uint32_t c2,
+    render_rect_t const& clip);
@@ -0,0 +1,43 @@
+#include "present.h"
+#include "polygon.h"
+#include "dirty.h"
+#include "malloc.h"
+#include "likely.h"
+
+static uint32_t *present_pixels;
+
+bool present_init(uint32_t width, uint32_t height)
+{
+    // Whole cache lines per row, so rows never share a line
+    uint32_t pitch = (width * sizeof(uint32_t) + 63) & -64;
+
+    uint32_t *pixels = (uint32_t*)malloc_aligned(size_t(pitch) * height, 64);
+
+    if (unlikely(!pixels))
+        return false;
+
+    present_free();
+
+    present_pixels = pixels;
+
+    // Starts with every tile dirty, nothing in RAM matches
+    // the framebuffer yet
+    set_render_surface(pixels, pitch, width, height);
+
+    return true;
+}
+
+void present_free()
+{
+    free(present_pixels);
+
+    present_pixels = nullptr;
+}
+
+void present(uint32_t *dest, size_t dest_pitch)
+{
+    if (unlikely(!present_pixels || render_surface.pixels != present_pixels))
+        return;
+
+    dirty_present(dest, dest_pitch);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Render target in ordinary cached RAM. Present copies only the tiles
+// that changed to the framebuffer, with streaming stores, see dirty.h
+// and arch/stream.h
+
+// Allocate a back buffer of the given size, and make it the render
+// surface. Returns false if out of memory, leaving the surface alone
+bool present_init(uint32_t width, uint32_t height);
+
+// Free the back buffer. The render surface must be
+// retargeted with set_render_surface first
+void present_free();
+
+// Copy the changed tiles of the back buffer to dest,
+// does nothing when the back buffer is not the render surface.
+// With a swap chain, pass the page count to dirty_set_pages
+void present(uint32_t *dest, size_t dest_pitch);
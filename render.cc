@@ -1,7 +1,854 @@
 #include <stdint.h>
 #include "render.h"
+#include "polygon.h"
+#include "line.h"
+#include "tile.h"
+#include "malloc.h"
 #include "string.h"
 #include "assert.h"
+#include "likely.h"
 
 #include "math/math.h"
 
+static float clip_guard = 1.0f;
+
+// Ping-pong buffers for the output of each plane, grown as needed
+static vertex *clip_verts[2];
+static size_t clip_capacity;
+
+// Projected vertices of the last clipped polygon
+static vertex *render_verts;
+static size_t render_capacity;
+
+// The same for the fixed point path, the last one holds the projection
+static vec4x *clipx_verts[3];
+static size_t clipx_capacity;
+
+draw_counters_t draw_counters;
+
+cull_counters_t cull_counters;
+
+static mat4x4 render_transform;
+
+// Planes of the view volume in object space, numbered as in
+// vec4::dot_clip_plane, scaled to give distances
+static vec4 render_frustum[CLIP_PLANE_COUNT];
+
+struct vcache_entry_t {
+    int outcode;
+
+    // Clip space, and window space when outcode is zero
+    vertex clip;
+    vertex window;
+};
+
+// Keys are the generation in the high half and the index in the low half.
+// They are separate, so the search only touches a few cache lines
+static uint64_t vcache_key[VCACHE_SIZE];
+static vcache_entry_t vcache[VCACHE_SIZE];
+
+// Entries in use, and the oldest one, which is replaced next
+static size_t vcache_count;
+static size_t vcache_next;
+
+// Bumped whenever the transform, the vertex array or the window size
+// changes, or by render_invalidate_vertices, so entries computed before
+// never match again
+static uint32_t vcache_gen;
+
+// Vertex array and window size of the current generation
+static vertex const *vcache_vertices;
+static uint32_t vcache_width;
+static uint32_t vcache_height;
+
+static bool wire_enable;
+
+// Edges already drawn by the current wireframe draw, keyed by their
+// indices, lower one first, in an open addressed table. 0 is empty,
+// which no edge can be, because degenerate edges aren't drawn
+static uint64_t *wire_edges;
+
+// Vertices whose own pixel was drawn, keyed by index plus one, in the
+// same allocation, so an edge left out by the dedup still gets corners
+static uint64_t *wire_verts;
+
+static size_t wire_capacity;
+static bool wire_dedup;
+
+static void vcache_invalidate()
+{
+    // Start empty rather than let a key from 2^32 generations ago match
+    if (unlikely(++vcache_gen == 0)) {
+        vcache_count = 0;
+        vcache_next = 0;
+    }
+}
+
+void clip_set_guard_band(float scale)
+{
+    clip_guard = scale > 1.0f ? scale : 1.0f;
+}
+
+float clip_guard_band()
+{
+    return clip_guard;
+}
+
+// Like vec4::outcode, with the x and y planes pushed out to the guard band
+static int clip_guard_outcode(vec4 const& v)
+{
+    float gw = v.w * clip_guard;
+
+    return ((v.x + gw < 0.0f) << 0) |
+            ((-v.x + gw < 0.0f) << 1) |
+            ((v.y + gw < 0.0f) << 2) |
+            ((-v.y + gw < 0.0f) << 3) |
+            ((v.dot_clip_plane(4) < 0.0f) << 4) |
+            ((v.dot_clip_plane(5) < 0.0f) << 5);
+}
+
+clip_test_t clip_test(vertex const *verts, size_t count, int *planes)
+{
+    int all_out = CLIP_ALL_PLANES;
+    int any_out = 0;
+
+    if (clip_guard > 1.0f) {
+        for (size_t i = 0; i < count; ++i) {
+            all_out &= verts[i].pos.outcode();
+            any_out |= clip_guard_outcode(verts[i].pos);
+        }
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            int code = verts[i].pos.outcode();
+            all_out &= code;
+            any_out |= code;
+        }
+    }
+
+    *planes = any_out;
+
+    if (all_out)
+        return CLIP_REJECT;
+
+    return any_out ? CLIP_PARTIAL : CLIP_ACCEPT;
+}
+
+static bool clip_reserve(size_t count)
+{
+    if (likely(count <= clip_capacity))
+        return true;
+
+    size_t new_capacity = clip_capacity ? clip_capacity : 16;
+
+    while (new_capacity < count)
+        new_capacity *= 2;
+
+    for (size_t i = 0; i < 2; ++i) {
+        vertex *new_verts = (vertex*)realloc(
+            clip_verts[i], new_capacity * sizeof(*new_verts));
+
+        if (unlikely(!new_verts))
+            return false;
+
+        clip_verts[i] = new_verts;
+    }
+
+    clip_capacity = new_capacity;
+
+    return true;
+}
+
+// Point where the edge from inside vertex a to outside vertex b crosses
+// the plane. Always interpolated from the inside vertex, so an edge
+// shared by two polygons produces exactly the same vertex in both
+static _always_inline vertex clip_intersect(
+    vertex const& a, float da, vertex const& b, float db)
+{
+    float t = da / (da - db);
+
+    vertex result;
+    result.pos = a.pos + (b.pos - a.pos) * t;
+    result.tex.u = a.tex.u + (b.tex.u - a.tex.u) * t;
+    result.tex.v = a.tex.v + (b.tex.v - a.tex.v) * t;
+
+    return result;
+}
+
+static size_t clip_plane(vertex *out, vertex const *in, size_t count,
+    int plane)
+{
+    size_t out_count = 0;
+
+    vertex const *prev = in + count - 1;
+    float dprev = prev->pos.dot_clip_plane(plane);
+
+    for (size_t i = 0; i < count; ++i) {
+        vertex const *curr = in + i;
+        float dcurr = curr->pos.dot_clip_plane(plane);
+
+        if (dcurr >= 0.0f) {
+            if (dprev < 0.0f)
+                out[out_count++] = clip_intersect(*curr, dcurr, *prev, dprev);
+
+            out[out_count++] = *curr;
+        } else if (dprev >= 0.0f) {
+            out[out_count++] = clip_intersect(*prev, dprev, *curr, dcurr);
+        }
+
+        prev = curr;
+        dprev = dcurr;
+    }
+
+    return out_count;
+}
+
+size_t clip_polygon(vertex const **out, vertex const *verts, size_t count,
+    int planes)
+{
+    if (unlikely(count < 3 || !clip_reserve(count + CLIP_PLANE_COUNT)))
+        return 0;
+
+    vertex const *in = verts;
+    size_t buffer = 0;
+
+    for (size_t plane = 0; plane < CLIP_PLANE_COUNT && count; ++plane) {
+        if (!(planes & (1 << plane)))
+            continue;
+
+        vertex *dest = clip_verts[buffer];
+        count = clip_plane(dest, in, count, plane);
+        in = dest;
+        buffer ^= 1;
+    }
+
+    *out = in;
+
+    return count >= 3 ? count : 0;
+}
+
+vec4 render_viewport(vec4 const& v)
+{
+    float rw = 1.0f / v.w;
+
+    return {
+        (v.x * rw + 1.0f) * float(render_surface.width) * 0.5f,
+        (v.y * rw + 1.0f) * float(render_surface.height) * 0.5f,
+        (v.z * rw + 1.0f) * 0.5f,
+        rw
+    };
+}
+
+// Divides by w, 1/w in 16.16 is too coarse to multiply by
+static vec4x render_viewport_unchecked(vec4x const& v)
+{
+    fix16_t half_width = fix16_t::from_raw(
+            int32_t(render_surface.width << (fix16_t::FRAC_BITS - 1)));
+    fix16_t half_height = fix16_t::from_raw(
+            int32_t(render_surface.height << (fix16_t::FRAC_BITS - 1)));
+    fix16_t half = fix16_t::from_raw(fix16_t::ONE >> 1);
+
+    return {
+        (v.x / v.w + 1) * half_width,
+        (v.y / v.w + 1) * half_height,
+        (v.z / v.w + 1) * half,
+        fix16_t(1) / v.w
+    };
+}
+
+// Distance from the fixed point clip plane, 0 is RENDER_FIXED_MIN_W,
+// 1 to 4 are the guard band, and 5 and 6 are z. In 64 bits, guard band
+// times w can be out of range
+static _always_inline int64_t clipx_distance(vec4x const& v, int plane)
+{
+    int64_t gw = int64_t(v.w.raw) * RENDER_FIXED_GUARD_BAND;
+
+    switch (plane) {
+    case 0: return int64_t(v.w.raw) - RENDER_FIXED_MIN_W.raw;
+    case 1: return gw + v.x.raw;
+    case 2: return gw - v.x.raw;
+    case 3: return gw + v.y.raw;
+    case 4: return gw - v.y.raw;
+    case 5: return int64_t(v.w.raw) + v.z.raw;
+    case 6: return int64_t(v.w.raw) - v.z.raw;
+    }
+    return 0;
+}
+
+static constexpr int CLIPX_PLANE_COUNT = 7;
+
+static int clipx_outcode(vec4x const& v)
+{
+    int result = 0;
+
+    for (int plane = 0; plane < CLIPX_PLANE_COUNT; ++plane)
+        result |= (clipx_distance(v, plane) < 0) << plane;
+
+    return result;
+}
+
+vec4x render_viewport(vec4x const& v)
+{
+    if (unlikely(clipx_outcode(v)))
+        return vec4x(0, 0, 0, 0);
+
+    return render_viewport_unchecked(v);
+}
+
+static bool clipx_reserve(size_t count)
+{
+    if (likely(count <= clipx_capacity))
+        return true;
+
+    size_t new_capacity = clipx_capacity ? clipx_capacity : 16;
+
+    while (new_capacity < count)
+        new_capacity *= 2;
+
+    for (size_t i = 0; i < 3; ++i) {
+        vec4x *new_verts = (vec4x*)realloc(
+            clipx_verts[i], new_capacity * sizeof(*new_verts));
+
+        if (unlikely(!new_verts))
+            return false;
+
+        clipx_verts[i] = new_verts;
+    }
+
+    clipx_capacity = new_capacity;
+
+    return true;
+}
+
+// As clip_intersect, with t in 2.30. da is at least 0 and db is
+// negative, so t is in [0, 1), and both are shifted down together
+// until the denominator fits in 32 bits, so da << 30 can't overflow
+static _always_inline vec4x clipx_intersect(
+    vec4x const& a, int64_t da, vec4x const& b, int64_t db)
+{
+    int64_t den = da - db;
+
+    while (den >= (int64_t(1) << 32)) {
+        da >>= 1;
+        den >>= 1;
+    }
+
+    int64_t t = (da << 30) / den;
+
+    auto lerp = [t](fix16_t a, fix16_t b) {
+        return fix16_t::from_raw(int32_t(a.raw +
+                ((int64_t(b.raw) - a.raw) * t >> 30)));
+    };
+
+    return {
+        lerp(a.x, b.x),
+        lerp(a.y, b.y),
+        lerp(a.z, b.z),
+        lerp(a.w, b.w)
+    };
+}
+
+static size_t clipx_plane(vec4x *out, vec4x const *in, size_t count,
+    int plane)
+{
+    size_t out_count = 0;
+
+    vec4x const *prev = in + count - 1;
+    int64_t dprev = clipx_distance(*prev, plane);
+
+    for (size_t i = 0; i < count; ++i) {
+        vec4x const *curr = in + i;
+        int64_t dcurr = clipx_distance(*curr, plane);
+
+        if (dcurr >= 0) {
+            if (dprev < 0)
+                out[out_count++] = clipx_intersect(*curr, dcurr, *prev, dprev);
+
+            out[out_count++] = *curr;
+        } else if (dprev >= 0) {
+            out[out_count++] = clipx_intersect(*prev, dprev, *curr, dcurr);
+        }
+
+        prev = curr;
+        dprev = dcurr;
+    }
+
+    return out_count;
+}
+
+void render_polygon(vec4x const *verts, size_t count, uint32_t color)
+{
+    if (unlikely(count < 3 ||
+            !clipx_reserve(count + CLIPX_PLANE_COUNT)))
+        return;
+
+    int all_out = (1 << CLIPX_PLANE_COUNT) - 1;
+    int any_out = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        int code = clipx_outcode(verts[i]);
+        all_out &= code;
+        any_out |= code;
+    }
+
+    if (all_out) {
+        cull_counters.tris_outside += count - 2;
+        return;
+    }
+
+    vec4x const *in = verts;
+    size_t buffer = 0;
+
+    // The w plane first, so the rest only see w of at least MIN_W
+    for (int plane = 0; plane < CLIPX_PLANE_COUNT && count; ++plane) {
+        if (!(any_out & (1 << plane)))
+            continue;
+
+        vec4x *dest = clipx_verts[buffer];
+        count = clipx_plane(dest, in, count, plane);
+        in = dest;
+        buffer ^= 1;
+    }
+
+    if (count < 3)
+        return;
+
+    // Clipped vertices can round a raw unit past a plane, which the
+    // check in render_viewport would reject, and so drop the polygon
+    vec4x *v = clipx_verts[2];
+
+    for (size_t i = 0; i < count; ++i)
+        v[i] = render_viewport_unchecked(in[i]);
+
+    // Signed area of the fan as in render_fan, in 28.4 so it fits
+    static constexpr int shift = fix16_t::FRAC_BITS - 4;
+    int64_t area = 0;
+
+    for (size_t i = 2; i < count; ++i) {
+        int64_t ax = v[0].x.raw >> shift, ay = v[0].y.raw >> shift;
+        int64_t bx = v[i - 1].x.raw >> shift, by = v[i - 1].y.raw >> shift;
+        int64_t cx = v[i].x.raw >> shift, cy = v[i].y.raw >> shift;
+
+        area += (by - ay) * (cx - ax) + (ax - bx) * (cy - ay);
+    }
+
+    if (area <= 0) {
+        cull_counters.tris_backfacing += count - 2;
+        return;
+    }
+
+    for (size_t i = 2; i < count; ++i)
+        draw_tri_ccw(&v[0], &v[i - 1], &v[i], color);
+}
+
+static bool render_reserve(size_t count)
+{
+    if (likely(count <= render_capacity))
+        return true;
+
+    size_t new_capacity = render_capacity ? render_capacity * 2 : 16;
+
+    while (new_capacity < count)
+        new_capacity *= 2;
+
+    vertex *new_verts = (vertex*)realloc(
+        render_verts, new_capacity * sizeof(*new_verts));
+
+    if (unlikely(!new_verts))
+        return false;
+
+    render_verts = new_verts;
+    render_capacity = new_capacity;
+
+    return true;
+}
+
+void render_polygon(vertex const *verts, size_t count,
+    uint32_t color, texture_t const *texture)
+{
+    int planes;
+
+    switch (clip_test(verts, count, &planes)) {
+    case CLIP_REJECT:
+        cull_counters.tris_outside += count >= 2 ? count - 2 : 0;
+        return;
+
+    case CLIP_PARTIAL:
+        count = clip_polygon(&verts, verts, count, planes);
+        break;
+
+    case CLIP_ACCEPT:
+        break;
+    }
+
+    if (count < 3 || unlikely(!render_reserve(count)))
+        return;
+
+    for (size_t i = 0; i < count; ++i) {
+        render_verts[i].pos = render_viewport(verts[i].pos);
+        render_verts[i].tex = verts[i].tex;
+    }
+
+    render_fan(render_verts, count, color, texture);
+}
+
+void render_fan(vertex const *verts, size_t count,
+    uint32_t color, texture_t const *texture)
+{
+    vertex const *v = verts;
+
+    // The fan covers the polygon, so its signed area is the sum of
+    // the triangles' areas, positive when wound as draw_tri_ccw expects
+    float area = 0.0f;
+
+    for (size_t i = 2; i < count; ++i) {
+        vec4 const& a = v[0].pos;
+        vec4 const& b = v[i - 1].pos;
+        vec4 const& c = v[i].pos;
+
+        area += (b.y - a.y) * (c.x - a.x) + (a.x - b.x) * (c.y - a.y);
+    }
+
+    if (!(area > 0.0f)) {
+        cull_counters.tris_backfacing += count >= 2 ? count - 2 : 0;
+        return;
+    }
+
+    for (size_t i = 2; i < count; ++i) {
+        if (texture) {
+            draw_tri_ccw_tex(&v[0].pos, &v[i - 1].pos, &v[i].pos,
+                    &v[0].tex, &v[i - 1].tex, &v[i].tex, texture);
+        } else {
+            draw_tri_ccw(&v[0].pos, &v[i - 1].pos, &v[i].pos, color);
+        }
+    }
+}
+
+void render_invalidate_vertices()
+{
+    vcache_invalidate();
+}
+
+void render_set_transform(mat4x4 const& m)
+{
+    render_transform = m;
+    vcache_invalidate();
+
+    // Clip space x + w is the dot product of row 0 plus row 3 with the
+    // object space position, and so on for the other planes
+    vec4 w(m.m[3][0], m.m[3][1], m.m[3][2], m.m[3][3]);
+
+    for (size_t plane = 0; plane < CLIP_PLANE_COUNT; ++plane) {
+        float const *row = m.m[plane >> 1];
+        vec4 r(row[0], row[1], row[2], row[3]);
+        vec4 p = (plane & 1) ? w - r : w + r;
+
+        // A degenerate plane culls nothing
+        float len = sqrtf(p.sq_len());
+        render_frustum[plane] = len > 0.0f ?
+                p * (1.0f / len) : vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+}
+
+void render_reset_cull_counters()
+{
+    memset(&cull_counters, 0, sizeof(cull_counters));
+}
+
+bool render_sphere_visible(vec4 const& center, float radius)
+{
+    ++cull_counters.objects_tested;
+
+    for (vec4 const& p : render_frustum) {
+        float d = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+
+        if (d < -radius) {
+            ++cull_counters.objects_culled;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Transformed vertex for index, from the cache when possible
+static void vcache_fetch(vcache_entry_t *result,
+    vertex const *vertices, uint32_t index)
+{
+    ++draw_counters.vertex_lookups;
+
+    uint64_t key = (uint64_t(vcache_gen) << 32) | index;
+
+    for (size_t i = 0; i < vcache_count; ++i) {
+        if (vcache_key[i] == key) {
+            ++draw_counters.vertex_hits;
+            *result = vcache[i];
+            return;
+        }
+    }
+
+    size_t slot = vcache_next;
+    vcache_next = (slot + 1) & (VCACHE_SIZE - 1);
+
+    if (vcache_count < VCACHE_SIZE)
+        ++vcache_count;
+
+    vcache_entry_t *entry = vcache + slot;
+    vec4 pos = vertices[index].pos;
+
+    vcache_key[slot] = key;
+    render_transform.transform(&entry->clip.pos, &pos, 1);
+    entry->clip.tex = vertices[index].tex;
+    entry->outcode = entry->clip.pos.outcode();
+
+    // Only used when the whole primitive is inside
+    if (!entry->outcode) {
+        entry->window.pos = render_viewport(entry->clip.pos);
+        entry->window.tex = entry->clip.tex;
+    }
+
+    *result = *entry;
+}
+
+void render_set_wireframe(bool enable)
+{
+    wire_enable = enable;
+}
+
+bool render_wireframe()
+{
+    return wire_enable;
+}
+
+// Empty the edge table, with room for edges at most half full.
+// Every edge is drawn, shared ones as often as they are used,
+// if the table can't be allocated
+static void wire_begin(size_t edges)
+{
+    size_t capacity = 16;
+
+    while (capacity < edges * 2)
+        capacity *= 2;
+
+    if (capacity > wire_capacity) {
+        uint64_t *table = (uint64_t*)realloc(wire_edges,
+                capacity * 2 * sizeof(*table));
+
+        if (unlikely(!table)) {
+            wire_dedup = false;
+            return;
+        }
+
+        wire_edges = table;
+        wire_verts = table + capacity;
+        wire_capacity = capacity;
+    }
+
+    memset(wire_edges, 0, wire_capacity * 2 * sizeof(*wire_edges));
+    wire_dedup = true;
+}
+
+// True the first time key is inserted since wire_begin
+static bool wire_insert(uint64_t *table, uint64_t key)
+{
+    size_t mask = wire_capacity - 1;
+    size_t slot = size_t((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+
+    for (;; slot = (slot + 1) & mask) {
+        if (table[slot] == key)
+            return false;
+
+        if (!table[slot]) {
+            table[slot] = key;
+            return true;
+        }
+    }
+}
+
+// True the first time the edge is seen since wire_begin
+static bool wire_first_use(uint32_t a, uint32_t b)
+{
+    if (unlikely(!wire_dedup))
+        return true;
+
+    return wire_insert(wire_edges, a < b ?
+            (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a);
+}
+
+// Lines leave out their last pixel, so a vertex is drawn once by the
+// edge that starts there. When every edge starting at a vertex was
+// drawn from the other end, the vertex is drawn on its own at the end
+static void wire_end(vertex const *vertices, uint32_t const *indices,
+    size_t count, uint32_t color)
+{
+    if (unlikely(!wire_dedup))
+        return;
+
+    for (size_t i = 0; i < count; ++i) {
+        vcache_entry_t entry;
+        vcache_fetch(&entry, vertices, indices[i]);
+
+        if (entry.outcode ||
+                !wire_insert(wire_verts, uint64_t(indices[i]) + 1))
+            continue;
+
+        vec4 const& p = entry.window.pos;
+        vec4 next(p.x + 1.0f, p.y, p.z, p.w);
+        draw_line_window(p, next, color);
+    }
+}
+
+// Clip the edge to the view volume in clip space, then project it.
+// True when the pixel of a was drawn, as draw_line_window
+static bool wire_draw_edge(vcache_entry_t const& a, vcache_entry_t const& b,
+    uint32_t color)
+{
+    ++draw_counters.edges;
+
+    if (!(a.outcode | b.outcode))
+        return draw_line_window(a.window.pos, b.window.pos, color);
+
+    if (a.outcode & b.outcode)
+        return false;
+
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+
+    for (int plane = 0; plane < int(CLIP_PLANE_COUNT); ++plane) {
+        float da = a.clip.pos.dot_clip_plane(plane);
+        float db = b.clip.pos.dot_clip_plane(plane);
+
+        if (da < 0.0f) {
+            float t = da / (da - db);
+            t0 = t0 > t ? t0 : t;
+        } else if (db < 0.0f) {
+            float t = da / (da - db);
+            t1 = t1 < t ? t1 : t;
+        }
+    }
+
+    if (t0 >= t1)
+        return false;
+
+    vec4 d = b.clip.pos - a.clip.pos;
+
+    // Clipped at a, the line starts somewhere else
+    return draw_line_window(render_viewport(a.clip.pos + d * t0),
+            render_viewport(a.clip.pos + d * t1), color) && !a.outcode;
+}
+
+// Vertices of one primitive, copied out of the cache, because
+// another vertex of the same primitive can replace them
+static void draw_indexed_polygon(vertex const *vertices,
+    uint32_t const *indices, size_t count,
+    uint32_t color, texture_t const *texture)
+{
+    vcache_entry_t entries[4];
+    vertex clip[4];
+    vertex window[4];
+    int any_out = 0;
+    int all_out = CLIP_ALL_PLANES;
+
+    for (size_t i = 0; i < count; ++i) {
+        vcache_entry_t &entry = entries[i];
+        vcache_fetch(&entry, vertices, indices[i]);
+
+        clip[i] = entry.clip;
+        window[i] = entry.window;
+        any_out |= entry.outcode;
+        all_out &= entry.outcode;
+    }
+
+    ++draw_counters.primitives;
+
+    if (all_out) {
+        cull_counters.tris_outside += count - 2;
+        return;
+    }
+
+    if (wire_enable) {
+        for (size_t i = 0, k = count - 1; i < count; k = i++) {
+            if (indices[k] == indices[i] ||
+                    !wire_first_use(indices[k], indices[i]))
+                continue;
+
+            // A line too short to have pixels leaves the vertex to wire_end
+            if (wire_draw_edge(entries[k], entries[i], color) && wire_dedup)
+                wire_insert(wire_verts, uint64_t(indices[k]) + 1);
+        }
+
+        return;
+    }
+
+    if (!any_out)
+        render_fan(window, count, color, texture);
+    else
+        render_polygon(clip, count, color, texture);
+}
+
+void draw_indexed(vertex const *vertices, uint32_t const *indices,
+    size_t count, primitive_t primitive,
+    uint32_t color, texture_t const *texture)
+{
+    memset(&draw_counters, 0, sizeof(draw_counters));
+
+    if (vcache_vertices != vertices ||
+            vcache_width != render_surface.width ||
+            vcache_height != render_surface.height) {
+        vcache_vertices = vertices;
+        vcache_width = render_surface.width;
+        vcache_height = render_surface.height;
+        vcache_invalidate();
+    }
+
+    // Each index after the first two of a strip or fan adds up to
+    // three edges, triangles and quads add one edge per index.
+    // Lines aren't binned, triangles binned before go under them
+    if (wire_enable) {
+        if (tile_binning())
+            tile_flush();
+
+        wire_begin(primitive == PRIM_TRIANGLE_STRIP ||
+                primitive == PRIM_TRIANGLE_FAN ? count * 3 : count);
+    }
+
+    uint32_t tri[3];
+
+    switch (primitive) {
+    case PRIM_TRIANGLES:
+        for (size_t i = 0; i + 3 <= count; i += 3)
+            draw_indexed_polygon(vertices, indices + i, 3, color, texture);
+        break;
+
+    case PRIM_TRIANGLE_STRIP:
+        for (size_t i = 0; i + 3 <= count; ++i) {
+            tri[0] = indices[i + (i & 1)];
+            tri[1] = indices[i + 1 - (i & 1)];
+            tri[2] = indices[i + 2];
+            draw_indexed_polygon(vertices, tri, 3, color, texture);
+        }
+        break;
+
+    case PRIM_TRIANGLE_FAN:
+        for (size_t i = 1; i + 2 <= count; ++i) {
+            tri[0] = indices[0];
+            tri[1] = indices[i];
+            tri[2] = indices[i + 1];
+            draw_indexed_polygon(vertices, tri, 3, color, texture);
+        }
+        break;
+
+    case PRIM_QUADS:
+        for (size_t i = 0; i + 4 <= count; i += 4)
+            draw_indexed_polygon(vertices, indices + i, 4, color, texture);
+        break;
+    }
+
+    // Indices left over after the last whole primitive aren't vertices
+    if (wire_enable) {
+        size_t used = primitive == PRIM_TRIANGLES ? count - count % 3 :
+                primitive == PRIM_QUADS ? count - count % 4 :
+                count >= 3 ? count : 0;
+
+        wire_end(vertices, indices, used, color);
+    }
+}
@@ -1,2 +1,169 @@
 #pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "vec.h"
+#include "vec_fixed.h"
 
+struct texture_t;
+
+// Vertex pipeline, from clip space to the rasterizer. Polygons are
+// convex, and clipped against the six planes of the view volume,
+// -w <= x, y, z <= w, numbered as in vec4::dot_clip_plane
+
+struct vertex {
+    texcoord tex;
+    vec4 pos;
+};
+
+// Each plane can add at most one vertex to a convex polygon
+static constexpr size_t CLIP_PLANE_COUNT = 6;
+static constexpr int CLIP_ALL_PLANES = (1 << CLIP_PLANE_COUNT) - 1;
+
+enum clip_test_t {
+    // Every vertex is outside the same plane
+    CLIP_REJECT,
+
+    // Nothing needs to be clipped
+    CLIP_ACCEPT,
+
+    // Clip against the planes returned
+    CLIP_PARTIAL
+};
+
+// With a guard band, x and y are only clipped when a vertex is
+// outside scale times the viewport, the rasterizer discards the rest
+// of the pixels outside the surface. The scale must keep window
+// coordinates well inside the rasterizer's fixed point range.
+// A scale of 1 or less disables the guard band
+void clip_set_guard_band(float scale);
+float clip_guard_band();
+
+// Trivial accept or reject of a whole batch of vertices, *planes is set
+// to the planes that need clipping, taking the guard band into account
+clip_test_t clip_test(vertex const *verts, size_t count, int *planes);
+
+// Sutherland-Hodgman clip of a convex polygon against the given planes.
+// Returns the vertex count, 0 when clipped away or out of memory, and
+// points *out at the result, valid until the next call
+size_t clip_polygon(vertex const **out, vertex const *verts, size_t count,
+    int planes);
+
+// Perspective divide and viewport transform to the render surface,
+// w is replaced by 1/w
+vec4 render_viewport(vec4 const& v);
+
+// Fixed point vertices are only projected when w is at least
+// RENDER_FIXED_MIN_W, z is within -w to w, and x and y are within this
+// many times w, which keeps every quotient in range. The fixed point
+// render_polygon clips to those planes, there is no other clipping
+static constexpr int RENDER_FIXED_GUARD_BAND = 4;
+static constexpr fix16_t RENDER_FIXED_MIN_W = fix16_t::from_raw(
+        fix16_t::ONE >> 8);
+
+// Integer arithmetic only. Returns w of 0 for a vertex outside the
+// limits above, draw_tri_ccw drops triangles with one of those
+vec4x render_viewport(vec4x const& v);
+
+// Fixed point render_polygon, flat filled, with integer arithmetic only.
+// Clipped in 16.16 to the limits above, so polygons crossing the near
+// plane or the guard band are cut rather than dropped
+void render_polygon(vec4x const *verts, size_t count, uint32_t color);
+
+// Clip, project, and draw a convex polygon as a fan of triangles, wound
+// as draw_tri_ccw expects after projection. Textured when texture is
+// not null, otherwise filled with color
+void render_polygon(vertex const *verts, size_t count,
+    uint32_t color, texture_t const *texture = nullptr);
+
+// Draw a convex polygon already in window space, as render_viewport
+// produces, as a fan of triangles without clipping
+void render_fan(vertex const *verts, size_t count,
+    uint32_t color, texture_t const *texture = nullptr);
+
+enum primitive_t {
+    // Each 3 indices are one triangle
+    PRIM_TRIANGLES,
+
+    // Each index after the first two adds a triangle with the
+    // previous two, every other one is reversed to keep the winding
+    PRIM_TRIANGLE_STRIP,
+
+    // Each index after the first two adds a triangle with the
+    // first index and the previous one
+    PRIM_TRIANGLE_FAN,
+
+    // Each 4 indices are one convex quad
+    PRIM_QUADS
+};
+
+// The most recently transformed vertices are kept in a small FIFO keyed
+// by index, so a vertex shared by nearby primitives is usually transformed
+// once. Entries are also keyed by a generation, bumped by each
+// render_set_transform and by draws from another vertex array or to
+// another window size, so they are kept across draws only while all of
+// those are unchanged. Vertices changed in place between draws need a
+// render_invalidate_vertices
+static constexpr size_t VCACHE_SIZE = 32;
+
+static_assert((VCACHE_SIZE & (VCACHE_SIZE - 1)) == 0,
+    "Cache size must be a power of two");
+
+struct draw_counters_t {
+    // Vertex references, and how many found the vertex already transformed
+    uint64_t vertex_lookups;
+    uint64_t vertex_hits;
+
+    // Primitives assembled
+    uint64_t primitives;
+
+    // Distinct edges in wireframe mode, each drawn as one line
+    uint64_t edges;
+};
+
+// Reset at the start of each draw_indexed, so it describes the last draw
+extern draw_counters_t draw_counters;
+
+// Object space to clip space transform applied by draw_indexed, vertex
+// cache entries transformed before are never used again. Also moves the
+// frustum used by render_sphere_visible
+void render_set_transform(mat4x4 const& m);
+
+// Drop every vertex cache entry, for a vertex array changed in place
+// since the last draw_indexed
+void render_invalidate_vertices();
+
+struct cull_counters_t {
+    // Bounding spheres tested, and found entirely outside the frustum
+    uint64_t objects_tested;
+    uint64_t objects_culled;
+
+    // Primitives entirely outside one clip plane
+    uint64_t tris_outside;
+
+    // Triangles facing away, or with no area, after projection
+    uint64_t tris_backfacing;
+};
+
+// Accumulated until reset, usually once per frame
+extern cull_counters_t cull_counters;
+
+void render_reset_cull_counters();
+
+// False if the object space sphere is entirely outside one plane of the
+// view volume of the current render_set_transform, so nothing in it can
+// be drawn. Conservative, spheres near a corner may pass
+bool render_sphere_visible(vec4 const& center, float radius);
+
+// While enabled, draw_indexed draws the edges of each primitive as lines
+// of the given color, instead of filling it, see line.h. An edge shared
+// by several primitives of one draw is drawn once, and every corner
+// inside the view gets its pixel. Primitives facing away are drawn too.
+// Triangles already binned are flushed first, lines aren't binned
+void render_set_wireframe(bool enable);
+bool render_wireframe();
+
+// Transform, clip, project and draw count indices of an indexed mesh.
+// Textured when texture is not null, otherwise filled with color
+void draw_indexed(vertex const *vertices, uint32_t const *indices,
+    size_t count, primitive_t primitive,
+    uint32_t color, texture_t const *texture = nullptr);
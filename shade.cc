@@ -0,0 +1,36 @@
+#include "shade.h"
+#include "likely.h"
+
+static _always_inline float shade_channel(uint32_t color, unsigned shift)
+{
+    return float((color >> shift) & 0xFF);
+}
+
+bool shade_plane_setup(shade_plane_t *plane,
+    vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t c0, uint32_t c1, uint32_t c2)
+{
+    float dx1 = v1->x - v0->x;
+    float dy1 = v1->y - v0->y;
+    float dx2 = v2->x - v0->x;
+    float dy2 = v2->y - v0->y;
+
+    float det = dx1 * dy2 - dx2 * dy1;
+
+    if (unlikely(det == 0.0f))
+        return false;
+
+    float inv_det = 1.0f / det;
+
+    texture_gradient(&plane->r, v0, dx1, dy1, dx2, dy2, inv_det,
+            shade_channel(c0, 16), shade_channel(c1, 16),
+            shade_channel(c2, 16));
+    texture_gradient(&plane->g, v0, dx1, dy1, dx2, dy2, inv_det,
+            shade_channel(c0, 8), shade_channel(c1, 8),
+            shade_channel(c2, 8));
+    texture_gradient(&plane->b, v0, dx1, dy1, dx2, dy2, inv_det,
+            shade_channel(c0, 0), shade_channel(c1, 0),
+            shade_channel(c2, 0));
+
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+#include "texture.h"
+
+// Gouraud shading. Each channel of the vertex colors is interpolated
+// linearly in window space, not perspective correct, in 0 to 255 units.
+// Colors are 0x00RRGGBB, like the render surface
+
+struct shade_plane_t {
+    texture_gradient_t r;
+    texture_gradient_t g;
+    texture_gradient_t b;
+};
+
+// Returns false if the triangle has no area
+bool shade_plane_setup(shade_plane_t *plane,
+    vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t c0, uint32_t c1, uint32_t c2);
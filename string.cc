@@ -1,6 +1,11 @@
 #include "string.h"
+#include "dispatch.h"
 
-void *memcpy(void * __restrict dest, void const * __restrict src, size_t size)
+typedef void *memcpy_fn(void * __restrict dest,
+    void const * __restrict src, size_t size);
+
+static void *memcpy_base(void * __restrict dest,
+        void const * __restrict src, size_t size)
 {
     char volatile *d_end = (char volatile *)dest + size;
     char volatile *s_end = (char volatile *)src + size;
@@ -9,6 +14,41 @@ void *memcpy(void * __restrict dest, void const * __restrict src, size_t size)
     return dest;
 }
 
+#if defined(__x86_64__) || defined(__i386__)
+// With enhanced rep movsb, the microcode moves whole cache lines
+static void *memcpy_erms(void * __restrict dest,
+        void const * __restrict src, size_t size)
+{
+    void *d = dest;
+    __asm__ __volatile__ (
+        "rep movsb"
+        : "+D" (d), "+S" (src), "+c" (size)
+        :
+        : "memory"
+    );
+    return dest;
+}
+#endif
+
+static dispatch_variant_t<memcpy_fn*> const memcpy_variants[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "erms", CPU_ERMS, memcpy_erms },
+#endif
+    { "base", 0, memcpy_base }
+};
+
+static memcpy_fn *memcpy_kernel = memcpy_base;
+
+void memcpy_dispatch(uint32_t features)
+{
+    dispatch_bind("memcpy", &memcpy_kernel, memcpy_variants, features);
+}
+
+void *memcpy(void * __restrict dest, void const * __restrict src, size_t size)
+{
+    return memcpy_kernel(dest, src, size);
+}
+
 void *memset(void * __restrict dest, int value, size_t size)
 {
     unsigned char volatile *out = (unsigned char volatile *)dest;
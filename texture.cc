@@ -0,0 +1,109 @@
+#include "texture.h"
+#include "malloc.h"
+#include "likely.h"
+
+static unsigned texture_subspan = TEXTURE_SUBSPAN_SHIFT_DEFAULT;
+
+texture_t *texture_create(uint32_t log2_width, uint32_t log2_height)
+{
+    // At least one whole tile, and small enough that texel
+    // coordinates in 16.16 fixed point can't overflow
+    if (unlikely(log2_width < TEXTURE_TILE_SHIFT ||
+            log2_height < TEXTURE_TILE_SHIFT ||
+            log2_width > 12 || log2_height > 12))
+        return nullptr;
+
+    texture_t *texture = (texture_t*)malloc(sizeof(*texture));
+
+    if (unlikely(!texture))
+        return nullptr;
+
+    size_t count = size_t(1) << (log2_width + log2_height);
+
+    texture->texels = (uint32_t*)malloc_aligned(
+        count * sizeof(*texture->texels), 64);
+
+    if (unlikely(!texture->texels)) {
+        free(texture);
+        return nullptr;
+    }
+
+    texture->width = 1U << log2_width;
+    texture->height = 1U << log2_height;
+    texture->log2_width = log2_width;
+    texture->log2_height = log2_height;
+
+    return texture;
+}
+
+void texture_free(texture_t *texture)
+{
+    if (!texture)
+        return;
+
+    free(texture->texels);
+    free(texture);
+}
+
+void texture_load(texture_t *texture, uint32_t const *pixels, size_t pitch)
+{
+    for (uint32_t y = 0; y < texture->height; ++y) {
+        uint32_t const *row = (uint32_t const*)
+                ((char const*)pixels + pitch * y);
+
+        for (uint32_t x = 0; x < texture->width; ++x)
+            texture_store(texture, x, y, row[x]);
+    }
+}
+
+void texture_set_subspan_shift(unsigned shift)
+{
+    texture_subspan = shift < TEXTURE_SUBSPAN_SHIFT_MAX ?
+            shift : TEXTURE_SUBSPAN_SHIFT_MAX;
+}
+
+unsigned texture_subspan_shift()
+{
+    return texture_subspan;
+}
+
+void texture_gradient(texture_gradient_t *g,
+    vec4 const *v0, float dx1, float dy1, float dx2, float dy2,
+    float inv_det, float a0, float a1, float a2)
+{
+    float da1 = a1 - a0;
+    float da2 = a2 - a0;
+
+    g->dadx = (da1 * dy2 - da2 * dy1) * inv_det;
+    g->dady = (dx1 * da2 - dx2 * da1) * inv_det;
+    g->a0 = a0 - g->dadx * v0->x - g->dady * v0->y;
+}
+
+bool texture_plane_setup(texture_plane_t *plane, texture_t const *texture,
+    vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    texcoord const *t0, texcoord const *t1, texcoord const *t2)
+{
+    float dx1 = v1->x - v0->x;
+    float dy1 = v1->y - v0->y;
+    float dx2 = v2->x - v0->x;
+    float dy2 = v2->y - v0->y;
+
+    float det = dx1 * dy2 - dx2 * dy1;
+
+    if (unlikely(det == 0.0f))
+        return false;
+
+    float inv_det = 1.0f / det;
+
+    float w = float(texture->width);
+    float h = float(texture->height);
+
+    texture_gradient(&plane->uw, v0, dx1, dy1, dx2, dy2, inv_det,
+            t0->u * w * v0->w, t1->u * w * v1->w, t2->u * w * v2->w);
+    texture_gradient(&plane->vw, v0, dx1, dy1, dx2, dy2, inv_det,
+            t0->v * h * v0->w, t1->v * h * v1->w, t2->v * h * v2->w);
+    texture_gradient(&plane->w, v0, dx1, dy1, dx2, dy2, inv_det,
+            v0->w, v1->w, v2->w);
+
+    return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "compiler.h"
+#include "vec.h"
+
+// Texels are stored in 4x4 tiles, so each 64 byte tile is one cache
+// line, and a span walking through the texture in any direction touches
+// far fewer lines than with a linear layout. Tiles are in row major order.
+// Dimensions are powers of two, at least 4, and coordinates wrap
+
+static constexpr unsigned TEXTURE_TILE_SHIFT = 2;
+static constexpr unsigned TEXTURE_TILE_SIZE = 1U << TEXTURE_TILE_SHIFT;
+static constexpr unsigned TEXTURE_TILE_MASK = TEXTURE_TILE_SIZE - 1;
+
+struct texture_t {
+    uint32_t *texels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t log2_width;
+    uint32_t log2_height;
+};
+
+// Perspective correct spans interpolate u/w, v/w and 1/w linearly, and
+// only divide at the ends of each subspan of 1 << shift pixels, the
+// texture coordinates are interpolated linearly in between
+static constexpr unsigned TEXTURE_SUBSPAN_SHIFT_DEFAULT = 4;
+static constexpr unsigned TEXTURE_SUBSPAN_SHIFT_MAX = 6;
+
+// a = a0 + dadx * x + dady * y
+struct texture_gradient_t {
+    float a0;
+    float dadx;
+    float dady;
+};
+
+// Plane through a0, a1 and a2 at v0, v1 and v2, where dx1, dy1 and dx2,
+// dy2 are v1 - v0 and v2 - v0, and inv_det is 1 / (dx1 * dy2 - dx2 * dy1).
+// Also used for the other interpolants, see shade.h
+void texture_gradient(texture_gradient_t *g,
+    vec4 const *v0, float dx1, float dy1, float dx2, float dy2,
+    float inv_det, float a0, float a1, float a2);
+
+// u/w and v/w are in texels
+struct texture_plane_t {
+    texture_gradient_t uw;
+    texture_gradient_t vw;
+    texture_gradient_t w;
+};
+
+// Returns nullptr if the size is invalid or out of memory
+texture_t *texture_create(uint32_t log2_width, uint32_t log2_height);
+
+void texture_free(texture_t *texture);
+
+// Copy a linear image with the same dimensions into the texture
+void texture_load(texture_t *texture, uint32_t const *pixels, size_t pitch);
+
+static _always_inline size_t texture_offset(
+    texture_t const *texture, uint32_t x, uint32_t y)
+{
+    x &= texture->width - 1;
+    y &= texture->height - 1;
+
+    return ((y >> TEXTURE_TILE_SHIFT) <<
+            (texture->log2_width + TEXTURE_TILE_SHIFT)) |
+            ((x >> TEXTURE_TILE_SHIFT) << (TEXTURE_TILE_SHIFT * 2)) |
+            ((y & TEXTURE_TILE_MASK) << TEXTURE_TILE_SHIFT) |
+            (x & TEXTURE_TILE_MASK);
+}
+
+static _always_inline uint32_t texture_fetch(
+    texture_t const *texture, uint32_t x, uint32_t y)
+{
+    return texture->texels[texture_offset(texture, x, y)];
+}
+
+static _always_inline void texture_store(
+    texture_t *texture, uint32_t x, uint32_t y, uint32_t texel)
+{
+    texture->texels[texture_offset(texture, x, y)] = texel;
+}
+
+// A shift of 0 divides at every pixel
+void texture_set_subspan_shift(unsigned shift);
+unsigned texture_subspan_shift();
+
+// Window space vertices, with 1/w in the w component, as produced by the
+// viewport transform. Texture coordinates are 0 to 1 across the texture,
+// and wrap. Returns false if the triangle has no area
+bool texture_plane_setup(texture_plane_t *plane, texture_t const *texture,
+    vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    texcoord const *t0, texcoord const *t1, texcoord const *t2);
+
+// Texel coordinate in 16.16 fixed point. Goes through 64 bits, so large
+// coordinates wrap instead of overflowing, the fetch masks off the rest
+static _always_inline uint32_t texture_fixed(float n)
+{
+    return uint32_t(int64_t(n * 65536.0f));
+}
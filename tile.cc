@@ -0,0 +1,302 @@
+#include "tile.h"
+#include "polygon.h"
+#include "parallel.h"
+#include "malloc.h"
+#include "string.h"
+#include "likely.h"
+
+struct tile_tri_t {
+    vec4 v[3];
+
+    // Only the first is used unless shaded
+    uint32_t colors[3];
+    bool shaded;
+
+    // Null unless textured
+    texture_t const *texture;
+    texcoord t[3];
+};
+
+// List of indices into tile_tris, in submission order
+struct tile_bin_t {
+    uint32_t *tris;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+static bool tile_enabled;
+static uint32_t tile_width;
+static uint32_t tile_height;
+static uint32_t tile_cols;
+static uint32_t tile_rows;
+static tile_bin_t *tile_bins;
+
+static tile_tri_t *tile_tris;
+static size_t tile_tri_count;
+static size_t tile_tri_capacity;
+
+static bool tile_parallel_enabled = true;
+
+static void tile_free()
+{
+    size_t count = tile_cols * tile_rows;
+
+    for (size_t i = 0; tile_bins && i < count; ++i)
+        free(tile_bins[i].tris);
+
+    free(tile_bins);
+    free(tile_tris);
+
+    tile_bins = nullptr;
+    tile_tris = nullptr;
+    tile_tri_count = 0;
+    tile_tri_capacity = 0;
+    tile_cols = 0;
+    tile_rows = 0;
+    tile_enabled = false;
+}
+
+bool tile_init(uint32_t width, uint32_t height)
+{
+    tile_free();
+
+    size_t cols = (width + TILE_SIZE - 1) >> TILE_SHIFT;
+    size_t rows = (height + TILE_SIZE - 1) >> TILE_SHIFT;
+    size_t bytes = cols * rows * sizeof(tile_bin_t);
+
+    tile_bins = (tile_bin_t*)malloc(bytes);
+
+    if (unlikely(!tile_bins))
+        return false;
+
+    memset(tile_bins, 0, bytes);
+
+    tile_width = width;
+    tile_height = height;
+    tile_cols = cols;
+    tile_rows = rows;
+    tile_enabled = true;
+
+    return true;
+}
+
+void tile_set_binning(bool enable)
+{
+    // Anything already binned must be drawn before switching to immediate
+    if (tile_enabled && !enable)
+        tile_flush();
+
+    tile_enabled = enable && tile_bins;
+}
+
+bool tile_binning()
+{
+    return tile_enabled;
+}
+
+void tile_set_parallel(bool enable)
+{
+    tile_parallel_enabled = enable;
+}
+
+bool tile_parallel()
+{
+    return tile_parallel_enabled;
+}
+
+size_t tile_count()
+{
+    return tile_cols * tile_rows;
+}
+
+static bool tile_reserve_tri()
+{
+    if (likely(tile_tri_count < tile_tri_capacity))
+        return true;
+
+    size_t new_capacity = tile_tri_capacity ? tile_tri_capacity * 2 : 256;
+
+    tile_tri_t *new_tris = (tile_tri_t*)realloc(
+        tile_tris, new_capacity * sizeof(*tile_tris));
+
+    if (unlikely(!new_tris))
+        return false;
+
+    tile_tris = new_tris;
+    tile_tri_capacity = new_capacity;
+
+    return true;
+}
+
+static bool tile_reserve_bin(tile_bin_t *bin)
+{
+    if (likely(bin->count < bin->capacity))
+        return true;
+
+    uint32_t new_capacity = bin->capacity ? bin->capacity * 2 : 16;
+
+    uint32_t *new_tris = (uint32_t*)realloc(
+        bin->tris, new_capacity * sizeof(*bin->tris));
+
+    if (unlikely(!new_tris))
+        return false;
+
+    bin->tris = new_tris;
+    bin->capacity = new_capacity;
+
+    return true;
+}
+
+// One color for flat triangles, three for shaded ones
+static bool tile_bin(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t const *colors, bool shaded, texcoord const *t0,
+    texcoord const *t1, texcoord const *t2, texture_t const *texture)
+{
+    if (unlikely(!tile_enabled))
+        return false;
+
+    float minxf = v0->x < v1->x ? v0->x : v1->x;
+    float maxxf = v0->x > v1->x ? v0->x : v1->x;
+    float minyf = v0->y < v1->y ? v0->y : v1->y;
+    float maxyf = v0->y > v1->y ? v0->y : v1->y;
+
+    minxf = minxf < v2->x ? minxf : v2->x;
+    maxxf = maxxf > v2->x ? maxxf : v2->x;
+    minyf = minyf < v2->y ? minyf : v2->y;
+    maxyf = maxyf > v2->y ? maxyf : v2->y;
+
+    float w = float(tile_width);
+    float h = float(tile_height);
+
+    // Completely off the surface, nothing to draw
+    if (maxxf < 0.0f || maxyf < 0.0f || minxf >= w || minyf >= h)
+        return true;
+
+    // Clamp before converting, so huge coordinates can't overflow
+    minxf = minxf > 0.0f ? minxf : 0.0f;
+    minyf = minyf > 0.0f ? minyf : 0.0f;
+    maxxf = maxxf < w - 1.0f ? maxxf : w - 1.0f;
+    maxyf = maxyf < h - 1.0f ? maxyf : h - 1.0f;
+
+    uint32_t tx0 = uint32_t(minxf) >> TILE_SHIFT;
+    uint32_t ty0 = uint32_t(minyf) >> TILE_SHIFT;
+    uint32_t tx1 = uint32_t(maxxf) >> TILE_SHIFT;
+    uint32_t ty1 = uint32_t(maxyf) >> TILE_SHIFT;
+
+    // Make room everywhere first, so a failure leaves the bins untouched
+    if (unlikely(!tile_reserve_tri()))
+        return false;
+
+    for (uint32_t ty = ty0; ty <= ty1; ++ty) {
+        tile_bin_t *bin = tile_bins + ty * tile_cols;
+        for (uint32_t tx = tx0; tx <= tx1; ++tx) {
+            if (unlikely(!tile_reserve_bin(bin + tx)))
+                return false;
+        }
+    }
+
+    uint32_t index = tile_tri_count++;
+    tile_tri_t &tri = tile_tris[index];
+    tri.v[0] = *v0;
+    tri.v[1] = *v1;
+    tri.v[2] = *v2;
+    tri.colors[0] = colors ? colors[0] : 0;
+    tri.colors[1] = shaded ? colors[1] : 0;
+    tri.colors[2] = shaded ? colors[2] : 0;
+    tri.shaded = shaded;
+    tri.texture = texture;
+
+    if (texture) {
+        tri.t[0] = *t0;
+        tri.t[1] = *t1;
+        tri.t[2] = *t2;
+    }
+
+    for (uint32_t ty = ty0; ty <= ty1; ++ty) {
+        tile_bin_t *bin = tile_bins + ty * tile_cols;
+        for (uint32_t tx = tx0; tx <= tx1; ++tx)
+            bin[tx].tris[bin[tx].count++] = index;
+    }
+
+    return true;
+}
+
+bool tile_bin_tri(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t color)
+{
+    return tile_bin(v0, v1, v2, &color, false,
+            nullptr, nullptr, nullptr, nullptr);
+}
+
+bool tile_bin_tri_shaded(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t c0, uint32_t c1, uint32_t c2)
+{
+    uint32_t colors[3] = { c0, c1, c2 };
+
+    return tile_bin(v0, v1, v2, colors, true,
+            nullptr, nullptr, nullptr, nullptr);
+}
+
+bool tile_bin_tri_tex(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    texcoord const *t0, texcoord const *t1, texcoord const *t2,
+    texture_t const *texture)
+{
+    return tile_bin(v0, v1, v2, nullptr, false, t0, t1, t2, texture);
+}
+
+void tile_render(size_t index)
+{
+    tile_bin_t const &bin = tile_bins[index];
+
+    int tx = int(index % tile_cols) << TILE_SHIFT;
+    int ty = int(index / tile_cols) << TILE_SHIFT;
+
+    render_rect_t clip{
+        tx,
+        ty,
+        tx + TILE_SIZE < tile_width ? tx + int(TILE_SIZE) : int(tile_width),
+        ty + TILE_SIZE < tile_height ? ty + int(TILE_SIZE) : int(tile_height)
+    };
+
+    for (uint32_t i = 0; i < bin.count; ++i) {
+        tile_tri_t const &tri = tile_tris[bin.tris[i]];
+
+        if (tri.texture) {
+            draw_tri_ccw_tex_rect(tri.v, tri.v + 1, tri.v + 2,
+                    tri.t, tri.t + 1, tri.t + 2, tri.texture, clip);
+        } else if (tri.shaded) {
+            draw_tri_ccw_shaded_rect(tri.v, tri.v + 1, tri.v + 2,
+                    tri.colors[0], tri.colors[1], tri.colors[2], clip);
+        } else {
+            draw_tri_ccw_rect(tri.v, tri.v + 1, tri.v + 2,
+                    tri.colors[0], clip);
+        }
+    }
+}
+
+static void tile_render_range(void *, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i)
+        tile_render(i);
+}
+
+void tile_flush()
+{
+    // Nothing binned, as for each fixed point triangle drawn in a row
+    if (!tile_tri_count)
+        return;
+
+    size_t count = tile_count();
+
+    if (tile_parallel_enabled && parallel_cpu_count() > 1) {
+        parallel_for(0, count, 1, tile_render_range, nullptr);
+    } else {
+        for (size_t i = 0; i < count; ++i)
+            tile_render(i);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        tile_bins[i].count = 0;
+
+    tile_tri_count = 0;
+}
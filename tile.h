@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "vec.h"
+
+struct texture_t;
+
+// Triangles are sorted into fixed size screen tiles, then each tile is
+// rasterized to completion before moving to the next one, so the tile's
+// pixels stay in cache, and each tile is an independent unit of work
+
+static constexpr unsigned TILE_SHIFT = 6;
+static constexpr unsigned TILE_SIZE = 1U << TILE_SHIFT;
+
+// Allocate bins for a surface of the given size, enables binning
+bool tile_init(uint32_t width, uint32_t height);
+
+void tile_set_binning(bool enable);
+bool tile_binning();
+
+// When enabled, tile_flush hands the tiles out to every CPU,
+// see parallel.h. Enabled by default
+void tile_set_parallel(bool enable);
+bool tile_parallel();
+
+// Returns false if the triangle could not be binned,
+// the caller should draw it immediately instead
+bool tile_bin_tri(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t color);
+
+// Same as tile_bin_tri, for draw_tri_ccw_shaded
+bool tile_bin_tri_shaded(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    uint32_t c0, uint32_t c1, uint32_t c2);
+
+// Same as tile_bin_tri, for draw_tri_ccw_tex
+bool tile_bin_tri_tex(vec4 const *v0, vec4 const *v1, vec4 const *v2,
+    texcoord const *t0, texcoord const *t1, texcoord const *t2,
+    texture_t const *texture);
+
+size_t tile_count();
+
+// Rasterize every triangle binned into one tile, in submission order
+void tile_render(size_t index);
+
+// Rasterize every tile, then empty the bins for the next frame.
+// Tiles cover disjoint pixels, depth blocks and dirty tiles,
+// so they can be drawn in any order, on any CPU
+void tile_flush();
@@ -1,7 +1,38 @@
 #pragma once
 
+#include "compiler.h"
 #include "math/math.h"
 
+// vec4 and the rows of mat4x4 are operated on as 16 byte vectors, which
+// lower to SSE on x86, NEON on aarch64, AltiVec on ppc built with it,
+// and to scalar code where there is no vector unit
+typedef float vec_v4sf _vector_size(16);
+typedef int32_t vec_v4si _vector_size(16);
+
+// Only 4 byte aligned in memory, keeping the layout of vec4 and vertex
+typedef vec_v4sf vec_v4sf_u _aligned(4) __attribute__((__may_alias__));
+
+// Vectors are only passed between inline functions, the build turns
+// -Wpsabi off for that, see CXX_FLAGS_COMMON in the Makefile
+
+#ifdef __clang__
+#define vec_shuffle(a, b, i0, i1, i2, i3) \
+    __builtin_shufflevector((a), (b), i0, i1, i2, i3)
+#else
+#define vec_shuffle(a, b, i0, i1, i2, i3) \
+    __builtin_shuffle((a), (b), vec_v4si{ i0, i1, i2, i3 })
+#endif
+
+static _always_inline vec_v4sf vec_load(float const *p)
+{
+    return *(vec_v4sf_u const *)p;
+}
+
+static _always_inline void vec_store(float *p, vec_v4sf v)
+{
+    *(vec_v4sf_u *)p = v;
+}
+
 struct texcoord {
     float u, v;
 
@@ -48,116 +79,91 @@ struct vec4 {
 
     constexpr vec4 &operator=(vec4 const& rhs) = default;
 
+    _always_inline vec_v4sf simd() const
+    {
+        return vec_load(&x);
+    }
+
+    static _always_inline vec4 from_simd(vec_v4sf v)
+    {
+        vec4 result;
+        vec_store(&result.x, v);
+        return result;
+    }
+
     vec4 operator+(vec4 const& rhs) const
     {
-        return {
-            x + rhs.x,
-            y + rhs.y,
-            z + rhs.z,
-            w + rhs.w
-        };
+        return from_simd(simd() + rhs.simd());
     }
 
     vec4 &operator+=(vec4 const& rhs)
     {
-        x += rhs.x;
-        y += rhs.y;
-        z += rhs.z;
-        w += rhs.w;
+        vec_store(&x, simd() + rhs.simd());
         return *this;
     }
 
     vec4 operator-(vec4 const& rhs) const
     {
-        return {
-            x - rhs.x,
-            y - rhs.y,
-            z - rhs.z,
-            w - rhs.w
-        };
+        return from_simd(simd() - rhs.simd());
     }
 
     vec4 &operator-=(vec4 const& rhs)
     {
-        x -= rhs.x;
-        y -= rhs.y;
-        z -= rhs.z;
-        w -= rhs.w;
+        vec_store(&x, simd() - rhs.simd());
         return *this;
     }
 
     vec4 operator*(vec4 const& rhs) const
     {
-        return {
-            x * rhs.x,
-            y * rhs.y,
-            z * rhs.z,
-            w * rhs.w
-        };
+        return from_simd(simd() * rhs.simd());
     }
 
     vec4 &operator*=(vec4 const& rhs)
     {
-        x *= rhs.x;
-        y *= rhs.y;
-        z *= rhs.z;
-        w *= rhs.w;
+        vec_store(&x, simd() * rhs.simd());
         return *this;
     }
 
     vec4 operator*(float rhs) const
     {
-        return {
-            x * rhs,
-            y * rhs,
-            z * rhs,
-            w * rhs
-        };
+        return from_simd(simd() * rhs);
     }
 
     vec4 &operator*=(float rhs)
     {
-        x *= rhs;
-        y *= rhs;
-        z *= rhs;
-        w *= rhs;
+        vec_store(&x, simd() * rhs);
         return *this;
     }
 
     vec4 operator/(float rhs) const
     {
-        rhs = 1.0f / rhs;
-        return {
-            x * rhs,
-            y * rhs,
-            z * rhs,
-            w * rhs
-        };
+        return from_simd(simd() * (1.0f / rhs));
     }
 
     vec4 &operator/=(float rhs)
     {
-        rhs = 1.0f / rhs;
-        x *= rhs;
-        y *= rhs;
-        z *= rhs;
-        w *= rhs;
+        vec_store(&x, simd() * (1.0f / rhs));
         return *this;
     }
 
     vec4 cross(vec4 const& rhs) const
     {
-        return {
-            y * rhs.z - z * rhs.y,
-            z * rhs.x - x * rhs.z,
-            x * rhs.y - y * rhs.x,
-            0
-        };
+        vec_v4sf a = simd();
+        vec_v4sf b = rhs.simd();
+
+        // yzx * zxy - zxy * yzx, w ends up 0
+        vec_v4sf a_yzx = vec_shuffle(a, a, 1, 2, 0, 3);
+        vec_v4sf b_yzx = vec_shuffle(b, b, 1, 2, 0, 3);
+        vec_v4sf r = a * b_yzx - a_yzx * b;
+
+        return from_simd(vec_shuffle(r, r, 1, 2, 0, 3));
     }
 
+    // Of x, y and z
     float dot(vec4 const& rhs) const
     {
-        return x * rhs.x + y * rhs.y + z;
+        vec_v4sf p = simd() * rhs.simd();
+        return p[0] + p[1] + p[2];
     }
 
     float sq_len() const
@@ -170,6 +176,7 @@ struct vec4 {
         return sqrtf(sq_len());
     }
 
+    // Hardware estimate and Newton steps, see math/fastmath.h
     float recip_len() const
     {
         return rsqrtf(sq_len());
@@ -177,33 +184,17 @@ struct vec4 {
 
     vec4 &normalize()
     {
-        float rl = 1.0f / len();
-        x *= rl;
-        y *= rl;
-        z *= rl;
-        w *= rl;
-        return *this;
+        return *this *= 1.0f / len();
     }
 
     vec4 &normalize_fast()
     {
-        float rl = recip_len();
-        x *= rl;
-        y *= rl;
-        z *= rl;
-        w *= rl;
-        return *this;
+        return *this *= recip_len();
     }
 
     vec4 normalized_fast() const
     {
-        float rl = recip_len();
-        return {
-            x * rl,
-            y * rl,
-            z * rl,
-            w * rl
-        };
+        return *this * recip_len();
     }
     
     // 0=x, 1=-x, 2=y, 3=-y, 4=z, 5=-z
@@ -276,50 +267,47 @@ struct mat4x4 {
     {
     }
 
+    _always_inline vec_v4sf row(size_t i) const
+    {
+        return vec_load(m[i]);
+    }
+
+    // Each row of the result is the rows of rhs weighted by a row of this
     mat4x4 mul(mat4x4 const& rhs) const
     {
-        return {
-            {
-                m[0][0]*rhs.m[0][0] + m[0][1]*rhs.m[1][0] +
-                m[0][2]*rhs.m[2][0] + m[0][3]*rhs.m[3][0],
-                m[0][0]*rhs.m[0][1] + m[0][1]*rhs.m[1][1] +
-                m[0][2]*rhs.m[2][1] + m[0][3]*rhs.m[3][1],
-                m[0][0]*rhs.m[0][2] + m[0][1]*rhs.m[1][2] +
-                m[0][2]*rhs.m[2][2] + m[0][3]*rhs.m[3][2],
-                m[0][0]*rhs.m[0][3] + m[0][1]*rhs.m[1][3] +
-                m[0][2]*rhs.m[2][3] + m[0][3]*rhs.m[3][3]
-            },
-            {
-                m[1][0]*rhs.m[0][0] + m[1][1]*rhs.m[1][0] +
-                m[1][2]*rhs.m[2][0] + m[1][3]*rhs.m[3][0],
-                m[1][0]*rhs.m[0][1] + m[1][1]*rhs.m[1][1] +
-                m[1][2]*rhs.m[2][1] + m[1][3]*rhs.m[3][1],
-                m[1][0]*rhs.m[0][2] + m[1][1]*rhs.m[1][2] +
-                m[1][2]*rhs.m[2][2] + m[1][3]*rhs.m[3][2],
-                m[1][0]*rhs.m[0][3] + m[1][1]*rhs.m[1][3] +
-                m[1][2]*rhs.m[2][3] + m[1][3]*rhs.m[3][3]
-            },
-            {
-                m[2][0]*rhs.m[0][0] + m[2][1]*rhs.m[1][0] +
-                m[2][2]*rhs.m[2][0] + m[2][3]*rhs.m[3][0],
-                m[2][0]*rhs.m[0][1] + m[2][1]*rhs.m[1][1] +
-                m[2][2]*rhs.m[2][1] + m[2][3]*rhs.m[3][1],
-                m[2][0]*rhs.m[0][2] + m[2][1]*rhs.m[1][2] +
-                m[2][2]*rhs.m[2][2] + m[2][3]*rhs.m[3][2],
-                m[2][0]*rhs.m[0][3] + m[2][1]*rhs.m[1][3] +
-                m[2][2]*rhs.m[2][3] + m[2][3]*rhs.m[3][3]
-            },
-            {
-                m[3][0]*rhs.m[0][0] + m[3][1]*rhs.m[1][0] +
-                m[3][2]*rhs.m[2][0] + m[3][3]*rhs.m[3][0],
-                m[3][0]*rhs.m[0][1] + m[3][1]*rhs.m[1][1] +
-                m[3][2]*rhs.m[2][1] + m[3][3]*rhs.m[3][1],
-                m[3][0]*rhs.m[0][2] + m[3][1]*rhs.m[1][2] +
-                m[3][2]*rhs.m[2][2] + m[3][3]*rhs.m[3][2],
-                m[3][0]*rhs.m[0][3] + m[3][1]*rhs.m[1][3] +
-                m[3][2]*rhs.m[2][3] + m[3][3]*rhs.m[3][3]
-            }
-        };
+        vec_v4sf r0 = rhs.row(0);
+        vec_v4sf r1 = rhs.row(1);
+        vec_v4sf r2 = rhs.row(2);
+        vec_v4sf r3 = rhs.row(3);
+
+        mat4x4 result;
+
+        for (size_t i = 0; i < 4; ++i) {
+            vec_store(result.m[i], r0 * m[i][0] + r1 * m[i][1] +
+                    r2 * m[i][2] + r3 * m[i][3]);
+        }
+
+        return result;
+    }
+
+    // Columns as vectors
+    _always_inline void columns(vec_v4sf *c0, vec_v4sf *c1,
+        vec_v4sf *c2, vec_v4sf *c3) const
+    {
+        vec_v4sf r0 = row(0);
+        vec_v4sf r1 = row(1);
+        vec_v4sf r2 = row(2);
+        vec_v4sf r3 = row(3);
+
+        vec_v4sf t0 = vec_shuffle(r0, r1, 0, 4, 1, 5);
+        vec_v4sf t1 = vec_shuffle(r2, r3, 0, 4, 1, 5);
+        vec_v4sf t2 = vec_shuffle(r0, r1, 2, 6, 3, 7);
+        vec_v4sf t3 = vec_shuffle(r2, r3, 2, 6, 3, 7);
+
+        *c0 = vec_shuffle(t0, t1, 0, 1, 4, 5);
+        *c1 = vec_shuffle(t0, t1, 2, 3, 6, 7);
+        *c2 = vec_shuffle(t2, t3, 0, 1, 4, 5);
+        *c3 = vec_shuffle(t2, t3, 2, 3, 6, 7);
     }
 
     mat4x4 operator*(mat4x4 const& rhs) const
@@ -329,12 +317,16 @@ struct mat4x4 {
 
     mat4x4 transposed() const
     {
-        return {
-            { m[0][0], m[1][0], m[2][0], m[3][0] },
-            { m[0][1], m[1][1], m[2][1], m[3][1] },
-            { m[0][2], m[1][2], m[2][2], m[3][2] },
-            { m[0][3], m[1][3], m[2][3], m[3][3] }
-        };
+        vec_v4sf c0, c1, c2, c3;
+        columns(&c0, &c1, &c2, &c3);
+
+        mat4x4 result;
+        vec_store(result.m[0], c0);
+        vec_store(result.m[1], c1);
+        vec_store(result.m[2], c2);
+        vec_store(result.m[3], c3);
+
+        return result;
     }
 
     float determinant() const noexcept
@@ -367,11 +359,26 @@ struct mat4x4 {
             + (m[0][0] * m[1][1] * m[2][2] * m[3][3]);
     }
 
-    // Compute fully arbitrary inverse matrix
-    // (264 multiplies, 103 adds, but there are many common subexpressions)
+    // Compute fully arbitrary inverse matrix, by cofactors, from the
+    // 2x2 determinants of the top two rows (s) and bottom two rows (c)
     mat4x4 inverse() const noexcept
     {
-        float det = determinant();
+        float s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+        float s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+        float s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+        float s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+        float s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+        float s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+
+        float c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+        float c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+        float c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+        float c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+        float c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+        float c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+
+        float det = s0 * c5 - s1 * c4 + s2 * c3 +
+                s3 * c2 - s4 * c1 + s5 * c0;
 
         assert(det != 0.0f);
 
@@ -380,143 +387,29 @@ struct mat4x4 {
 
         det = 1.0f / det;
 
-        // 192 multiplies, 80 adds
+        // Column j, in the order rows 1, 0, 3, 2
+        vec_v4sf k0 = { m[1][0], m[0][0], m[3][0], m[2][0] };
+        vec_v4sf k1 = { m[1][1], m[0][1], m[3][1], m[2][1] };
+        vec_v4sf k2 = { m[1][2], m[0][2], m[3][2], m[2][2] };
+        vec_v4sf k3 = { m[1][3], m[0][3], m[3][3], m[2][3] };
 
-        return {
-            {
-                det * (
-                      (m[1][2]*m[2][3]*m[3][1])
-                    - (m[1][3]*m[2][2]*m[3][1])
-                    + (m[1][3]*m[2][1]*m[3][2])
-                    - (m[1][1]*m[2][3]*m[3][2])
-                    - (m[1][2]*m[2][1]*m[3][3])
-                    + (m[1][1]*m[2][2]*m[3][3])
-                ),
-                det * (
-                      (m[0][3]*m[2][2]*m[3][1])
-                    - (m[0][2]*m[2][3]*m[3][1])
-                    - (m[0][3]*m[2][1]*m[3][2])
-                    + (m[0][1]*m[2][3]*m[3][2])
-                    + (m[0][2]*m[2][1]*m[3][3])
-                    - (m[0][1]*m[2][2]*m[3][3])
-                ),
-                det * (
-                      (m[0][2]*m[1][3]*m[3][1])
-                    - (m[0][3]*m[1][2]*m[3][1])
-                    + (m[0][3]*m[1][1]*m[3][2])
-                    - (m[0][1]*m[1][3]*m[3][2])
-                    - (m[0][2]*m[1][1]*m[3][3])
-                    + (m[0][1]*m[1][2]*m[3][3])
-                ),
-                det * (
-                      (m[0][3]*m[1][2]*m[2][1])
-                    - (m[0][2]*m[1][3]*m[2][1])
-                    - (m[0][3]*m[1][1]*m[2][2])
-                    + (m[0][1]*m[1][3]*m[2][2])
-                    + (m[0][2]*m[1][1]*m[2][3])
-                    - (m[0][1]*m[1][2]*m[2][3])
-                )
-            }, {
-                det * (
-                      (m[1][3]*m[2][2]*m[3][0])
-                    - (m[1][2]*m[2][3]*m[3][0])
-                    - (m[1][3]*m[2][0]*m[3][2])
-                    + (m[1][0]*m[2][3]*m[3][2])
-                    + (m[1][2]*m[2][0]*m[3][3])
-                    - (m[1][0]*m[2][2]*m[3][3])
-                ),
-                det * (
-                      (m[0][2]*m[2][3]*m[3][0])
-                    - (m[0][3]*m[2][2]*m[3][0])
-                    + (m[0][3]*m[2][0]*m[3][2])
-                    - (m[0][0]*m[2][3]*m[3][2])
-                    - (m[0][2]*m[2][0]*m[3][3])
-                    + (m[0][0]*m[2][2]*m[3][3])
-                ),
-                det * (
-                      (m[0][3]*m[1][2]*m[3][0])
-                    - (m[0][2]*m[1][3]*m[3][0])
-                    - (m[0][3]*m[1][0]*m[3][2])
-                    + (m[0][0]*m[1][3]*m[3][2])
-                    + (m[0][2]*m[1][0]*m[3][3])
-                    - (m[0][0]*m[1][2]*m[3][3])
-                ),
-                det * (
-                      (m[0][2]*m[1][3]*m[2][0])
-                    - (m[0][3]*m[1][2]*m[2][0])
-                    + (m[0][3]*m[1][0]*m[2][2])
-                    - (m[0][0]*m[1][3]*m[2][2])
-                    - (m[0][2]*m[1][0]*m[2][3])
-                    + (m[0][0]*m[1][2]*m[2][3])
-                )
-            }, {
-                det * (
-                      (m[1][1]*m[2][3]*m[3][0])
-                    - (m[1][3]*m[2][1]*m[3][0])
-                    + (m[1][3]*m[2][0]*m[3][1])
-                    - (m[1][0]*m[2][3]*m[3][1])
-                    - (m[1][1]*m[2][0]*m[3][3])
-                    + (m[1][0]*m[2][1]*m[3][3])
-                ),
-                det * (
-                      (m[0][3]*m[2][1]*m[3][0])
-                    - (m[0][1]*m[2][3]*m[3][0])
-                    - (m[0][3]*m[2][0]*m[3][1])
-                    + (m[0][0]*m[2][3]*m[3][1])
-                    + (m[0][1]*m[2][0]*m[3][3])
-                    - (m[0][0]*m[2][1]*m[3][3])
-                ),
-                det * (
-                      (m[0][1]*m[1][3]*m[3][0])
-                    - (m[0][3]*m[1][1]*m[3][0])
-                    + (m[0][3]*m[1][0]*m[3][1])
-                    - (m[0][0]*m[1][3]*m[3][1])
-                    - (m[0][1]*m[1][0]*m[3][3])
-                    + (m[0][0]*m[1][1]*m[3][3])
-                ),
-                det * (
-                      (m[0][3]*m[1][1]*m[2][0])
-                    - (m[0][1]*m[1][3]*m[2][0])
-                    - (m[0][3]*m[1][0]*m[2][1])
-                    + (m[0][0]*m[1][3]*m[2][1])
-                    + (m[0][1]*m[1][0]*m[2][3])
-                    - (m[0][0]*m[1][1]*m[2][3])
-                )
-            }, {
-                det * (
-                      (m[1][2]*m[2][1]*m[3][0])
-                    - (m[1][1]*m[2][2]*m[3][0])
-                    - (m[1][2]*m[2][0]*m[3][1])
-                    + (m[1][0]*m[2][2]*m[3][1])
-                    + (m[1][1]*m[2][0]*m[3][2])
-                    - (m[1][0]*m[2][1]*m[3][2])
-                ),
-                det * (
-                      (m[0][1]*m[2][2]*m[3][0])
-                    - (m[0][2]*m[2][1]*m[3][0])
-                    + (m[0][2]*m[2][0]*m[3][1])
-                    - (m[0][0]*m[2][2]*m[3][1])
-                    - (m[0][1]*m[2][0]*m[3][2])
-                    + (m[0][0]*m[2][1]*m[3][2])
-                ),
-                det * (
-                      (m[0][2]*m[1][1]*m[3][0])
-                    - (m[0][1]*m[1][2]*m[3][0])
-                    - (m[0][2]*m[1][0]*m[3][1])
-                    + (m[0][0]*m[1][2]*m[3][1])
-                    + (m[0][1]*m[1][0]*m[3][2])
-                    - (m[0][0]*m[1][1]*m[3][2])
-                ),
-                det * (
-                      (m[0][1]*m[1][2]*m[2][0])
-                    - (m[0][2]*m[1][1]*m[2][0])
-                    + (m[0][2]*m[1][0]*m[2][1])
-                    - (m[0][0]*m[1][2]*m[2][1])
-                    - (m[0][1]*m[1][0]*m[2][2])
-                    + (m[0][0]*m[1][1]*m[2][2])
-                )
-            }
-        };
+        // Cofactors of rows 0 and 1 come from c, of rows 2 and 3 from s
+        vec_v4sf p0 = { c0, c0, s0, s0 };
+        vec_v4sf p1 = { c1, c1, s1, s1 };
+        vec_v4sf p2 = { c2, c2, s2, s2 };
+        vec_v4sf p3 = { c3, c3, s3, s3 };
+        vec_v4sf p4 = { c4, c4, s4, s4 };
+        vec_v4sf p5 = { c5, c5, s5, s5 };
+
+        vec_v4sf sign = { det, -det, det, -det };
+
+        mat4x4 result;
+        vec_store(result.m[0], (k1 * p5 - k2 * p4 + k3 * p3) * sign);
+        vec_store(result.m[1], (k2 * p2 - k0 * p5 - k3 * p1) * sign);
+        vec_store(result.m[2], (k0 * p4 - k1 * p2 + k3 * p0) * sign);
+        vec_store(result.m[3], (k1 * p1 - k0 * p3 - k2 * p0) * sign);
+
+        return result;
     }
 
     float determinant_simple() const noexcept
@@ -741,18 +634,16 @@ struct mat4x4 {
         };
     }
 
+    // Each result is the columns weighted by x, y, z, and w taken as 1
     void transform(vec4 *dst, vec4 *src, size_t count) const
     {
+        vec_v4sf c0, c1, c2, c3;
+        columns(&c0, &c1, &c2, &c3);
+
         for (size_t i = 0; i < count; ++i) {
-            vec4 p = src[i];
-            p.w = 1.0f;
-            p = {
-                p.x * m[0][0] + p.y * m[0][1] + p.z * m[0][2] + p.w * m[0][3],
-                p.x * m[1][0] + p.y * m[1][1] + p.z * m[1][2] + p.w * m[1][3],
-                p.x * m[2][0] + p.y * m[2][1] + p.z * m[2][2] + p.w * m[2][3],
-                p.x * m[3][0] + p.y * m[3][1] + p.z * m[3][2] + p.w * m[3][3]
-            };
-            dst[i] = p;
+            vec_v4sf p = src[i].simd();
+            dst[i] = vec4::from_simd(c0 * p[0] + c1 * p[1] +
+                    c2 * p[2] + c3);
         }
     }
 };
@@ -864,15 +755,15 @@ public:
             row2 = p - lookAt;
         }
 
-        row2.normalize();
+        row2.normalize_fast();
 
         // Calculate the right vector from the up and back vector
         row0 = up.cross(row2);
-        row0.normalize();
+        row0.normalize_fast();
 
         // Calculate the up vector from the back and right vector
         row1 = row2.cross(row0);
-        row1.normalize();
+        row1.normalize_fast();
 
         return from_dirs_and_pos(row0, row1, row2, p);
     }
@@ -0,0 +1,421 @@
+#pragma once
+
+#include "vec.h"
+#include "math/fixed.h"
+
+// vec4 and mat4x4 in 16.16 fixed point, with the same members, for
+// targets where float is emulated. render_viewport and draw_tri_ccw take
+// these too, so a triangle goes from object space to pixels with integer
+// arithmetic only. Rotations take their sines from 2.30, see math/fixed.h
+// This is a side path, for render_polygon and bench_fixed. draw_indexed,
+// cmdbuf, depth and binning take vec4 and mat4x4 in every build
+
+struct vec4x {
+    fix16_t x, y, z, w;
+
+    constexpr vec4x() : x(), y(), z(), w() {}
+
+    constexpr vec4x(fix16_t x, fix16_t y, fix16_t z, fix16_t w = 1)
+        : x(x), y(y), z(z), w(w) {}
+
+    constexpr explicit vec4x(fix16_t n)
+        : x(n), y(n), z(n), w(n) {}
+
+    // Rounded to nearest, float math
+    static constexpr vec4x from_float(vec4 const& v)
+    {
+        return { fix16_t(v.x), fix16_t(v.y), fix16_t(v.z), fix16_t(v.w) };
+    }
+
+    constexpr vec4 to_float() const
+    {
+        return { x.to_float(), y.to_float(), z.to_float(), w.to_float() };
+    }
+
+    vec4x operator+(vec4x const& rhs) const
+    {
+        return { x + rhs.x, y + rhs.y, z + rhs.z, w + rhs.w };
+    }
+
+    vec4x &operator+=(vec4x const& rhs)
+    {
+        return *this = *this + rhs;
+    }
+
+    vec4x operator-(vec4x const& rhs) const
+    {
+        return { x - rhs.x, y - rhs.y, z - rhs.z, w - rhs.w };
+    }
+
+    vec4x &operator-=(vec4x const& rhs)
+    {
+        return *this = *this - rhs;
+    }
+
+    vec4x operator*(vec4x const& rhs) const
+    {
+        return { x * rhs.x, y * rhs.y, z * rhs.z, w * rhs.w };
+    }
+
+    vec4x &operator*=(vec4x const& rhs)
+    {
+        return *this = *this * rhs;
+    }
+
+    vec4x operator*(fix16_t rhs) const
+    {
+        return { x * rhs, y * rhs, z * rhs, w * rhs };
+    }
+
+    vec4x &operator*=(fix16_t rhs)
+    {
+        return *this = *this * rhs;
+    }
+
+    // Divides each, a reciprocal would lose the low bits of large rhs
+    vec4x operator/(fix16_t rhs) const
+    {
+        return { x / rhs, y / rhs, z / rhs, w / rhs };
+    }
+
+    vec4x &operator/=(fix16_t rhs)
+    {
+        return *this = *this / rhs;
+    }
+
+    // a0 * b0 - a1 * b1 in 64 bits, rounded once
+    static _always_inline fix16_t diff_products(
+            fix16_t a0, fix16_t b0, fix16_t a1, fix16_t b1)
+    {
+        int64_t diff = int64_t(a0.raw) * b0.raw - int64_t(a1.raw) * b1.raw;
+
+        return fix16_t::from_raw(int32_t((diff + (fix16_t::ONE >> 1)) >>
+                fix16_t::FRAC_BITS));
+    }
+
+    // w ends up 0
+    vec4x cross(vec4x const& rhs) const
+    {
+        return {
+            diff_products(y, rhs.z, z, rhs.y),
+            diff_products(z, rhs.x, x, rhs.z),
+            diff_products(x, rhs.y, y, rhs.x),
+            0
+        };
+    }
+
+    // Of x, y and z, rounded once
+    fix16_t dot(vec4x const& rhs) const
+    {
+        int64_t sum = int64_t(x.raw) * rhs.x.raw +
+                int64_t(y.raw) * rhs.y.raw +
+                int64_t(z.raw) * rhs.z.raw;
+
+        return fix16_t::from_raw(int32_t((sum + (fix16_t::ONE >> 1)) >>
+                fix16_t::FRAC_BITS));
+    }
+
+    // Overflows past a length of 181
+    fix16_t sq_len() const
+    {
+        return dot(*this);
+    }
+
+    // From the exact sum of squares, any length in range
+    fix16_t len() const
+    {
+        uint64_t sum = uint64_t(int64_t(x.raw) * x.raw) +
+                uint64_t(int64_t(y.raw) * y.raw) +
+                uint64_t(int64_t(z.raw) * z.raw);
+
+        return fix16_t::from_raw(int32_t(fix_isqrt64(sum)));
+    }
+
+    fix16_t recip_len() const
+    {
+        return fix16_t(1) / len();
+    }
+
+    vec4x &normalize()
+    {
+        return *this /= len();
+    }
+
+    // There is no estimate to take in fixed point
+    vec4x &normalize_fast()
+    {
+        return normalize();
+    }
+
+    vec4x normalized_fast() const
+    {
+        return *this / len();
+    }
+
+    // 0=x, 1=-x, 2=y, 3=-y, 4=z, 5=-z
+    fix16_t dot_clip_plane(int plane) const
+    {
+        switch (plane) {
+        case 0: return  x + w;
+        case 1: return -x + w;
+        case 2: return  y + w;
+        case 3: return -y + w;
+        case 4: return  z + w;
+        case 5: return -z + w;
+        }
+        return 0;
+    }
+
+    int outcode() const
+    {
+        int result = 0;
+
+        for (size_t plane = 0; plane < 6; ++plane)
+            result |= (dot_clip_plane(plane) < fix16_t()) << plane;
+
+        return result;
+    }
+};
+
+struct mat4x4x {
+    fix16_t m[4][4];
+
+    constexpr mat4x4x()
+        : m{
+            { 1, 0, 0, 0 },
+            { 0, 1, 0, 0 },
+            { 0, 0, 1, 0 },
+            { 0, 0, 0, 1 }
+        }
+    {
+    }
+
+    constexpr mat4x4x(fix16_t const (&rhs)[4][4])
+        : m{
+            { rhs[0][0], rhs[0][1], rhs[0][2], rhs[0][3] },
+            { rhs[1][0], rhs[1][1], rhs[1][2], rhs[1][3] },
+            { rhs[2][0], rhs[2][1], rhs[2][2], rhs[2][3] },
+            { rhs[3][0], rhs[3][1], rhs[3][2], rhs[3][3] }
+        }
+    {
+    }
+
+    // Rows, there is no constructor from vec4x rows, braced
+    // rows would convert to either
+    constexpr mat4x4x(fix16_t const (&a)[4], fix16_t const (&b)[4],
+            fix16_t const (&c)[4], fix16_t const (&d)[4])
+        : m{
+            { a[0], a[1], a[2], a[3] },
+            { b[0], b[1], b[2], b[3] },
+            { c[0], c[1], c[2], c[3] },
+            { d[0], d[1], d[2], d[3] }
+        }
+    {
+    }
+
+    // Rounded to nearest, float math
+    static mat4x4x from_float(mat4x4 const& rhs)
+    {
+        mat4x4x result;
+
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t k = 0; k < 4; ++k)
+                result.m[i][k] = fix16_t(rhs.m[i][k]);
+        }
+
+        return result;
+    }
+
+    mat4x4 to_float() const
+    {
+        mat4x4 result;
+
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t k = 0; k < 4; ++k)
+                result.m[i][k] = m[i][k].to_float();
+        }
+
+        return result;
+    }
+
+    // Row i of this weighted by (x, y, z, w), summed in 64 bits
+    _always_inline fix16_t row_dot(size_t i, fix16_t x, fix16_t y,
+            fix16_t z, fix16_t w) const
+    {
+        int64_t sum = int64_t(m[i][0].raw) * x.raw +
+                int64_t(m[i][1].raw) * y.raw +
+                int64_t(m[i][2].raw) * z.raw +
+                int64_t(m[i][3].raw) * w.raw;
+
+        return fix16_t::from_raw(int32_t((sum + (fix16_t::ONE >> 1)) >>
+                fix16_t::FRAC_BITS));
+    }
+
+    // Each row of the result is the rows of rhs weighted by a row of this
+    mat4x4x mul(mat4x4x const& rhs) const
+    {
+        mat4x4x result;
+
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t k = 0; k < 4; ++k) {
+                result.m[i][k] = row_dot(i, rhs.m[0][k], rhs.m[1][k],
+                        rhs.m[2][k], rhs.m[3][k]);
+            }
+        }
+
+        return result;
+    }
+
+    mat4x4x operator*(mat4x4x const& rhs) const
+    {
+        return mul(rhs);
+    }
+
+    mat4x4x transposed() const
+    {
+        mat4x4x result;
+
+        for (size_t i = 0; i < 4; ++i) {
+            for (size_t k = 0; k < 4; ++k)
+                result.m[i][k] = m[k][i];
+        }
+
+        return result;
+    }
+
+    static mat4x4x rotate_axis(vec4x const& axis, fix16_t angleRads)
+    {
+        fix30_t s30, c30;
+        fix_sincos(angleRads, &s30, &c30);
+
+        fix16_t c = c30;
+        fix16_t t = fix16_t(1) - c;
+        vec4x sv = axis * fix16_t(s30);
+        vec4x tv = axis * t;
+
+        return {
+            {
+                tv.x * axis.x + c,      // txx + c
+                tv.x * axis.y - sv.z,   // txy - sz
+                tv.x * axis.z + sv.y,   // txz + sy
+                0
+            }, {
+                tv.x * axis.y + sv.z,   // txy + sz
+                tv.y * axis.y + c,      // tyy + c
+                tv.y * axis.z - sv.x,   // tyz - sx
+                0
+            }, {
+                tv.x * axis.z - sv.y,   // txz - sy
+                tv.y * axis.z + sv.x,   // tyz + sx
+                tv.z * axis.z + c,      // tzz + c
+                0
+            }, {
+                0, 0, 0, 1
+            }
+        };
+    }
+
+    static constexpr mat4x4x scale4(fix16_t x, fix16_t y,
+            fix16_t z, fix16_t w)
+    {
+        return {
+            { x, 0, 0, 0 },
+            { 0, y, 0, 0 },
+            { 0, 0, z, 0 },
+            { 0, 0, 0, w }
+        };
+    }
+
+    static constexpr mat4x4x scale(fix16_t s)
+    {
+        return {
+            { s, 0, 0, 0 },
+            { 0, s, 0, 0 },
+            { 0, 0, s, 0 },
+            { 0, 0, 0, 1 }
+        };
+    }
+
+    static mat4x4x rotate_x(fix16_t a)
+    {
+        fix30_t s, c;
+        fix_sincos(a, &s, &c);
+        return {
+            { 1, 0, 0, 0 },
+            { 0, c, -s, 0 },
+            { 0, s, c, 0 },
+            { 0, 0, 0, 1 }
+        };
+    }
+
+    static mat4x4x rotate_y(fix16_t a)
+    {
+        fix30_t s, c;
+        fix_sincos(a, &s, &c);
+        return {
+            { c, 0, s, 0 },
+            { 0, 1, 0, 0 },
+            { -s, 0, c, 0 },
+            { 0, 0, 0, 1 }
+        };
+    }
+
+    static mat4x4x rotate_z(fix16_t a)
+    {
+        fix30_t s, c;
+        fix_sincos(a, &s, &c);
+        return {
+            { c, -s, 0, 0 },
+            { s, c, 0, 0 },
+            { 0, 0, 1, 0 },
+            { 0, 0, 0, 1 }
+        };
+    }
+
+    static constexpr mat4x4x translate(vec4x const& v)
+    {
+        return {
+            { 1, 0, 0, v.x },
+            { 0, 1, 0, v.y },
+            { 0, 0, 1, v.z },
+            { 0, 0, 0, 1 }
+        };
+    }
+
+    // As mat4x4::perspective, f * n * 2 must stay in range
+    static constexpr mat4x4x perspective(fix16_t l, fix16_t t,
+                                         fix16_t r, fix16_t b,
+                                         fix16_t n, fix16_t f)
+    {
+        fix16_t n2 = n + n;
+        fix16_t rml = r - l;
+        fix16_t tmb = t - b;
+        fix16_t fmn = f - n;
+        fix16_t x = n2 / rml;
+        fix16_t y = n2 / tmb;
+        fix16_t A = (r + l) / rml;
+        fix16_t B = (t + b) / tmb;
+        fix16_t C = -(f + n) / fmn;
+        fix16_t D = -(f * n2) / fmn;
+        return {
+            { x, 0, A, 0 },
+            { 0, y, B, 0 },
+            { 0, 0, C, D },
+            { 0, 0, -1, 0 }
+        };
+    }
+
+    // Each result is the columns weighted by x, y, z, and w taken as 1
+    void transform(vec4x *dst, vec4x const *src, size_t count) const
+    {
+        for (size_t i = 0; i < count; ++i) {
+            vec4x p = src[i];
+            dst[i] = {
+                row_dot(0, p.x, p.y, p.z, 1),
+                row_dot(1, p.x, p.y, p.z, 1),
+                row_dot(2, p.x, p.y, p.z, 1),
+                row_dot(3, p.x, p.y, p.z, 1)
+            };
+        }
+    }
+};
@@ -0,0 +1,161 @@
+#include "xform.h"
+#include "polygon.h"
+#include "render.h"
+#include "malloc.h"
+#include "string.h"
+#include "likely.h"
+#include "math/math.h"
+#include "dispatch.h"
+
+// Lowers to SSE on x86_64, NEON on aarch64, and
+// to scalar code where there is no vector unit
+typedef float v4sf _vector_size(16);
+typedef int32_t v4si _vector_size(16);
+
+static_assert(sizeof(v4sf) == XFORM_LANES * sizeof(float),
+    "Groups must be one vector");
+
+bool xform_batch_init(xform_batch_t *batch, size_t capacity)
+{
+    capacity = (capacity + XFORM_LANES - 1) & -XFORM_LANES;
+
+    size_t bytes = capacity * sizeof(float);
+
+    batch->x = (float*)malloc_aligned(bytes, sizeof(v4sf));
+    batch->y = (float*)malloc_aligned(bytes, sizeof(v4sf));
+    batch->z = (float*)malloc_aligned(bytes, sizeof(v4sf));
+    batch->w = (float*)malloc_aligned(bytes, sizeof(v4sf));
+    batch->outcode = (uint8_t*)malloc(capacity);
+    batch->capacity = capacity;
+
+    if (unlikely(!batch->x || !batch->y || !batch->z || !batch->w ||
+            !batch->outcode)) {
+        xform_batch_free(batch);
+        return false;
+    }
+
+    // The lanes past the last vertex are still transformed,
+    // keep them from holding garbage
+    memset(batch->x, 0, bytes);
+    memset(batch->y, 0, bytes);
+    memset(batch->z, 0, bytes);
+    memset(batch->w, 0, bytes);
+    memset(batch->outcode, 0, capacity);
+
+    return true;
+}
+
+void xform_batch_free(xform_batch_t *batch)
+{
+    free(batch->x);
+    free(batch->y);
+    free(batch->z);
+    free(batch->w);
+    free(batch->outcode);
+
+    memset(batch, 0, sizeof(*batch));
+}
+
+// Built once per instruction set by the variants below
+static _always_inline int xform_project_body(xform_batch_t *out,
+    xform_batch_t const *in, mat4x4 const& m, size_t count, int *all_out)
+{
+    v4sf m00 = v4sf{} + m.m[0][0], m01 = v4sf{} + m.m[0][1];
+    v4sf m02 = v4sf{} + m.m[0][2], m03 = v4sf{} + m.m[0][3];
+    v4sf m10 = v4sf{} + m.m[1][0], m11 = v4sf{} + m.m[1][1];
+    v4sf m12 = v4sf{} + m.m[1][2], m13 = v4sf{} + m.m[1][3];
+    v4sf m20 = v4sf{} + m.m[2][0], m21 = v4sf{} + m.m[2][1];
+    v4sf m22 = v4sf{} + m.m[2][2], m23 = v4sf{} + m.m[2][3];
+    v4sf m30 = v4sf{} + m.m[3][0], m31 = v4sf{} + m.m[3][1];
+    v4sf m32 = v4sf{} + m.m[3][2], m33 = v4sf{} + m.m[3][3];
+
+    v4sf half_width = v4sf{} + float(render_surface.width) * 0.5f;
+    v4sf half_height = v4sf{} + float(render_surface.height) * 0.5f;
+    v4sf half = v4sf{} + 0.5f;
+    v4sf one = v4sf{} + 1.0f;
+    v4sf zero = {};
+
+    v4si lane = { 0, 1, 2, 3 };
+    v4si any = {};
+    v4si all = { -1, -1, -1, -1 };
+
+    for (size_t i = 0; i < count; i += XFORM_LANES) {
+        v4sf x = *(v4sf const*)(in->x + i);
+        v4sf y = *(v4sf const*)(in->y + i);
+        v4sf z = *(v4sf const*)(in->z + i);
+
+        v4sf cx = x * m00 + y * m01 + z * m02 + m03;
+        v4sf cy = x * m10 + y * m11 + z * m12 + m13;
+        v4sf cz = x * m20 + y * m21 + z * m22 + m23;
+        v4sf cw = x * m30 + y * m31 + z * m32 + m33;
+
+        // Plane distances as vec4::dot_clip_plane,
+        // each compare is -1 in the lanes that are outside
+        v4si code = ((cw + cx < zero) & 1) |
+                ((cw - cx < zero) & 2) |
+                ((cw + cy < zero) & 4) |
+                ((cw - cy < zero) & 8) |
+                ((cw + cz < zero) & 16) |
+                ((cw - cz < zero) & 32);
+
+        // Only the lanes holding vertices count towards the batch
+        v4si valid = lane < v4si{} + int32_t(count - i);
+        any |= code & valid;
+        all &= code | ~valid;
+
+        for (size_t k = 0; k < XFORM_LANES; ++k)
+            out->outcode[i + k] = uint8_t(code[k]);
+
+        v4sf rw = one / cw;
+
+        *(v4sf*)(out->x + i) = (cx * rw + one) * half_width;
+        *(v4sf*)(out->y + i) = (cy * rw + one) * half_height;
+        *(v4sf*)(out->z + i) = (cz * rw + one) * half;
+        *(v4sf*)(out->w + i) = rw;
+    }
+
+    int any_out = 0;
+    int every_out = CLIP_ALL_PLANES;
+
+    for (size_t k = 0; k < XFORM_LANES; ++k) {
+        any_out |= any[k];
+        every_out &= all[k];
+    }
+
+    *all_out = every_out;
+
+    return any_out;
+}
+
+static int xform_project_base(xform_batch_t *out, xform_batch_t const *in,
+    mat4x4 const& m, size_t count, int *all_out)
+{
+    return xform_project_body(out, in, m, count, all_out);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// VEX encoded. Not fused into multiply-adds, which round once instead
+// of twice, so the results match the base variant and mat4x4::transform
+// bit for bit, and a vertex lands on the same pixels whichever is used
+_target("avx2")
+static int xform_project_avx2(xform_batch_t *out, xform_batch_t const *in,
+    mat4x4 const& m, size_t count, int *all_out)
+{
+    return xform_project_body(out, in, m, count, all_out);
+}
+#endif
+
+static dispatch_variant_t<xform_project_fn*> const xform_project_variants[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "avx2", CPU_AVX2, xform_project_avx2 },
+#endif
+    { "base", 0, xform_project_base }
+};
+
+xform_project_fn *xform_project = xform_project_base;
+
+void xform_dispatch(uint32_t features)
+{
+    dispatch_bind("xform_project", &xform_project,
+            xform_project_variants, features);
+}
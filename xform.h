@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "vec.h"
+
+// Batched vertex stage. Positions are kept in structure of arrays form,
+// so each step of the transform works on several vertices at once, and
+// transform, outcode, perspective divide and viewport transform are done
+// in one pass over the batch
+
+// Vertices are processed in groups of this many
+static constexpr size_t XFORM_LANES = 4;
+
+struct xform_batch_t {
+    // Each array has room for capacity vertices, rounded up to a whole
+    // group, and is 16 byte aligned
+    float *x;
+    float *y;
+    float *z;
+    float *w;
+
+    // Clip outcode of each vertex, as vec4::outcode
+    uint8_t *outcode;
+
+    size_t capacity;
+};
+
+// Returns false if out of memory
+bool xform_batch_init(xform_batch_t *batch, size_t capacity);
+
+void xform_batch_free(xform_batch_t *batch);
+
+// Transform count object space positions from in, with w taken as 1, by m,
+// like mat4x4::transform. Stores the outcode of each clip space position,
+// then the window space position as render_viewport, with 1/w in w.
+// Window positions are only meaningful for vertices in front of the eye.
+// Returns the outcode bits set by any vertex, and sets *all_out to the
+// bits set by every vertex, so a whole batch can be trivially accepted
+// or rejected. Bound to the best variant for the CPU, see dispatch.h
+typedef int xform_project_fn(xform_batch_t *out, xform_batch_t const *in,
+    mat4x4 const& m, size_t count, int *all_out);
+
+extern xform_project_fn *xform_project;